@@ -26,46 +26,60 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <avr/sfr_defs.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
 
 #include "isr.h"
 #include "state.h"
 #include "types.h"
 #include "lcd.h"
+#include "disp.h"
 #include "ina219.h"
+#include "sample.h"
 #include "sound.h"
+#include "telemetry.h"
+#include "history.h"
+#include "load.h"
+#include "board.h"
 
 /* Initialize AVR peripherals */
 static void init_hw( void )
 {
   /* LCD Power */
-  PORTC &= ~_BV(PORTC1);
-  DDRC |= _BV(DDC1);
+  C_BOARD_LCD_POWER_PORT &= ~_BV(C_BOARD_LCD_POWER_BIT);
+  C_BOARD_LCD_POWER_DDR |= _BV(C_BOARD_LCD_POWER_BIT);
 
   /* OpAmp Power */
-  PORTB &= ~_BV(PORTB5);
-  DDRB |= _BV(DDB5);
+  C_BOARD_OPAMP_PORT &= ~_BV(C_BOARD_OPAMP_BIT);
+  C_BOARD_OPAMP_DDR |= _BV(C_BOARD_OPAMP_BIT);
 
   /* Pushbutton */
-  DDRB &= ~_BV(DDB4);
-  PORTB |= _BV(PORTB4); // Enable Pullup
+  C_BOARD_BUTTON_DDR &= ~_BV(C_BOARD_BUTTON_BIT);
+  C_BOARD_BUTTON_PORT |= _BV(C_BOARD_BUTTON_BIT); // Enable Pullup
 
   /* Encoder */
-  DDRB &= ~( _BV(DDB1) | _BV(DDB3) );
-  PORTB |= _BV(PORTB1) | _BV(PORTB3); // Enable Pullups
-
-  /* PWM Output */
-  PORTB &= ~_BV(PORTB2);
-  DDRB |= _BV(DDB2);
+  C_BOARD_ENCODER_A_DDR &= ~_BV(C_BOARD_ENCODER_A_BIT);
+  C_BOARD_ENCODER_A_PORT |= _BV(C_BOARD_ENCODER_A_BIT); // Enable Pullup
+  C_BOARD_ENCODER_B_DDR &= ~_BV(C_BOARD_ENCODER_B_BIT);
+  C_BOARD_ENCODER_B_PORT |= _BV(C_BOARD_ENCODER_B_BIT); // Enable Pullup
+
+  /* PWM Outputs */
+  C_BOARD_LOAD_A_PORT &= ~_BV(C_BOARD_LOAD_A_BIT);
+  C_BOARD_LOAD_A_DDR |= _BV(C_BOARD_LOAD_A_BIT);
+#if C_LOAD_CHANNELS > 1
+  C_BOARD_LOAD_B_PORT &= ~_BV(C_BOARD_LOAD_B_BIT);
+  C_BOARD_LOAD_B_DDR |= _BV(C_BOARD_LOAD_B_BIT);
+#endif
 
   /* LED */
-  PORTC &= ~_BV(PORTC3);
-  DDRC |= _BV(DDC3);
+  C_BOARD_LED_PORT &= ~_BV(C_BOARD_LED_BIT);
+  C_BOARD_LED_DDR |= _BV(C_BOARD_LED_BIT);
 
   /* Speaker */
-  PORTC &= ~_BV(PORTC2);
-  DDRC |= _BV(DDC2);
+  C_BOARD_SPEAKER_PORT &= ~_BV(C_BOARD_SPEAKER_BIT);
+  C_BOARD_SPEAKER_DDR |= _BV(C_BOARD_SPEAKER_BIT);
 
-  /* Timer 0 - 125kHz Frequency */ 
+  /* Timer 0 - 125kHz Frequency, CTC Mode for tone generation */ 
+  TCCR0A = _BV(WGM01);
   TCCR0B = _BV(CS01); // Clk Div 8
 
   /* Timer 2 - 32.768kHz External Crystal */
@@ -76,19 +90,43 @@ static void init_hw( void )
   ASSR = _BV(AS2); // Enable crystal oscillator
 
   /* Timer 1 - 1MHz Frequency */
-  TCCR1A = _BV(COM1B1) | _BV(WGM10) | 
-           _BV(WGM11);   // Clear on compare match, Fast PWM Mode, TOP=OCR1A, OC1B output
+#if C_LOAD_CHANNELS > 1
+  TCCR1A = _BV(COM1A1) | _BV(COM1B1) | _BV(WGM11); // Clear on compare match, OC1A and OC1B outputs
+#else
+  TCCR1A = _BV(COM1B1) | _BV(WGM11); // Clear on compare match, OC1B output
+#endif
+
+  TCCR1B = _BV(CS10) | _BV(WGM12) | _BV(WGM13); // Clk div 1, Fast PWM Mode - TOP=ICR1
+
+  ICR1 = C_LOAD_PWM_TOP;           // PWM period, 1kHz at 999
+  OCR1A = 0;                       // 0% duty cycle initially
+  OCR1B = 0;
+  TIMSK1 = _BV(TOIE1);             // Interrupt every PWM period
+}
 
-  TCCR1B = _BV(CS10) | _BV(WGM12) | _BV(WGM13); // Clk div 1, CTC Mode - TOP=OCR 
+/* Sleep until the next interrupt. Must be called with interrupts disabled;
+ * they are enabled again on return */
+static void EventLoopSleep( void )
+{
+  /* Idle only. Timer1 runs the load PWM and the 1ms tick from reset on, 
+   * and every deeper mode stops its clock */
+  set_sleep_mode( SLEEP_MODE_IDLE );
 
-  OCR1A = 1000;                    // 1kHz compare match rate
-  OCR1B = 0;                       // 0% duty cycle initially
-  TIMSK1 = _BV(OCIE1A);            // Enable compare match interrupt
+  ISRSetSleeping( TRUE );
+  sleep_enable();
+
+  /* The instruction after sei is always executed, so an interrupt that 
+   * posts a flag after the check in the event loop still wakes us */
+  sei();
+  sleep_cpu();
+
+  sleep_disable();
+  ISRSetSleeping( FALSE );
 }
 
 int main( void )
 {
-  uint8 u_Flags;
+  ISREventType z_Event;
 
   /* Set system clock to 1MHz ( 8MHz div 8 ) */
   CLKPR = _BV(CLKPCE);
@@ -101,39 +139,58 @@ int main( void )
   lcd_init(LCD_DISP_ON);
 
   /* clear display and home cursor */
-  lcd_clrscr();
+  DispInit();
         
   /* put string to display (line 1) with linefeed */
-  lcd_puts(" Battery Buddy\n");
+  DispPuts_P(" Battery Buddy\n");
 
   /* cursor is now on second line, write second line */
-  lcd_puts("      v1.0");
-  
-  /* Play opening ditty */
-  playNote( 3033, 100 );
-  playNote( 2551, 100 );
-  playNote( 1911, 100 );
-
-  _delay_ms(2000);
+  DispPuts_P("      v1.0");
+  DispFlush();
 
-  lcd_clrscr();
+  /* Initialize current monitors */
+  SampleInit();
 
-  /* Initialize current monitor */
-  ina219_init();
+  /* Sample stream on the otherwise unused USART */
+  TelemetryInit();
 
-  _delay_ms(2);
+  /* Find the newest discharge record */
+  HistoryInit();
 
   /* Enable Interrupts */
   sei();
+  
+  /* Play opening ditty in the background while the banner is shown */
+  SoundPlay( z_MelodyStartup, 1 );
+
+  _delay_ms(2000);
+
+  /* Discard anything that happened during the banner */
+  ISRFlushEvents();
+
+  DispClear();
 
   /* Event Loop */
   while( 1 )
   {
-    if( ( u_Flags = ISRGetFlags() ) == 0 )
+    cli();
+
+    if( !ISRGetEvent( &z_Event ) )
+    {
+      EventLoopSleep();
       continue;
+    }
+
+    sei();
+
+    /* Main State Machine. Drain everything pending before redrawing */
+    do
+    {
+      StateProcessFlags( z_Event.u_Flags, z_Event.w_Timestamp );
+    } while( ISRGetEvent( &z_Event ) );
 
-    /* Main State Machine */
-    StateProcessFlags( u_Flags );
+    /* Send whatever changed on screen */
+    DispFlush();
   }
 
   return 0;
@@ -0,0 +1,110 @@
+/* 
+board.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <avr/io.h>
+
+/* Board configuration. Everything that depends on how the ATmega168 is 
+ * wired lives here, so a board variant only needs this file changed */
+
+/* Number of load channels fitted. Channel A is driven from OC1B ( PB2 ). A 
+ * second channel can be driven from OC1A ( PB1 ), which needs the encoder 
+ * moved off PB1. The channels are driven alike, as one load in parallel, 
+ * and measured by the one INA219 */
+#ifndef C_BOARD_LOAD_CHANNELS
+#define C_BOARD_LOAD_CHANNELS 1
+#endif
+
+#if ( C_BOARD_LOAD_CHANNELS < 1 ) || ( C_BOARD_LOAD_CHANNELS > 2 )
+#error "Only the two Timer1 compare outputs can drive a load"
+#endif
+
+/* INA219 sensors on the TWI bus, at most C_INA219_MAX_DEVICES. The first
+ * measures the load and is the one regulated and integrated on. Each entry
+ * is address, calibration, averaged config and fast config */
+#ifndef C_BOARD_INA219_COUNT
+#define C_BOARD_INA219_COUNT 1
+#endif
+
+#define C_BOARD_INA219_0 \
+  { 0x80, C_INA219_CAL_DEFAULT, C_INA219_CONFIG_AVERAGED, C_INA219_CONFIG_FAST }
+#define C_BOARD_INA219_1 \
+  { 0x82, C_INA219_CAL_DEFAULT, C_INA219_CONFIG_AVERAGED, C_INA219_CONFIG_FAST }
+#define C_BOARD_INA219_2 \
+  { 0x88, C_INA219_CAL_DEFAULT, C_INA219_CONFIG_AVERAGED, C_INA219_CONFIG_FAST }
+#define C_BOARD_INA219_3 \
+  { 0x8A, C_INA219_CAL_DEFAULT, C_INA219_CONFIG_AVERAGED, C_INA219_CONFIG_FAST }
+
+/* Load PWM outputs. Fixed by the Timer1 compare pins */
+#define C_BOARD_LOAD_A_DDR      DDRB
+#define C_BOARD_LOAD_A_PORT     PORTB
+#define C_BOARD_LOAD_A_BIT      PORTB2
+#define C_BOARD_LOAD_B_DDR      DDRB
+#define C_BOARD_LOAD_B_PORT     PORTB
+#define C_BOARD_LOAD_B_BIT      PORTB1
+
+/* Load OpAmp power, shared by all channels */
+#define C_BOARD_OPAMP_DDR       DDRB
+#define C_BOARD_OPAMP_PORT      PORTB
+#define C_BOARD_OPAMP_BIT       PORTB5
+
+/* Pushbutton, active low with pullup */
+#define C_BOARD_BUTTON_DDR      DDRB
+#define C_BOARD_BUTTON_PORT     PORTB
+#define C_BOARD_BUTTON_PIN      PINB
+#define C_BOARD_BUTTON_BIT      PORTB4
+
+/* Encoder, with pullups. A is the clocking phase. With a second load 
+ * channel A moves to PC0, the only spare pin */
+#if C_BOARD_LOAD_CHANNELS == 1
+#define C_BOARD_ENCODER_A_DDR   DDRB
+#define C_BOARD_ENCODER_A_PORT  PORTB
+#define C_BOARD_ENCODER_A_PIN   PINB
+#define C_BOARD_ENCODER_A_BIT   PORTB1
+#else
+#define C_BOARD_ENCODER_A_DDR   DDRC
+#define C_BOARD_ENCODER_A_PORT  PORTC
+#define C_BOARD_ENCODER_A_PIN   PINC
+#define C_BOARD_ENCODER_A_BIT   PORTC0
+#endif
+
+#define C_BOARD_ENCODER_B_DDR   DDRB
+#define C_BOARD_ENCODER_B_PORT  PORTB
+#define C_BOARD_ENCODER_B_PIN   PINB
+#define C_BOARD_ENCODER_B_BIT   PORTB3
+
+/* LCD power */
+#define C_BOARD_LCD_POWER_DDR   DDRC
+#define C_BOARD_LCD_POWER_PORT  PORTC
+#define C_BOARD_LCD_POWER_BIT   PORTC1
+
+/* LED */
+#define C_BOARD_LED_DDR         DDRC
+#define C_BOARD_LED_PORT        PORTC
+#define C_BOARD_LED_BIT         PORTC3
+
+/* Speaker, toggled by writing its PIN register */
+#define C_BOARD_SPEAKER_DDR     DDRC
+#define C_BOARD_SPEAKER_PORT    PORTC
+#define C_BOARD_SPEAKER_PIN     PINC
+#define C_BOARD_SPEAKER_BIT     PORTC2
+
+#endif
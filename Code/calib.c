@@ -0,0 +1,186 @@
+/* 
+calib.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include "types.h"
+#include "load.h"
+#include "control.h"
+#include "nvmap.h"
+#include "nvm.h"
+#include "calib.h"
+
+#define C_CALIB_SETTLE_SAMPLES 12 /* Conversions ignored after each step */
+#define C_CALIB_AVG_SAMPLES    8  /* Conversions averaged per point */
+#define C_CALIB_UNMEASURED     0xFFFF
+
+/* The table is kept in a ring of C_CALIB_SLOTS slots, so a reset while a 
+ * new table is written leaves the previous one in place */
+#define C_CALIB_SLOTS 2
+
+typedef struct
+{
+  uint16 w_Current[C_CALIB_POINTS]; /* 0.1mA at duty ( i + 1 ) * C_CALIB_DUTY_STEP */
+} CalibTableType;
+
+typedef struct
+{
+  uint8 u_Sequence;
+  CalibTableType z_Table;
+  uint16 w_Crc;
+} CalibRecordType;
+
+static const NvmRingType z_CalibRing = 
+  { C_NVM_ADDR_CALIB, C_CALIB_SLOTS, sizeof( CalibRecordType ) };
+
+C_NVM_ASSERT_FITS( Calib, C_NVM_ADDR_CALIB, C_CALIB_SLOTS * sizeof( CalibRecordType ), C_NVM_ADDR_HISTORY );
+
+static CalibTableType z_Calib;
+static uint8 u_CalibValid = FALSE;
+
+/* Sweep state */
+static uint8  u_Step;
+static uint8  u_SampleCount;
+static uint32 q_Sum;
+
+/* Load calibration table from EEPROM */
+uint8 CalibReadEEPROM( void )
+{
+  CalibRecordType z_Record;
+
+  /* First point must have been measured for the table to be of any use */
+  if( ( NvmRingFindNewest( &z_CalibRing, &z_Record, NULL ) == C_CALIB_SLOTS ) || 
+      ( z_Record.z_Table.w_Current[0] == C_CALIB_UNMEASURED ) )
+  {
+    u_CalibValid = FALSE;
+    return( FALSE );
+  }
+
+  z_Calib = z_Record.z_Table;
+  u_CalibValid = TRUE;
+
+  return( TRUE );
+}
+
+/* Write calibration table to EEPROM. Table, sequence and CRC go in one 
+ * write, so the table read back is either this one or the previous one */
+static void CalibWriteEEPROM( void )
+{
+  CalibRecordType z_Record;
+
+  z_Record.z_Table = z_Calib;
+  NvmRingAppend( &z_CalibRing, &z_Record );
+}
+
+/* Returns duty cycle expected to produce w_Current ( mA ) */
+uint16 CalibFeedForward( uint16 w_Current )
+{
+  uint32 q_Target = (uint32)w_Current * 10;
+  uint16 w_LowDuty = 0;
+  uint16 w_LowCurrent = 0;
+  uint16 w_HighCurrent;
+  uint8  u_Index;
+
+  if( !u_CalibValid )
+    return( (uint16)( ( (uint32)w_Current * ( C_LOAD_PWM_TOP + 1 ) ) / ( 1094UL * C_LOAD_CHANNELS ) ) );
+
+  /* Find the segment containing the target and interpolate along it. Past 
+   * the last measured point the last segment is extrapolated */
+  for( u_Index = 0; u_Index < C_CALIB_POINTS; u_Index++ )
+  {
+    w_HighCurrent = z_Calib.w_Current[u_Index];
+
+    if( w_HighCurrent == C_CALIB_UNMEASURED )
+      break;
+
+    if( ( w_HighCurrent >= q_Target ) || ( u_Index == C_CALIB_POINTS - 1 ) ||
+        ( z_Calib.w_Current[u_Index + 1] == C_CALIB_UNMEASURED ) )
+    {
+      if( w_HighCurrent <= w_LowCurrent )
+        return( w_LowDuty );
+
+      q_Target = w_LowDuty + ( ( q_Target - w_LowCurrent ) * C_CALIB_DUTY_STEP ) / 
+                             ( w_HighCurrent - w_LowCurrent );
+      break;
+    }
+
+    w_LowDuty += C_CALIB_DUTY_STEP;
+    w_LowCurrent = w_HighCurrent;
+  }
+
+  if( q_Target > C_CONTROL_DUTY_MAX )
+    q_Target = C_CONTROL_DUTY_MAX;
+
+  return( (uint16)q_Target );
+}
+
+/* Start a calibration sweep */
+void CalibStart( void )
+{
+  uint8 u_Index;
+
+  for( u_Index = 0; u_Index < C_CALIB_POINTS; u_Index++ )
+    z_Calib.w_Current[u_Index] = C_CALIB_UNMEASURED;
+
+  u_Step = 0;
+  u_SampleCount = 0;
+  q_Sum = 0;
+
+  LoadSetDuty( C_CALIB_DUTY_STEP );
+}
+
+/* Advance the sweep with a new conversion */
+CalibStatusEnumType CalibProcess( uint16 w_RawCurrent )
+{
+  /* Let the load settle after each step before averaging */
+  if( ++u_SampleCount <= C_CALIB_SETTLE_SAMPLES )
+    return( CALIB_RUNNING );
+
+  q_Sum += w_RawCurrent;
+
+  if( u_SampleCount < C_CALIB_SETTLE_SAMPLES + C_CALIB_AVG_SAMPLES )
+    return( CALIB_RUNNING );
+
+  z_Calib.w_Current[u_Step] = q_Sum / C_CALIB_AVG_SAMPLES;
+  u_SampleCount = 0;
+  q_Sum = 0;
+
+  if( ( ++u_Step == C_CALIB_POINTS ) || 
+      ( z_Calib.w_Current[u_Step - 1] > C_CALIB_MAX_CURRENT ) )
+  {
+    LoadSetDuty( 0 );
+
+    /* A load that never draws current is not worth storing */
+    if( z_Calib.w_Current[0] == 0 )
+      return( CALIB_FAILED );
+
+    CalibWriteEEPROM();
+    u_CalibValid = TRUE;
+
+    return( CALIB_DONE );
+  }
+
+  LoadSetDuty( ( u_Step + 1 ) * C_CALIB_DUTY_STEP );
+
+  return( CALIB_RUNNING );
+}
+
+/* Returns index of the point currently being measured */
+uint8 CalibGetStep( void )
+{
+  return( u_Step );
+}
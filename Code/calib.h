@@ -0,0 +1,62 @@
+/* 
+calib.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef CALIB_H
+#define CALIB_H
+
+#include "types.h"
+#include "load.h"
+
+/* The load is calibrated by stepping the duty cycle through C_CALIB_POINTS
+ * evenly spaced values and recording the measured current at each. The
+ * resulting piecewise linear table is stored in EEPROM and used to compute
+ * the feed-forward duty cycle for a requested current */
+#define C_CALIB_POINTS      12
+#define C_CALIB_DUTY_STEP   ( ( C_LOAD_PWM_TOP + 1 ) * 2 / 25 ) /* Timer1 counts between points, 80 at 1000 */
+#define C_CALIB_MAX_CURRENT ( 11000 * C_LOAD_CHANNELS ) /* 0.1mA. Sweep stops early above this */
+
+typedef enum
+{
+  CALIB_RUNNING,
+  CALIB_DONE,
+  CALIB_FAILED
+} CalibStatusEnumType;
+
+/* Load calibration table from EEPROM
+ *   Returns TRUE if success, FALSE if there is no valid table
+ */
+uint8 CalibReadEEPROM( void );
+
+/* Returns duty cycle expected to produce w_Current ( mA ). Falls back to the
+ * nominal 1.094mA per count if no calibration is available */
+uint16 CalibFeedForward( uint16 w_Current );
+
+/* Start a calibration sweep. Load must be powered */
+void CalibStart( void );
+
+/* Advance the sweep with a new conversion
+ *   w_RawCurrent - Measured load current in 0.1mA
+ *   Returns sweep status. Table is written to EEPROM on CALIB_DONE
+ */
+CalibStatusEnumType CalibProcess( uint16 w_RawCurrent );
+
+/* Returns index of the point currently being measured */
+uint8 CalibGetStep( void );
+
+#endif
@@ -0,0 +1,58 @@
+/* 
+checkpoint.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include "types.h"
+#include "nvmap.h"
+#include "nvm.h"
+#include "checkpoint.h"
+
+static const NvmRingType z_CheckpointRing = 
+  { C_NVM_ADDR_CHECKPOINT, C_CHECKPOINT_SLOTS, sizeof( CheckpointRecordType ) };
+
+C_NVM_ASSERT_FITS( Checkpoint, C_NVM_ADDR_CHECKPOINT, C_CHECKPOINT_SLOTS * sizeof( CheckpointRecordType ), C_NVM_ADDR_PROFILE );
+
+/* Save a checkpoint */
+void CheckpointSave( CheckpointRecordType *p_Record )
+{
+  p_Record->u_Active = TRUE;
+  NvmRingAppend( &z_CheckpointRing, p_Record );
+}
+
+/* Read the newest checkpoint. A slot torn by a reset fails its CRC, so the 
+ * record before it is found instead */
+uint8 CheckpointRead( CheckpointRecordType *p_Record )
+{
+  if( NvmRingFindNewest( &z_CheckpointRing, p_Record, NULL ) == C_CHECKPOINT_SLOTS )
+    return( FALSE );
+
+  return( p_Record->u_Active );
+}
+
+/* Mark the session as ended */
+void CheckpointClear( void )
+{
+  CheckpointRecordType z_Record;
+
+  /* Only costs a write if there is an active session */
+  if( CheckpointRead( &z_Record ) )
+  {
+    z_Record.u_Active = FALSE;
+    NvmRingAppend( &z_CheckpointRing, &z_Record );
+  }
+}
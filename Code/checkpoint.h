@@ -0,0 +1,65 @@
+/* 
+checkpoint.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "types.h"
+
+/* Discharge checkpoints. While discharging, the session is saved every 
+ * C_CHECKPOINT_INTERVAL seconds so it can be resumed after a reset. Records 
+ * go round a ring of C_CHECKPOINT_SLOTS slots, so the previous checkpoint is 
+ * never overwritten by the one being written and a reset during the write 
+ * only loses that one. A reset loses at most C_CHECKPOINT_INTERVAL seconds 
+ * of discharge. At 100,000 write cycles each slot lasts 
+ * C_CHECKPOINT_SLOTS * C_CHECKPOINT_INTERVAL * 100,000 seconds of 
+ * discharging, over four months of continuous use. The session's
+ * settings are not repeated here, they are the newest config record as 
+ * that is written when the discharge starts */
+#define C_CHECKPOINT_SLOTS    4
+#define C_CHECKPOINT_INTERVAL 30  /* Seconds */
+
+typedef struct
+{
+  uint8  u_Sequence;            /* Previous record's sequence + 1 */
+  uint8  u_Active;              /* FALSE once the session has ended */
+  uint16 w_CapacityDischarged;  /* mAh */
+  uint16 w_CapacityRemainder;   /* mA seconds */
+  uint16 w_CapacityFraction;
+  uint16 w_EnergyDischarged;    /* 10mWh */
+  uint32 q_EnergyRemainder;     /* uJ */
+  uint8  u_Hours;
+  uint8  u_Minutes;
+  uint8  u_Seconds;
+  uint16 w_Duty;                /* Regulator output, used to reseed it */
+  uint16 w_Crc;                 /* CRC-CCITT of all preceding bytes */
+} CheckpointRecordType;
+
+/* Save a checkpoint. Sequence, active flag and CRC are filled in here */
+void CheckpointSave( CheckpointRecordType *p_Record );
+
+/* Read the newest checkpoint
+ *   Returns TRUE if it belongs to a session that never ended
+ */
+uint8 CheckpointRead( CheckpointRecordType *p_Record );
+
+/* Mark the session as ended so it is not offered for resume */
+void CheckpointClear( void );
+
+#endif
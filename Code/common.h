@@ -28,7 +28,11 @@ typedef struct
   uint16 w_ADCCurrent;
   uint16 w_CutoffVoltage;
   uint16 w_DischargeCurrent;
-  uint32 q_CapacityDischarged;
+  uint16 w_CapacityDischarged;   /* mAh */
+  uint16 w_CapacityRemainder;    /* mA seconds, below 3600 */
+  uint16 w_CapacityFraction;     /* 1/C_CHARGE_UNITS_PER_MAS mA seconds */
+  uint16 w_EnergyDischarged;     /* 10mWh */
+  uint32 q_EnergyRemainder;      /* uJ, below C_ENERGY_UJ_PER_UNIT */
   uint8  u_Hours;
   uint8  u_Minutes;
   uint8  u_Seconds;
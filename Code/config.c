@@ -18,58 +18,62 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
 #include "common.h"
-#include <avr/eeprom.h>
+#include <string.h>
 #include "types.h"
 #include "isr.h"
-#include "lcd.h"
+#include "disp.h"
+#include "nvmap.h"
+#include "nvm.h"
 
 #define extern
 #include "config.h"
 #undef extern
 
-/* Write configuration parameters to EEPROM 
- *   Returns TRUE if success, FALSE if failure
- */
-uint8 ConfigWriteEEPROM( z_ConfigStructType *p_Config )
-{
-  uint16 w_Checksum = 0;
-  uint8 *p_Current = (uint8 *)p_Config;
-  uint8 *p_End = (uint8 *)p_Config + ( sizeof( z_ConfigStructType ) - 1 );
+/* Config is kept in a ring of C_CONFIG_SLOTS slots. Bump C_CONFIG_VERSION
+ * whenever z_ConfigStructType changes so old records fall back to defaults */
+#define C_CONFIG_SLOTS   4
+#define C_CONFIG_VERSION 4
 
-  /* Compute checksum */
-  while( p_Current <= p_End )
-  {
-    w_Checksum ^= *p_Current++;
-  }
-
-  /* Write structure to EEPROM */
-  eeprom_write_block( p_Config, (uint8 *) 0, sizeof( z_ConfigStructType ) );
+typedef struct
+{
+  uint8 u_Sequence;
+  uint8 u_Version;
+  z_ConfigStructType z_Config;
+  uint16 w_Crc;
+} ConfigRecordType;
 
-  /* Write Checksum */
-  eeprom_write_block( &w_Checksum, (uint8 *)sizeof( z_ConfigStructType ), 
-                      sizeof( w_Checksum ) );
+static const NvmRingType z_ConfigRing = 
+  { C_NVM_ADDR_CONFIG, C_CONFIG_SLOTS, sizeof( ConfigRecordType ) };
 
-  return( TRUE );
-}
+C_NVM_ASSERT_FITS( Config, C_NVM_ADDR_CONFIG, C_CONFIG_SLOTS * sizeof( ConfigRecordType ), C_NVM_SIZE );
 
-/* Attempt to read configuration from EEPROM
+/* Layout of the pre-ring config record */
+typedef struct
+{
+  uint8 u_Mode;
+  uint8 u_CellType;
+  uint8 u_NumCells;
+  uint8 u_DischargeCurrent;
+  uint16 w_DischargeCurrentCustom;
+} ConfigLegacyType;
+
+/* Read the pre-ring config record ( structure plus XOR checksum ) so an 
+ * upgrade keeps the user's settings
  *   Returns TRUE if success, FALSE if failure
  */
-uint8 ConfigReadEEPROM( z_ConfigStructType *p_Config )
+static uint8 ConfigReadLegacy( z_ConfigStructType *p_Config )
 {
-  z_ConfigStructType z_ReadStruct;
+  ConfigLegacyType z_ReadStruct;
 
   uint16 w_ChecksumRead;
   uint16 w_ChecksumComputed = 0;
 
   uint8 *p_Current = (uint8 *)&z_ReadStruct;
-  uint8 *p_End = (uint8 *)&z_ReadStruct + ( sizeof( z_ConfigStructType ) - 1 );
+  uint8 *p_End = (uint8 *)&z_ReadStruct + ( sizeof( ConfigLegacyType ) - 1 );
 
-  /* Read structure from EEPROM */
-  eeprom_read_block( &z_ReadStruct, (uint8 *) 0, sizeof( z_ConfigStructType ) );
-
-  /* Read checksum */
-  eeprom_read_block( &w_ChecksumRead, (uint8 *)sizeof( z_ConfigStructType ), sizeof( w_ChecksumRead ) );
+  NvmRead( C_NVM_ADDR_CONFIG_LEGACY, &z_ReadStruct, sizeof( ConfigLegacyType ) );
+  NvmRead( C_NVM_ADDR_CONFIG_LEGACY + sizeof( ConfigLegacyType ), &w_ChecksumRead, 
+           sizeof( w_ChecksumRead ) );
 
   /* Compute Checksum */
   while( p_Current <= p_End )
@@ -79,7 +83,15 @@ uint8 ConfigReadEEPROM( z_ConfigStructType *p_Config )
 
   if( w_ChecksumComputed == w_ChecksumRead )
   {
-    *p_Config = z_ReadStruct;
+    p_Config->e_Mode = z_ReadStruct.u_Mode;
+    p_Config->e_CellType = z_ReadStruct.u_CellType;
+    p_Config->u_NumCells = z_ReadStruct.u_NumCells;
+    p_Config->e_DischargeCurrent = z_ReadStruct.u_DischargeCurrent;
+    p_Config->w_DischargeCurrentCustom = z_ReadStruct.w_DischargeCurrentCustom;
+    p_Config->w_Power = C_CONFIG_DEFAULT_POWER;
+    p_Config->w_Resistance = C_CONFIG_DEFAULT_RESISTANCE;
+    p_Config->w_TaperEnd = C_CONFIG_DEFAULT_TAPER_END;
+    p_Config->u_Profile = 0;
     return( TRUE );
   }
   else
@@ -88,15 +100,56 @@ uint8 ConfigReadEEPROM( z_ConfigStructType *p_Config )
   }
 }
 
+/* Write configuration parameters to EEPROM. Nothing is written if the 
+ * newest record already holds them, otherwise the write is queued and 
+ * programmed in the background
+ *   Returns TRUE if success, FALSE if failure
+ */
+uint8 ConfigWriteEEPROM( z_ConfigStructType *p_Config )
+{
+  ConfigRecordType z_Record;
+
+  if( ( NvmRingFindNewest( &z_ConfigRing, &z_Record, NULL ) != C_CONFIG_SLOTS ) &&
+      ( z_Record.u_Version == C_CONFIG_VERSION ) &&
+      !memcmp( &z_Record.z_Config, p_Config, sizeof( z_ConfigStructType ) ) )
+  {
+    return( TRUE );
+  }
+
+  z_Record.u_Version = C_CONFIG_VERSION;
+  z_Record.z_Config = *p_Config;
+  NvmRingAppend( &z_ConfigRing, &z_Record );
+
+  return( TRUE );
+}
+
+/* Attempt to read configuration from EEPROM
+ *   Returns TRUE if success, FALSE if failure
+ */
+uint8 ConfigReadEEPROM( z_ConfigStructType *p_Config )
+{
+  ConfigRecordType z_Record;
+
+  if( NvmRingFindNewest( &z_ConfigRing, &z_Record, NULL ) == C_CONFIG_SLOTS )
+    return( ConfigReadLegacy( p_Config ) );
+
+  if( z_Record.u_Version != C_CONFIG_VERSION )
+    return( FALSE );
+
+  *p_Config = z_Record.z_Config;
+
+  return( TRUE );
+}
+
 /* Utility function to handle configuration parameter selection via encoder 
  *   u_Flags - ISR flags
  *   p_Param - Pointer to configuration parameter
  *   u_ParamMin - Parameter minimum value
  *   u_ParamMax - Parameter maximum value
- *   p_String - Pointer to array of strings to be displayed for each value. If NULL display *p_Param instead
+ *   p_String - Program memory table of program memory strings to be displayed for each value. If NULL display *p_Param instead
  */
 void ConfigParameter( uint8 u_Flags, uint8 *p_Param, uint8 u_ParamMin, 
-                      uint8 u_ParamMax, char const **p_String )
+                      uint8 u_ParamMax, PGM_P const *p_String )
 {
   if( !( ( u_Flags & C_ISR_FLAG_ENCODER_CW ) | ( u_Flags & C_ISR_FLAG_ENCODER_CCW ) ) )
     return;
@@ -115,11 +168,11 @@ void ConfigParameter( uint8 u_Flags, uint8 *p_Param, uint8 u_ParamMin,
       (*p_Param)--;
   }
 
-  lcd_gotoxy(0,1);
+  DispGotoXY(0,1);
 
   if( p_String )
-    lcd_puts( p_String[*p_Param] );        
+    DispPutsTable_p( p_String, *p_Param );
   else
-    lcd_putc( *p_Param + 48 );
+    DispPutc( *p_Param + 48 );
 }
 
@@ -20,12 +20,24 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <avr/pgmspace.h>
 #include "types.h"
 
+#define C_CONFIG_DEFAULT_POWER      50   /* 0.1W */
+#define C_CONFIG_DEFAULT_RESISTANCE 100  /* 0.1 Ohm */
+#define C_CONFIG_DEFAULT_TAPER_END  50   /* mA, C/20 of a 1000mAh pack */
+
 typedef enum
 {
   MODE_FULL_DISCHARGE,
   MODE_STORAGE,
+  MODE_CONSTANT_POWER,
+  MODE_CONSTANT_RESISTANCE,
+  MODE_IR_TEST,
+  MODE_PROFILE,
+  MODE_WAVE,
+  MODE_CALIBRATE,
+  MODE_HISTORY,
   MODE_MAX
 } ModeEnumType;
 
@@ -53,6 +65,10 @@ typedef struct
   uint8 u_NumCells;
   DischargeCurrentEnumType e_DischargeCurrent;
   uint16 w_DischargeCurrentCustom;
+  uint16 w_Power;       /* 0.1W, constant power mode */
+  uint16 w_Resistance;  /* 0.1 Ohm, constant resistance mode */
+  uint16 w_TaperEnd;    /* mA, storage mode constant voltage phase ends below this */
+  uint8 u_Profile;      /* Profile mode, see profile.h */
 } z_ConfigStructType;
 
 extern z_ConfigStructType z_Config;
@@ -72,9 +88,9 @@ uint8 ConfigReadEEPROM( z_ConfigStructType *p_Config );
  *   p_Param - Pointer to configuration parameter
  *   u_ParamMin - Parameter minimum value
  *   u_ParamMax - Parameter maximum value
- *   p_String - Pointer to array of strings to be displayed for each value. If NULL display *p_Param instead
+ *   p_String - Program memory table of program memory strings to be displayed for each value. If NULL display *p_Param instead
  */
 void ConfigParameter( uint8 u_Flags, uint8 *p_Param, uint8 u_ParamMin, 
-                      uint8 u_ParamMax, char const **p_String );
+                      uint8 u_ParamMax, PGM_P const *p_String );
 
 #endif
@@ -0,0 +1,157 @@
+/* 
+control.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include "types.h"
+#include "control.h"
+
+static uint16 w_ControlSetpoint;
+static int32  q_Integral;        /* Q8 duty counts */
+static uint8  u_DividerCount;
+static uint8  u_Settling;        /* Conversions still to hold the feed-forward */
+static uint16 w_ControlDuty;     /* 1 / 2^C_LOAD_DITHER_BITS counts */
+static uint16 w_TaperVoltage;
+static uint16 w_TaperMax;
+static int32  q_TaperSetpoint;   /* Q8 0.1mA */
+
+/* Start regulating */
+void ControlStart( uint16 w_Setpoint, uint16 w_FeedForward )
+{
+  if( w_FeedForward > C_CONTROL_DUTY_MAX )
+    w_FeedForward = C_CONTROL_DUTY_MAX;
+
+  w_ControlSetpoint = w_Setpoint;
+  w_ControlDuty = w_FeedForward << C_LOAD_DITHER_BITS;
+  q_Integral = (int32)w_FeedForward << 8;
+  u_DividerCount = 0;
+  u_Settling = C_CONTROL_SETTLE_CONVERSIONS;
+}
+
+/* Change load current setpoint without resetting the integrator */
+void ControlSetSetpoint( uint16 w_Setpoint )
+{
+  w_ControlSetpoint = w_Setpoint;
+}
+
+/* Run one regulator update */
+uint16 ControlUpdate( uint16 w_RawCurrent )
+{
+  int16 i_Error;
+  int32 q_Output;
+  int32 q_NewIntegral;
+
+  /* The conversion in progress at the start saw the old load */
+  if( u_Settling )
+  {
+    u_Settling--;
+    return( w_ControlDuty );
+  }
+
+  if( ++u_DividerCount < C_CONTROL_DIVIDER )
+    return( w_ControlDuty );
+
+  u_DividerCount = 0;
+
+  i_Error = (int16)( w_ControlSetpoint - w_RawCurrent );
+
+  q_NewIntegral = q_Integral + (int32)i_Error * C_CONTROL_KI_Q8;
+  q_Output = q_NewIntegral + (int32)i_Error * C_CONTROL_KP_Q8;
+
+  /* Clamp the output and only let the integrator move if that does not push 
+   * it further into saturation ( anti-windup ) */
+  if( q_Output < 0 )
+  {
+    q_Output = 0;
+
+    if( i_Error > 0 )
+      q_Integral = q_NewIntegral;
+  }
+  else
+  if( q_Output > ( (int32)C_CONTROL_DUTY_MAX << 8 ) )
+  {
+    q_Output = (int32)C_CONTROL_DUTY_MAX << 8;
+
+    if( i_Error < 0 )
+      q_Integral = q_NewIntegral;
+  }
+  else
+  {
+    q_Integral = q_NewIntegral;
+  }
+
+  /* Keep the fraction the dither can resolve */
+  w_ControlDuty = (uint16)( q_Output >> ( 8 - C_LOAD_DITHER_BITS ) );
+
+  return( w_ControlDuty );
+}
+
+/* Load current that draws a given power at the present battery voltage */
+uint16 ControlPowerSetpoint( uint16 w_Power, uint16 w_Voltage )
+{
+  uint32 q_Current;
+
+  if( w_Voltage == 0 )
+    return( 0 );
+
+  /* 0.1W * 1000000 / mV = 0.1mA */
+  q_Current = (uint32)w_Power * 1000000UL / w_Voltage;
+
+  return( q_Current > C_CONTROL_SETPOINT_MAX ? C_CONTROL_SETPOINT_MAX : q_Current );
+}
+
+/* Load current of a given resistance at the present battery voltage */
+uint16 ControlResistanceSetpoint( uint16 w_Resistance, uint16 w_Voltage )
+{
+  uint32 q_Current;
+
+  if( w_Resistance == 0 )
+    return( C_CONTROL_SETPOINT_MAX );
+
+  /* mV * 100 / 0.1 Ohm = 0.1mA */
+  q_Current = (uint32)w_Voltage * 100 / w_Resistance;
+
+  return( q_Current > C_CONTROL_SETPOINT_MAX ? C_CONTROL_SETPOINT_MAX : q_Current );
+}
+
+/* Start the constant voltage taper */
+void ControlTaperStart( uint16 w_Voltage, uint16 w_Setpoint )
+{
+  w_TaperVoltage = w_Voltage;
+  w_TaperMax = w_Setpoint;
+  q_TaperSetpoint = (int32)w_Setpoint << 8;
+}
+
+/* Run one taper update. Above the target voltage the pack can take more 
+ * current, below it less. The setpoint never goes above the constant 
+ * current value it started from */
+uint16 ControlTaperUpdate( uint16 w_Voltage )
+{
+  int16 i_Error;
+
+  i_Error = (int16)( w_Voltage - w_TaperVoltage );
+
+  q_TaperSetpoint += (int32)i_Error * C_CONTROL_TAPER_KI_Q8;
+
+  if( q_TaperSetpoint < 0 )
+    q_TaperSetpoint = 0;
+  else
+  if( q_TaperSetpoint > ( (int32)w_TaperMax << 8 ) )
+    q_TaperSetpoint = (int32)w_TaperMax << 8;
+
+  return( (uint16)( q_TaperSetpoint >> 8 ) );
+}
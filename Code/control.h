@@ -0,0 +1,95 @@
+/* 
+control.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include "types.h"
+#include "load.h"
+
+/* Fixed point PI load current regulator. Runs from the sampling path once 
+ * every C_CONTROL_DIVIDER INA219 conversions ( ~59Hz / C_CONTROL_DIVIDER ). 
+ * Gains are per update, so retune them if the divider or the INA219 
+ * averaging is changed. They are tuned for one load channel; channels in 
+ * parallel draw C_LOAD_CHANNELS times the current per duty count, so the 
+ * gains are divided down to keep the loop gain the same */
+#define C_CONTROL_DIVIDER  1
+#define C_CONTROL_KP_Q8    ( 6 / C_LOAD_CHANNELS )  /* duty counts per 0.1mA of error, Q8 */
+#define C_CONTROL_KI_Q8    ( 12 / C_LOAD_CHANNELS ) /* duty counts per 0.1mA of error per update, Q8 */
+#define C_CONTROL_DUTY_MAX C_LOAD_DUTY_MAX
+
+/* Conversions after ControlStart that only hold the feed-forward: the one 
+ * in progress at the step, and the next, which still sees the PWM filter 
+ * settle. Acting on either winds the integrator up by most of the step, 
+ * which shows as an overshoot of up to 80% of the setpoint */
+#define C_CONTROL_SETTLE_CONVERSIONS 2
+#define C_CONTROL_SETPOINT_MAX ( 10000 * C_LOAD_CHANNELS ) /* 0.1mA, load current limit */
+
+/* Constant voltage taper. An outer integrating loop on the battery voltage
+ * that lowers the current setpoint to hold the loaded voltage at the target.
+ * A pack with internal resistance R ( Ohm ) sees a loop gain per update of
+ * C_CONTROL_TAPER_KI_Q8 / 256 * R / 10, so it is stable and well damped 
+ * for anything a pack can have, at the cost of a slow pull-in on very stiff
+ * packs. That is fine as the taper itself takes many minutes */
+#define C_CONTROL_TAPER_KI_Q8 128 /* 0.1mA per mV of error per update, Q8 */
+
+/* Start regulating. The feed-forward is held for the first 
+ * C_CONTROL_SETTLE_CONVERSIONS updates
+ *   w_Setpoint - Load current in 0.1mA
+ *   w_FeedForward - Initial duty cycle, used to seed the integrator
+ */
+void ControlStart( uint16 w_Setpoint, uint16 w_FeedForward );
+
+/* Change load current setpoint ( 0.1mA ) without resetting the integrator */
+void ControlSetSetpoint( uint16 w_Setpoint );
+
+/* Run one regulator update
+ *   w_RawCurrent - Measured load current in 0.1mA
+ *   Returns new duty cycle in 1 / 2^C_LOAD_DITHER_BITS counts, for 
+ *   LoadSetDutyFine
+ */
+uint16 ControlUpdate( uint16 w_RawCurrent );
+
+/* Load current that draws a given power at the present battery voltage
+ *   w_Power - 0.1W
+ *   w_Voltage - Battery voltage in mV
+ *   Returns load current setpoint in 0.1mA, at most C_CONTROL_SETPOINT_MAX
+ */
+uint16 ControlPowerSetpoint( uint16 w_Power, uint16 w_Voltage );
+
+/* Load current of a given resistance at the present battery voltage
+ *   w_Resistance - 0.1 Ohm
+ *   w_Voltage - Battery voltage in mV
+ *   Returns load current setpoint in 0.1mA, at most C_CONTROL_SETPOINT_MAX
+ */
+uint16 ControlResistanceSetpoint( uint16 w_Resistance, uint16 w_Voltage );
+
+/* Start the constant voltage taper
+ *   w_Voltage - Battery voltage to hold in mV
+ *   w_Setpoint - Present load current setpoint in 0.1mA, never exceeded
+ */
+void ControlTaperStart( uint16 w_Voltage, uint16 w_Setpoint );
+
+/* Run one taper update
+ *   w_Voltage - Measured battery voltage in mV
+ *   Returns new load current setpoint in 0.1mA
+ */
+uint16 ControlTaperUpdate( uint16 w_Voltage );
+
+#endif
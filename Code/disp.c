@@ -0,0 +1,151 @@
+/* 
+disp.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include <string.h>
+#include "types.h"
+#include "lcd.h"
+#include "disp.h"
+
+/* Unchanged cells between two dirty runs that are rewritten rather than 
+ * paying for another cursor move */
+#define C_DISP_MERGE_GAP 2
+
+static char a_Frame[C_DISP_ROWS][C_DISP_COLS];  /* What we want shown */
+static char a_Shown[C_DISP_ROWS][C_DISP_COLS];  /* What the LCD shows */
+static uint8 u_CursorX;
+static uint8 u_CursorY;
+
+/* Initialize shadow to match a freshly cleared LCD */
+void DispInit( void )
+{
+  lcd_clrscr();
+  memset( a_Shown, ' ', sizeof( a_Shown ) );
+  DispClear();
+}
+
+/* Clear shadow and home cursor */
+void DispClear( void )
+{
+  memset( a_Frame, ' ', sizeof( a_Frame ) );
+  u_CursorX = 0;
+  u_CursorY = 0;
+}
+
+/* Set shadow cursor position */
+void DispGotoXY( uint8 u_X, uint8 u_Y )
+{
+  u_CursorX = u_X;
+  u_CursorY = u_Y;
+}
+
+/* Put character at shadow cursor */
+void DispPutc( char c )
+{
+  if( c == '\n' )
+  {
+    u_CursorX = 0;
+
+    if( ++u_CursorY == C_DISP_ROWS )
+      u_CursorY = 0;
+  }
+  else
+  {
+    /* Characters past the end of the line are not visible. Drop them */
+    if( ( u_CursorX < C_DISP_COLS ) && ( u_CursorY < C_DISP_ROWS ) )
+      a_Frame[u_CursorY][u_CursorX] = c;
+
+    u_CursorX++;
+  }
+}
+
+/* Put string at shadow cursor */
+void DispPuts( const char *s )
+{
+  register char c;
+
+  while ( (c = *s++) )
+  {
+    DispPutc( c );
+  }
+}
+
+/* Put string from program memory at shadow cursor */
+void DispPuts_p( const char *progmem_s )
+{
+  register char c;
+
+  while ( (c = pgm_read_byte(progmem_s++)) )
+  {
+    DispPutc( c );
+  }
+}
+
+/* Put entry of a program memory string table at shadow cursor */
+void DispPutsTable_p( PGM_P const *p_Table, uint8 u_Index )
+{
+  DispPuts_p( (PGM_P)pgm_read_word( &p_Table[u_Index] ) );
+}
+
+/* Send changed cells to the LCD */
+void DispFlush( void )
+{
+  uint8 u_Row;
+  uint8 u_Col;
+  uint8 u_End;
+  uint8 u_Gap;
+
+  for( u_Row = 0; u_Row < C_DISP_ROWS; u_Row++ )
+  {
+    u_Col = 0;
+
+    while( u_Col < C_DISP_COLS )
+    {
+      if( a_Frame[u_Row][u_Col] == a_Shown[u_Row][u_Col] )
+      {
+        u_Col++;
+        continue;
+      }
+
+      /* Find end of this run, absorbing short clean gaps */
+      u_End = u_Col + 1;
+      u_Gap = 0;
+
+      while( ( u_End + u_Gap < C_DISP_COLS ) && ( u_Gap <= C_DISP_MERGE_GAP ) )
+      {
+        if( a_Frame[u_Row][u_End + u_Gap] != a_Shown[u_Row][u_End + u_Gap] )
+        {
+          u_End += u_Gap + 1;
+          u_Gap = 0;
+        }
+        else
+        {
+          u_Gap++;
+        }
+      }
+
+      lcd_gotoxy( u_Col, u_Row );
+
+      for( ; u_Col < u_End; u_Col++ )
+      {
+        lcd_putc( a_Frame[u_Row][u_Col] );
+        a_Shown[u_Row][u_Col] = a_Frame[u_Row][u_Col];
+      }
+    }
+  }
+}
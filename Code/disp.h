@@ -0,0 +1,60 @@
+/* 
+disp.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef DISP_H
+#define DISP_H
+
+#include <avr/pgmspace.h>
+#include "types.h"
+
+/* RAM shadow of the 16x2 LCD. Drawing functions only touch the shadow.
+ * DispFlush sends the cells that differ from what the LCD is showing, 
+ * merging nearby changes into a single cursor move */
+
+#define C_DISP_COLS 16
+#define C_DISP_ROWS 2
+
+/* Initialize shadow to match a freshly cleared LCD */
+void DispInit( void );
+
+/* Clear shadow and home cursor */
+void DispClear( void );
+
+/* Set shadow cursor position */
+void DispGotoXY( uint8 u_X, uint8 u_Y );
+
+/* Put character at shadow cursor. '\n' moves to start of the next line */
+void DispPutc( char c );
+
+/* Put string at shadow cursor */
+void DispPuts( const char *s );
+
+/* Put string from program memory at shadow cursor */
+void DispPuts_p( const char *progmem_s );
+
+/* Put entry u_Index of a program memory table of program memory strings */
+void DispPutsTable_p( PGM_P const *p_Table, uint8 u_Index );
+
+/* Put string literal at shadow cursor, keeping it in program memory */
+#define DispPuts_P(__s) DispPuts_p(PSTR(__s))
+
+/* Send changed cells to the LCD */
+void DispFlush( void );
+
+#endif
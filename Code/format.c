@@ -0,0 +1,88 @@
+/* 
+format.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include <avr/pgmspace.h>
+#include "types.h"
+#include "format.h"
+
+static const uint16 w_FormatPowers[C_FORMAT_FIELD_MAX] PROGMEM = { 10000, 1000, 100, 10, 1 };
+
+/* Render a number into a fixed width field */
+void FormatNumber( char *p_Buffer, uint16 w_Number, uint8 u_FieldSize, 
+                   uint8 u_DigitsAfterDecimal, char u_FillChar )
+{
+  const uint16 *p_Power;
+  uint16 w_Power;
+  uint8 u_Digit;
+  uint8 u_Count;
+  uint8 u_DecimalPlaceIndex = 0;
+  uint8 u_NonZeroDigitFound = FALSE;
+
+  if( u_FieldSize > C_FORMAT_FIELD_MAX || u_DigitsAfterDecimal + 2 > u_FieldSize )
+  {
+    *p_Buffer = 0;
+    return;
+  }
+
+  if( u_DigitsAfterDecimal )
+  {
+    u_DecimalPlaceIndex = u_FieldSize - u_DigitsAfterDecimal - 1;
+  }
+
+  /* Leftmost position is worth 10^( u_FieldSize - 1 ) */
+  p_Power = &w_FormatPowers[C_FORMAT_FIELD_MAX - u_FieldSize];
+
+  for( u_Count = 0; u_Count < u_FieldSize; u_Count++ )
+  {
+    if( u_DigitsAfterDecimal && ( u_Count == u_DecimalPlaceIndex ) )
+    {
+      *p_Buffer++ = '.';
+      u_NonZeroDigitFound = TRUE;
+      continue;
+    }
+
+    w_Power = pgm_read_word( p_Power++ );
+
+    if( w_Number >= w_Power )
+    {
+      u_Digit = '0';
+
+      do
+      {
+        w_Number -= w_Power;
+        u_Digit++;
+      } while( w_Number >= w_Power );
+
+      *p_Buffer++ = u_Digit;
+      u_NonZeroDigitFound = TRUE;
+    }
+    else
+    if( u_NonZeroDigitFound || ( u_Count + 1 == u_DecimalPlaceIndex ) || 
+        ( u_Count == u_FieldSize - 1 ) )
+    {
+      *p_Buffer++ = '0';
+    }
+    else
+    {
+      *p_Buffer++ = u_FillChar;
+    }
+  }
+
+  *p_Buffer = 0;
+}
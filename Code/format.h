@@ -0,0 +1,42 @@
+/* 
+format.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include "types.h"
+
+#define C_FORMAT_FIELD_MAX 5 /* Digits in a uint16 */
+
+/* Render a number into a fixed width field. Digits are found by repeated 
+ * subtraction of powers of ten, as the AVR has no hardware divider
+ *   p_Buffer - Receives u_FieldSize characters plus terminator, so it must 
+ *     hold C_FORMAT_FIELD_MAX + 1
+ *   w_Number - Number to render
+ *   u_FieldSize - Size of the field. Elements of the field not containing 
+ *     numerical digits are filled with u_FillChar
+ *   u_DigitsAfterDecimal - Number of digits after the decimal point. If '0' 
+ *     then no decimal point. The point takes the place of the lowest digit, 
+ *     so 12345 in a field of 5 with 2 decimals renders as "12.34"
+ *   u_FillChar - Character used to fill empty field positions
+ */
+void FormatNumber( char *p_Buffer, uint16 w_Number, uint8 u_FieldSize, 
+                   uint8 u_DigitsAfterDecimal, char u_FillChar );
+
+#endif
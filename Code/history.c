@@ -0,0 +1,75 @@
+/* 
+history.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include "types.h"
+#include "nvmap.h"
+#include "nvm.h"
+#include "history.h"
+
+static const NvmRingType z_HistoryRing = 
+  { C_NVM_ADDR_HISTORY, C_HISTORY_SLOTS, sizeof( HistoryRecordType ) };
+
+C_NVM_ASSERT_FITS( History, C_NVM_ADDR_HISTORY, C_HISTORY_SLOTS * sizeof( HistoryRecordType ), C_NVM_ADDR_CHECKPOINT );
+
+/* Newest slot, C_HISTORY_SLOTS if the ring is empty, and number of valid 
+ * records. Scanning the ring reads every slot, so it is done in HistoryInit
+ * and after each append, not on every read */
+static uint8 u_HistoryNewest;
+static uint8 u_HistoryCount;
+
+/* Find the newest record */
+void HistoryInit( void )
+{
+  u_HistoryNewest = NvmRingFindNewest( &z_HistoryRing, NULL, &u_HistoryCount );
+}
+
+/* Append a record */
+void HistoryAppend( HistoryRecordType *p_Record )
+{
+  uint8 u_Slot = NvmRingAppend( &z_HistoryRing, p_Record );
+
+  if( u_Slot == C_HISTORY_SLOTS )
+  {
+    /* Dropped, the ring is unchanged */
+    return;
+  }
+
+  /* The slot written over may have been the oldest record or a bad one, 
+   * so count again. Reads see the queued write */
+  HistoryInit();
+}
+
+/* Read a record, newest first */
+uint8 HistoryRead( uint8 u_Index, HistoryRecordType *p_Record )
+{
+  uint8 u_Slot;
+
+  if( u_Index >= u_HistoryCount )
+    return( FALSE );
+
+  u_Slot = ( u_HistoryNewest + C_HISTORY_SLOTS - u_Index ) % C_HISTORY_SLOTS;
+
+  return( NvmRingReadSlot( &z_HistoryRing, u_Slot, p_Record ) );
+}
+
+/* Returns number of valid records */
+uint8 HistoryCount( void )
+{
+  return( u_HistoryCount );
+}
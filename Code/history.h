@@ -0,0 +1,63 @@
+/* 
+history.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "types.h"
+
+/* Discharge history. Each finished session appends one record to a ring of
+ * C_HISTORY_SLOTS slots in EEPROM. Consecutive records go to consecutive 
+ * slots, so every cell is written once per C_HISTORY_SLOTS sessions. At the
+ * datasheet's 100,000 write cycles that is 1,600,000 sessions before wear 
+ * becomes a concern. The newest record is found from the sequence numbers */
+#define C_HISTORY_SLOTS 16
+
+typedef struct
+{
+  uint8  u_Sequence;         /* Previous record's sequence + 1 */
+  uint8  u_Mode;             /* ModeEnumType */
+  uint8  u_Cells;            /* CellTypeEnumType << 4 | number of cells */
+  uint16 w_DischargeCurrent; /* mA, or 0.1W / 0.1 Ohm in the CP / CR modes */
+  uint16 w_Capacity;         /* mAh */
+  uint8  u_Hours;
+  uint8  u_Minutes;
+  uint8  u_Seconds;
+  uint16 w_EndVoltage;       /* mV */
+  uint16 w_Energy;           /* 10mWh */
+  uint16 w_Crc;              /* CRC-CCITT of all preceding bytes */
+} HistoryRecordType;
+
+/* Find the newest record. Call once at start-up, before any other History
+ * function */
+void HistoryInit( void );
+
+/* Append a record. Sequence and CRC are filled in here */
+void HistoryAppend( HistoryRecordType *p_Record );
+
+/* Read a record
+ *   u_Index - 0 for the newest record, 1 for the one before, ...
+ *   Returns TRUE if success, FALSE if there is no such record
+ */
+uint8 HistoryRead( uint8 u_Index, HistoryRecordType *p_Record );
+
+/* Returns number of valid records */
+uint8 HistoryCount( void );
+
+#endif
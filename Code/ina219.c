@@ -19,75 +19,84 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "types.h"
 #include "ina219.h"
-#include "i2cmaster.h"
-
-#define DEVICE_ADDRESS 0x80
-#define CONFIG_REG_VAL ( (uint16) 0x219F )
-#define CAL_REG_VAL    ( (uint16) 0x29B1 )
-
-/* Initialize ina219 IC */
-void ina219_init( void )
+#include "isr.h"
+#include "twi.h"
+
+#define REG_CONFIG      0x0
+#define REG_SHUNT       0x1
+#define REG_BUS         0x2
+#define REG_POWER       0x3
+#define REG_CURRENT     0x4
+#define REG_CALIBRATION 0x5
+
+/* Write calibration and config to an ina219 IC */
+void ina219_init( Ina219Type *p_Device )
 {
-  /* Initialize I2C Controller */
-  i2c_init();
-
   /* Set calibration word */
-  i2c_start_wait( DEVICE_ADDRESS + I2C_WRITE );
-  i2c_write( 0x5 ); // Calibration Register Address
-
-  i2c_write( CAL_REG_VAL >> 8 );
-  i2c_write( CAL_REG_VAL & 0xF );
-
-  i2c_stop();
+  TWIQueueWrite( p_Device->u_Address, REG_CALIBRATION, p_Device->w_Calibration, 0 );
 
   /* Set config register */
-  i2c_start_wait( DEVICE_ADDRESS + I2C_WRITE );
-  i2c_write( 0x0 ); // Calibration Register Address
+  TWIQueueWrite( p_Device->u_Address, REG_CONFIG, p_Device->w_Config, 0 );
+}
 
-  i2c_write( CONFIG_REG_VAL >> 8 );
-  i2c_write( CONFIG_REG_VAL & 0xF );
+/* Switch between the averaged and the fast conversion rate */
+uint8 ina219_set_fast( Ina219Type *p_Device, uint8 u_Fast )
+{
+  return( TWIQueueWrite( p_Device->u_Address, REG_CONFIG, 
+                         u_Fast ? p_Device->w_ConfigFast : p_Device->w_Config, 0 ) );
+}
 
-  i2c_stop();
+/* Queue a read of the bus voltage register */
+uint8 ina219_start_poll( Ina219Type *p_Device )
+{
+  return( TWIQueueRead( p_Device->u_Address, REG_BUS, &p_Device->w_RawBus, 
+                        C_ISR_FLAG_CONVERSION_POLL ) );
 }
 
-/* Read a register from the ina219 */
-static uint16 ina219_read( uint8 u_Register )
+/* Returns TRUE if the last polled bus voltage register had CNVR set */
+uint8 ina219_conversion_ready( Ina219Type *p_Device )
 {
-  uint16 w_Temp;
+  return( ( p_Device->w_RawBus & C_INA219_BUS_CNVR ) != 0 );
+}
 
-  i2c_start_wait( DEVICE_ADDRESS + I2C_WRITE );
-  i2c_write( u_Register ); 
-  
-  i2c_rep_start( DEVICE_ADDRESS + I2C_READ );
-  
-  w_Temp = i2c_readAck() << 8;
-  w_Temp |= i2c_readAck();
+/* Queue reads of the shunt, current and power registers */
+uint8 ina219_start_sample( Ina219Type *p_Device )
+{
+  /* All or nothing. A partial set would never post its done flag */
+  if( TWIQueueFree() < 3 )
+    return( FALSE );
 
-  i2c_stop();
+  TWIQueueRead( p_Device->u_Address, REG_SHUNT, &p_Device->w_RawShunt, 0 );
+  TWIQueueRead( p_Device->u_Address, REG_CURRENT, &p_Device->w_RawCurrent, 0 );
 
-  return( w_Temp );
+  /* Must be last. Reading power clears CNVR for the next poll */
+  return( TWIQueueRead( p_Device->u_Address, REG_POWER, &p_Device->w_RawPower, 
+                        C_ISR_FLAG_SAMPLE_READY ) );
 }
 
-/* Read load voltage in mV */
-uint16 ina219_read_voltage( void )
+/* Convert the most recently completed sample */
+void ina219_get_sample( Ina219Type *p_Device, Ina219SampleType *p_Sample )
 {
-  uint16 w_Voltage;
+  /* Shunt and current are two's complement. The offset of the part makes
+   * them slightly negative with no load; nothing here runs in reverse, 
+   * so those read as 0 rather than as 650mV and 6.5A */
+  int16 i_Shunt = (int16)p_Device->w_RawShunt;
+  int16 i_Current = (int16)p_Device->w_RawCurrent;
 
-  /* Battery Voltage = Shunt Voltage + BusVoltage */
-  w_Voltage =  ( ina219_read( 0x2 ) >> 3 ) * 4; // Bus
-  w_Voltage += ina219_read( 0x1 ) / 100; // Shunt
+  if( i_Shunt < 0 )
+    i_Shunt = 0;
 
-  return( w_Voltage );
-}
+  if( i_Current < 0 )
+    i_Current = 0;
 
-/* Read current in mA */
-uint16 ina219_read_current( void )
-{
-  return( ina219_read( 0x4 ) / 10 );
-}
+  /* Battery Voltage = Shunt Voltage + BusVoltage */
+  p_Sample->w_Voltage =  ( p_Device->w_RawBus >> 3 ) * 4; // Bus
+  p_Sample->w_Voltage += i_Shunt / 100; // Shunt
 
-uint16 ina219_read_power( void )
-{
-  return( ina219_read( 0x3 ) );
-}
+  p_Sample->w_RawShunt = p_Device->w_RawShunt;
+  p_Sample->w_RawBus = p_Device->w_RawBus;
 
+  /* Current in mA */
+  p_Sample->w_RawCurrent = i_Current;
+  p_Sample->w_Current = i_Current / 10;
+}
@@ -22,15 +22,78 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "types.h"
 
-/* Initialize ina219 IC */
-void   ina219_init();
+typedef struct
+{
+  uint16 w_Voltage; /* Battery voltage in mV, below 33100 */
+  uint16 w_Current; /* Load current in mA */
+  uint16 w_RawCurrent; /* Load current in 0.1mA, 0 to 32767 */
+  uint16 w_RawShunt;   /* Shunt voltage register ( 10uV ) */
+  uint16 w_RawBus;     /* Bus voltage register */
+  uint16 w_Timestamp;  /* ms. Set by the sampler */
+} Ina219SampleType;
 
-/* Read a register from the ina219 */
-uint16 ina219_read_voltage( void );
+/* Bus voltage register flags */
+#define C_INA219_BUS_CNVR ( 1 << 1 ) /* Conversion ready */
+#define C_INA219_BUS_OVF  ( 1 << 0 ) /* Math overflow */
 
-/* Read current in mA */
-uint16 ina219_read_current( void );
-uint16 ina219_read_power( void );
+/* Sensors on one bus. The INA219 has two address pins, each tied to GND, 
+ * VS+, SDA or SCL, but the sampler keeps its rate for at most four */
+#define C_INA219_MAX_DEVICES 4
+
+/* 32V range, 40mV shunt range, 16 sample averaging on both ADCs, continuous.
+ * A shunt + bus conversion pair completes every 17.02ms ( ~59Hz ) */
+#define C_INA219_CONFIG_AVERAGED ( (uint16) 0x2667 )
+/* Same ranges, single 12-bit conversions. A pair completes every 1.06ms */
+#define C_INA219_CONFIG_FAST     ( (uint16) 0x219F )
+/* 0.1mA current LSB with the stock shunt. The sample conversion assumes a 
+ * 0.1mA LSB, so other shunts need 4096 / ( 0.1mA * shunt in mOhm ) */
+#define C_INA219_CAL_DEFAULT     ( (uint16) 0x29B1 )
+
+/* One INA219. Fill in the first four fields, the rest belong to the driver */
+typedef struct
+{
+  uint8  u_Address;     /* 8-bit device address ( R/W bit clear ) */
+  uint16 w_Calibration; /* Calibration register */
+  uint16 w_Config;      /* Config register, averaged conversions */
+  uint16 w_ConfigFast;  /* Config register, fast conversions */
+
+  /* Raw register values, filled in from TWI_vect */
+  uint16 w_RawShunt;
+  uint16 w_RawBus;
+  uint16 w_RawCurrent;
+  uint16 w_RawPower;
+} Ina219Type;
+
+/* Write calibration and config to an ina219 IC. The TWI controller must 
+ * already be initialized */
+void   ina219_init( Ina219Type *p_Device );
+
+/* Switch between the averaged ~59Hz conversion rate and single 12-bit 
+ * conversions, which trade noise for time resolution. The conversion in
+ * progress when the switch lands is not usable
+ *   u_Fast - TRUE for fast conversions
+ *   Returns TRUE if success, FALSE if the TWI queue is full
+ */
+uint8  ina219_set_fast( Ina219Type *p_Device, uint8 u_Fast );
+
+/* Queue a read of the bus voltage register. C_ISR_FLAG_CONVERSION_POLL is 
+ * posted once it completes
+ *   Returns TRUE if success, FALSE if the TWI queue is full
+ */
+uint8  ina219_start_poll( Ina219Type *p_Device );
+
+/* Returns TRUE if the last polled bus voltage register had CNVR set */
+uint8  ina219_conversion_ready( Ina219Type *p_Device );
+
+/* Queue reads of the shunt, current and power registers. Reading power clears
+ * CNVR. C_ISR_FLAG_SAMPLE_READY is posted once they complete
+ *   Returns TRUE if success, FALSE if the TWI queue has no room for all 
+ *   three, in which case none is queued
+ */
+uint8  ina219_start_sample( Ina219Type *p_Device );
+
+/* Convert the most recently completed sample */
+void   ina219_get_sample( Ina219Type *p_Device, Ina219SampleType *p_Sample );
 
 #endif
 
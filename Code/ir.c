@@ -0,0 +1,211 @@
+/* 
+ir.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include "types.h"
+#include "ina219.h"
+#include "sample.h"
+#include "load.h"
+#include "calib.h"
+#include "ir.h"
+
+static uint8  u_IRRunning = FALSE;
+static uint8  u_Phase;           /* Even phases are low, odd are high */
+static uint8  u_LastPhase;
+static uint8  u_SampleCount;
+static uint16 w_LowDuty;
+static uint16 w_HighDuty;
+static uint32 q_LowVoltage;      /* mV */
+static uint32 q_LowCurrent;      /* 0.1mA */
+static uint32 q_HighVoltage;
+static uint32 q_HighCurrent;
+static uint16 w_Result;
+
+static uint16 a_CurveCapacity[C_IR_CURVE_POINTS];
+static uint16 a_CurveResistance[C_IR_CURVE_POINTS];
+static uint8  u_CurveCount;
+
+/* Start a measurement */
+void IRStart( uint16 w_HighCurrent, uint8 u_Pulses )
+{
+  w_HighDuty = CalibFeedForward( w_HighCurrent );
+  w_LowDuty = CalibFeedForward( w_HighCurrent / C_IR_LOW_DIVIDER );
+
+  q_LowVoltage = 0;
+  q_LowCurrent = 0;
+  q_HighVoltage = 0;
+  q_HighCurrent = 0;
+  u_Phase = 0;
+  u_LastPhase = u_Pulses * 2;
+  u_SampleCount = 0;
+  u_IRRunning = TRUE;
+
+  ina219_set_fast( SampleGetSensor( C_SAMPLE_LOAD_SENSOR ), TRUE );
+  LoadSetDuty( w_LowDuty );
+}
+
+/* Abandon a measurement */
+void IRStop( void )
+{
+  if( u_IRRunning )
+  {
+    u_IRRunning = FALSE;
+    ina219_set_fast( SampleGetSensor( C_SAMPLE_LOAD_SENSOR ), FALSE );
+  }
+}
+
+/* Returns TRUE while a measurement is running */
+uint8 IRBusy( void )
+{
+  return( u_IRRunning );
+}
+
+/* Work out the result from the sums. With P pulses there are P + 1 low 
+ * levels, so cross multiplying by the level counts compares averages 
+ * without dividing first */
+static IRStatusEnumType IRCompute( void )
+{
+  uint32 q_Pulses = u_LastPhase / 2;
+  uint32 q_DeltaV;
+  uint32 q_DeltaI;
+
+  q_LowVoltage *= q_Pulses;
+  q_HighVoltage *= q_Pulses + 1;
+  q_LowCurrent *= q_Pulses;
+  q_HighCurrent *= q_Pulses + 1;
+
+  if( ( q_HighCurrent <= q_LowCurrent ) ||
+      ( q_HighCurrent - q_LowCurrent < 
+        (uint32)C_IR_MIN_STEP * C_IR_AVG_SAMPLES * q_Pulses * ( q_Pulses + 1 ) ) )
+  {
+    return( IR_FAILED );
+  }
+
+  q_DeltaI = q_HighCurrent - q_LowCurrent;
+
+  if( q_HighVoltage >= q_LowVoltage )
+  {
+    w_Result = 0;
+    return( IR_DONE );
+  }
+
+  q_DeltaV = q_LowVoltage - q_HighVoltage;
+
+  /* mV / 0.1mA * 100000 = 0.1mOhm. Halve both until the product fits */
+  while( q_DeltaV > 0xFFFFFFFFUL / 100000 )
+  {
+    q_DeltaV >>= 1;
+    q_DeltaI >>= 1;
+  }
+
+  q_DeltaV = q_DeltaV * 100000 / q_DeltaI;
+
+  w_Result = q_DeltaV > C_IR_MAX_RESULT ? C_IR_MAX_RESULT : q_DeltaV;
+
+  return( IR_DONE );
+}
+
+/* Advance the measurement with a new conversion */
+IRStatusEnumType IRProcess( Ina219SampleType *p_Sample )
+{
+  if( !u_IRRunning )
+    return( IR_FAILED );
+
+  if( ++u_SampleCount <= C_IR_SETTLE_SAMPLES )
+    return( IR_RUNNING );
+
+  if( u_Phase & 1 )
+  {
+    q_HighVoltage += p_Sample->w_Voltage;
+    q_HighCurrent += p_Sample->w_RawCurrent;
+  }
+  else
+  {
+    q_LowVoltage += p_Sample->w_Voltage;
+    q_LowCurrent += p_Sample->w_RawCurrent;
+  }
+
+  if( u_SampleCount < C_IR_SETTLE_SAMPLES + C_IR_AVG_SAMPLES )
+    return( IR_RUNNING );
+
+  /* Level done. Step the load straight after a conversion was read, so the 
+   * edge lands as early as possible in the next one */
+  u_SampleCount = 0;
+
+  if( u_Phase == u_LastPhase )
+  {
+    IRStop();
+    return( IRCompute() );
+  }
+
+  u_Phase++;
+  LoadSetDuty( ( u_Phase & 1 ) ? w_HighDuty : w_LowDuty );
+
+  return( IR_RUNNING );
+}
+
+/* Returns result of the last measurement in 0.1mOhm */
+uint16 IRGetResult( void )
+{
+  return( w_Result );
+}
+
+/* Start a new curve */
+void IRCurveReset( void )
+{
+  u_CurveCount = 0;
+}
+
+/* Add a point */
+uint8 IRCurveAdd( uint16 w_Capacity, uint16 w_Resistance )
+{
+  uint8 u_Thinned = FALSE;
+  uint8 u_Index;
+
+  if( u_CurveCount == C_IR_CURVE_POINTS )
+  {
+    /* Keep the even points */
+    for( u_Index = 1; u_Index < C_IR_CURVE_POINTS / 2; u_Index++ )
+    {
+      a_CurveCapacity[u_Index] = a_CurveCapacity[u_Index * 2];
+      a_CurveResistance[u_Index] = a_CurveResistance[u_Index * 2];
+    }
+
+    u_CurveCount = C_IR_CURVE_POINTS / 2;
+    u_Thinned = TRUE;
+  }
+
+  a_CurveCapacity[u_CurveCount] = w_Capacity;
+  a_CurveResistance[u_CurveCount] = w_Resistance;
+  u_CurveCount++;
+
+  return( u_Thinned );
+}
+
+/* Returns number of points held */
+uint8 IRCurveCount( void )
+{
+  return( u_CurveCount );
+}
+
+/* Read a point, oldest first */
+void IRCurveGet( uint8 u_Index, uint16 *p_Capacity, uint16 *p_Resistance )
+{
+  *p_Capacity = a_CurveCapacity[u_Index];
+  *p_Resistance = a_CurveResistance[u_Index];
+}
@@ -0,0 +1,89 @@
+/* 
+ir.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef IR_H
+#define IR_H
+
+#include "types.h"
+#include "ina219.h"
+
+/* DC internal resistance from load pulses. The load is stepped open loop
+ * between a low and a high current, low first and last ( L H L H .. L ), 
+ * with the INA219 on its fast conversion rate. At each level the first 
+ * C_IR_SETTLE_SAMPLES conversions are dropped, so none that straddles an 
+ * edge is used, and the next C_IR_AVG_SAMPLES are summed. As the low levels
+ * sit symmetrically around the high ones, the pack's own voltage drift 
+ * during the test cancels out of ( V low - V high ) / ( I high - I low ) */
+#define C_IR_SETTLE_SAMPLES 3
+#define C_IR_AVG_SAMPLES    8
+#define C_IR_LOW_DIVIDER    5    /* Low current is the high current / this */
+#define C_IR_MIN_STEP       100  /* 0.1mA. Smaller current steps fail */
+#define C_IR_MAX_RESULT     9999 /* 0.1mOhm. Larger results are clamped */
+
+typedef enum
+{
+  IR_RUNNING,
+  IR_DONE,
+  IR_FAILED
+} IRStatusEnumType;
+
+/* Start a measurement. Load must be powered and sampling running
+ *   w_HighCurrent - Pulse current in mA
+ *   u_Pulses - Number of high pulses
+ */
+void IRStart( uint16 w_HighCurrent, uint8 u_Pulses );
+
+/* Abandon a measurement, restoring the normal conversion rate */
+void IRStop( void );
+
+/* Returns TRUE while a measurement is running */
+uint8 IRBusy( void );
+
+/* Advance the measurement with a new conversion
+ *   p_Sample - Latest conversion
+ *   Returns status. The load is left at the low current when finished
+ */
+IRStatusEnumType IRProcess( Ina219SampleType *p_Sample );
+
+/* Returns result of the last measurement in 0.1mOhm */
+uint16 IRGetResult( void );
+
+/* Resistance against state of charge. Points are added during a discharge,
+ * and once C_IR_CURVE_POINTS are held every other one is dropped, so the 
+ * curve always spans the whole discharge at up to twice the spacing */
+#define C_IR_CURVE_POINTS 12
+
+/* Start a new curve */
+void IRCurveReset( void );
+
+/* Add a point
+ *   w_Capacity - mAh discharged
+ *   w_Resistance - 0.1mOhm
+ *   Returns TRUE if the curve was thinned out to make room, in which case
+ *   the caller should double the spacing of the points it adds
+ */
+uint8 IRCurveAdd( uint16 w_Capacity, uint16 w_Resistance );
+
+/* Returns number of points held */
+uint8 IRCurveCount( void );
+
+/* Read a point, oldest first */
+void IRCurveGet( uint8 u_Index, uint16 *p_Capacity, uint16 *p_Resistance );
+
+#endif
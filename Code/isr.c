@@ -24,55 +24,170 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include "types.h"
 #include "common.h"
 #include "ina219.h"
+#include "wave.h"
+#include "load.h"
+#include "board.h"
 
 #define C_LONG_PRESS_THRESHOLD_MS 1000
 
-static volatile uint8 u_ISRFlags = 0;
+/* Volatile so that reading a slot stays between the head check and the 
+ * tail store that hands it back to the interrupts */
+static volatile ISREventType z_EventQueue[C_ISR_EVENT_QUEUE_SIZE];
+static volatile uint8 u_EventHead = 0;  /* Written by interrupts only */
+static volatile uint8 u_EventTail = 0;  /* Written by main loop only */
+static volatile uint16 w_EventOverflows = 0;
+static volatile uint16 w_Millis = 0;
+static volatile uint8 u_MainSleeping = FALSE;
+static volatile uint16 w_AwakeMs = 0;
 
-/* Returns current ISR flag values */
-uint8 ISRGetFlags( void )
+/* Pop oldest pending event. Indices are free running and a single byte, 
+ * so no locking is needed against the interrupts filling the queue */
+uint8 ISRGetEvent( ISREventType *p_Event )
 {
-  uint8 u_ISRFlagsTemp;
+  uint8 u_Tail = u_EventTail;
+  volatile ISREventType *p_Slot;
+
+  if( u_Tail == u_EventHead )
+    return( FALSE );
+
+  p_Slot = &z_EventQueue[u_Tail & ( C_ISR_EVENT_QUEUE_SIZE - 1 )];
+  p_Event->u_Flags = p_Slot->u_Flags;
+  p_Event->w_Timestamp = p_Slot->w_Timestamp;
+  u_EventTail = u_Tail + 1;
+
+  return( TRUE );
+}
+
+/* Discard all pending events. Whatever the full queue turned away while 
+ * nobody was listening is not counted as lost */
+void ISRFlushEvents( void )
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    u_EventTail = u_EventHead;
+    w_EventOverflows = 0;
+  }
+}
+
+/* Returns number of events dropped because the queue was full */
+uint16 ISRGetOverflowCount( void )
+{
+  uint16 w_Overflows;
 
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
   {
-    u_ISRFlagsTemp = u_ISRFlags;
-    u_ISRFlags = 0;
+    w_Overflows = w_EventOverflows;
   }
 
-  return ( u_ISRFlagsTemp );
+  return( w_Overflows );
+}
+
+/* Returns free running millisecond counter */
+uint16 ISRGetMillis( void )
+{
+  uint16 w_MillisTemp;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    w_MillisTemp = w_Millis;
+  }
+
+  return( w_MillisTemp );
+}
+
+/* Tell the awake-time statistics whether the main loop is about to sleep */
+void ISRSetSleeping( uint8 u_Sleeping )
+{
+  u_MainSleeping = u_Sleeping;
+}
+
+/* Returns number of milliseconds the main loop was awake during the last
+ * full second */
+uint16 ISRGetAwakeMs( void )
+{
+  uint16 w_AwakeMsTemp;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    w_AwakeMsTemp = w_AwakeMs;
+  }
+
+  return( w_AwakeMsTemp );
+}
+
+/* Post flags from interrupt context ( e.g. TWI transaction completion ) */
+void ISRPostFlags( uint8 u_Flags )
+{
+  uint8 u_Head = u_EventHead;
+  volatile ISREventType *p_Event;
+
+  if( u_Flags == 0 )
+    return;
+
+  if( (uint8)( u_Head - u_EventTail ) == C_ISR_EVENT_QUEUE_SIZE )
+  {
+    w_EventOverflows++;
+    return;
+  }
+
+  p_Event = &z_EventQueue[u_Head & ( C_ISR_EVENT_QUEUE_SIZE - 1 )];
+  p_Event->u_Flags = u_Flags;
+  p_Event->w_Timestamp = w_Millis;
+
+  /* Publish only once the entry is complete */
+  u_EventHead = u_Head + 1;
 }
 
 /* Returns raw pushbutton GPIO reading */
 static uint8 GetRawButtonPress( void )
 {
-  return( ( PINB & _BV(PORTB4) ) > 0 );
+  return( ( C_BOARD_BUTTON_PIN & _BV(C_BOARD_BUTTON_BIT) ) > 0 );
 }
 
 /* Returns raw encoder GPIO readings. Format is 000000AB */
 static uint8 GetRawEncoderValue( void )
 {
-  return( ( ( PINB & _BV(PORTB1) ? 1:0 ) << 1 ) | 
-          ( ( PINB & _BV(PORTB3) ? 1:0 ) ) );
+  return( ( ( C_BOARD_ENCODER_A_PIN & _BV(C_BOARD_ENCODER_A_BIT) ? 1:0 ) << 1 ) | 
+          ( ( C_BOARD_ENCODER_B_PIN & _BV(C_BOARD_ENCODER_B_BIT) ? 1:0 ) ) );
 }
 
 /* 1Hz Timer Interrupt */
 ISR ( TIMER2_COMPA_vect )
 {
-  u_ISRFlags |= C_ISR_FLAG_1HZ_TICK;
+  ISRPostFlags( C_ISR_FLAG_1HZ_TICK );
 
   /* Clear interrupt */
   TIFR2 |= _BV(OCF2A);
 }
 
-/* 1kHz Timer 1 Interrupt */
-ISR ( TIMER1_COMPA_vect )
+/* Timer 1 Interrupt, once per load PWM period. The millisecond work below 
+ * runs once 1000us of PWM periods have gone by, so the timebase does not 
+ * depend on the PWM resolution */
+ISR ( TIMER1_OVF_vect )
 {
+#if C_LOAD_PWM_TOP < 999
+  static uint16  w_PeriodUs = 0;
+#endif
   static uint16  w_MsCounter = 0;
+  static uint8   u_SampleCounter = 0;
+  static uint16  w_AwakeCounter = 0;
   static uint16  w_SwitchState = 0;
   static uint16  w_LongSwitchPressCounter = 0;
   static uint8   u_LastEncoderValue = 0x3; 
   uint8          u_CurrentEncoderValue;
+  uint8          u_Flags = 0;
+
+  /* Next PWM period's duty cycle */
+  LoadDither();
+
+#if C_LOAD_PWM_TOP < 999
+  w_PeriodUs += C_LOAD_PWM_TOP + 1;
+
+  if( w_PeriodUs < 1000 )
+    return;
+
+  w_PeriodUs -= 1000;
+#endif
 
   /* Debounce Pushbutton */
   if( w_MsCounter & 0x1 )
@@ -81,14 +196,14 @@ ISR ( TIMER1_COMPA_vect )
 
     if( w_SwitchState == 0xf000 )
     {
-      u_ISRFlags |= C_ISR_FLAG_SHORT_BUTTON_PRESS;
+      u_Flags |= C_ISR_FLAG_SHORT_BUTTON_PRESS;
     }
     else
     if( ( w_SwitchState == 0xe000 ) && ( w_LongSwitchPressCounter != C_LONG_PRESS_THRESHOLD_MS ) )
     {
       if( ++w_LongSwitchPressCounter == C_LONG_PRESS_THRESHOLD_MS )
       {
-        u_ISRFlags |= C_ISR_FLAG_LONG_BUTTON_PRESS;
+        u_Flags |= C_ISR_FLAG_LONG_BUTTON_PRESS;
       }
     }
     else
@@ -108,23 +223,45 @@ ISR ( TIMER1_COMPA_vect )
       if( u_CurrentEncoderValue & 0x1 )
       {
         /* CCW */
-        u_ISRFlags |= C_ISR_FLAG_ENCODER_CCW;
+        u_Flags |= C_ISR_FLAG_ENCODER_CCW;
       }
       else
       {
         /* CW */
-        u_ISRFlags |= C_ISR_FLAG_ENCODER_CW;
+        u_Flags |= C_ISR_FLAG_ENCODER_CW;
       }
     }
   }
 
   u_LastEncoderValue = u_CurrentEncoderValue;
 
+  /* Sampling engine poll rate */
+  if( ++u_SampleCounter == C_SAMPLE_POLL_MS )
+  {
+    u_SampleCounter = 0;
+    u_Flags |= C_ISR_FLAG_SAMPLE_TICK;
+  }
+
+  /* Waveform replay steps the load on this interrupt's timing */
+  WaveTick();
+
+  w_Millis++;
+
+  /* Sample whether the main loop was running when this tick arrived */
+  if( !u_MainSleeping )
+  {
+    w_AwakeCounter++;
+  }
+
   if( ++w_MsCounter == 1000 )
   {
     w_MsCounter = 0;
+    w_AwakeMs = w_AwakeCounter;
+    w_AwakeCounter = 0;
   }
 
-  TIFR1 |= _BV(OCF1A);
+  ISRPostFlags( u_Flags );
+
+  TIFR1 |= _BV(TOV1);
 }
 
@@ -27,8 +27,48 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define C_ISR_FLAG_ENCODER_CCW        ( 1 << 2 )
 #define C_ISR_FLAG_SHORT_BUTTON_PRESS ( 1 << 3 )
 #define C_ISR_FLAG_LONG_BUTTON_PRESS  ( 1 << 4 )
+#define C_ISR_FLAG_SAMPLE_READY       ( 1 << 5 )
+#define C_ISR_FLAG_SAMPLE_TICK        ( 1 << 6 )
+#define C_ISR_FLAG_CONVERSION_POLL    ( 1 << 7 )
 
-/* Returns current ISR flag values */
-uint8 ISRGetFlags( void );
+/* Sample tick period. Must be well below the INA219 conversion time */
+#define C_SAMPLE_POLL_MS 4
+
+/* Interrupts hand events to the main loop through a single producer /
+ * single consumer ring. Each interrupt invocation posts at most one event
+ * holding the flags it raised, so nothing is coalesced or lost unless the 
+ * ring overflows. Must be a power of 2 */
+#define C_ISR_EVENT_QUEUE_SIZE 32
+
+typedef struct
+{
+  uint8  u_Flags;     /* C_ISR_FLAG_xxx */
+  uint16 w_Timestamp; /* ISRGetMillis() when posted */
+} ISREventType;
+
+/* Pop oldest pending event
+ *   Returns TRUE if an event was returned, FALSE if the queue is empty
+ */
+uint8 ISRGetEvent( ISREventType *p_Event );
+
+/* Discard all pending events and clear the overflow count */
+void ISRFlushEvents( void );
+
+/* Returns number of events dropped because the queue was full */
+uint16 ISRGetOverflowCount( void );
+
+/* Returns free running millisecond counter */
+uint16 ISRGetMillis( void );
+
+/* Tell the awake-time statistics whether the main loop is about to sleep.
+ * Must be called with interrupts disabled */
+void ISRSetSleeping( uint8 u_Sleeping );
+
+/* Returns number of milliseconds the main loop was awake during the last
+ * full second ( 0 - 1000 ) */
+uint16 ISRGetAwakeMs( void );
+
+/* Post flags as one event. Interrupt context only */
+void ISRPostFlags( uint8 u_Flags );
 
 #endif
@@ -213,7 +213,7 @@ Input:    rs     1: read data
                  0: read busy flag / address counter
 Returns:  byte read from LCD controller
 *************************************************************************/
-#if LCD_IO_MODE
+#if LCD_IO_MODE && LCD_TIMED_WRITES==0
 static uint8_t lcd_read(uint8_t rs) 
 {
     uint8_t data;
@@ -273,30 +273,28 @@ static uint8_t lcd_read(uint8_t rs)
     }
     return data;
 }
-#else
+#elif LCD_IO_MODE==0
 #define lcd_read(rs) (rs) ? *(volatile uint8_t*)(LCD_IO_DATA+LCD_IO_READ) : *(volatile uint8_t*)(LCD_IO_FUNCTION+LCD_IO_READ)
 /* rs==0 -> read instruction from LCD_IO_FUNCTION */
 /* rs==1 -> read data from LCD_IO_DATA */
 #endif
 
 
+/* DDRAM address the controller's address counter holds, tracked here so 
+   it never has to be read back */
+static uint8_t lcdAddress;
+
+
 /*************************************************************************
-loops while lcd is busy, returns address counter
+loops while lcd is busy
 *************************************************************************/
-static uint8_t lcd_waitbusy(void)
+static void lcd_waitbusy(void)
 
 {
-    register uint8_t c;
-    
+#if LCD_TIMED_WRITES==0
     /* wait until busy flag is cleared */
-    while ( (c=lcd_read(0)) & (1<<LCD_BUSY)) {}
-    
-    /* the address counter is updated 4us after the busy flag is cleared */
-    delay(2);
-
-    /* now read the address counter */
-    return (lcd_read(0));  // return address counter
-    
+    while ( lcd_read(0) & (1<<LCD_BUSY)) {}
+#endif
 }/* lcd_waitbusy */
 
 
@@ -357,6 +355,19 @@ void lcd_command(uint8_t cmd)
 {
     lcd_waitbusy();
     lcd_write(cmd,0);
+
+    /* keep track of the address counter */
+    if ( cmd & (1<<LCD_DDRAM) )
+        lcdAddress = cmd & ~(1<<LCD_DDRAM);
+    else if ( ( cmd == (1<<LCD_CLR) ) || ( (cmd & ~1) == (1<<LCD_HOME) ) )
+        lcdAddress = 0;
+
+#if LCD_TIMED_WRITES
+    if ( cmd < (1<<LCD_ENTRY_MODE) )
+        delay(LCD_DELAY_CLEAR_US);
+    else
+        delay(LCD_DELAY_WRITE_US);
+#endif
 }
 
 
@@ -369,6 +380,20 @@ void lcd_data(uint8_t data)
 {
     lcd_waitbusy();
     lcd_write(data,1);
+
+    /* entry mode is always LCD_MODE_DEFAULT, so the address increments */
+    lcdAddress++;
+#if LCD_LINES==2 && LCD_CONTROLLER_KS0073==0
+    /* each line holds 40 characters, then the counter moves to the other */
+    if ( lcdAddress == LCD_START_LINE1+40 )
+        lcdAddress = LCD_START_LINE2;
+    else if ( lcdAddress == LCD_START_LINE2+40 )
+        lcdAddress = LCD_START_LINE1;
+#endif
+
+#if LCD_TIMED_WRITES
+    delay(LCD_DELAY_WRITE_US);
+#endif
 }
 
 
@@ -408,7 +433,7 @@ void lcd_gotoxy(uint8_t x, uint8_t y)
 *************************************************************************/
 int lcd_getxy(void)
 {
-    return lcd_waitbusy();
+    return lcdAddress;
 }
 
 
@@ -440,7 +465,7 @@ void lcd_putc(char c)
     uint8_t pos;
 
 
-    pos = lcd_waitbusy();   // read busy-flag and address counter
+    pos = lcdAddress;
     if (c=='\n')
     {
         lcd_newline(pos);
@@ -450,28 +475,27 @@ void lcd_putc(char c)
 #if LCD_WRAP_LINES==1
 #if LCD_LINES==1
         if ( pos == LCD_START_LINE1+LCD_DISP_LENGTH ) {
-            lcd_write((1<<LCD_DDRAM)+LCD_START_LINE1,0);
+            lcd_command((1<<LCD_DDRAM)+LCD_START_LINE1);
         }
 #elif LCD_LINES==2
         if ( pos == LCD_START_LINE1+LCD_DISP_LENGTH ) {
-            lcd_write((1<<LCD_DDRAM)+LCD_START_LINE2,0);    
+            lcd_command((1<<LCD_DDRAM)+LCD_START_LINE2);    
         }else if ( pos == LCD_START_LINE2+LCD_DISP_LENGTH ){
-            lcd_write((1<<LCD_DDRAM)+LCD_START_LINE1,0);
+            lcd_command((1<<LCD_DDRAM)+LCD_START_LINE1);
         }
 #elif LCD_LINES==4
         if ( pos == LCD_START_LINE1+LCD_DISP_LENGTH ) {
-            lcd_write((1<<LCD_DDRAM)+LCD_START_LINE2,0);    
+            lcd_command((1<<LCD_DDRAM)+LCD_START_LINE2);    
         }else if ( pos == LCD_START_LINE2+LCD_DISP_LENGTH ) {
-            lcd_write((1<<LCD_DDRAM)+LCD_START_LINE3,0);
+            lcd_command((1<<LCD_DDRAM)+LCD_START_LINE3);
         }else if ( pos == LCD_START_LINE3+LCD_DISP_LENGTH ) {
-            lcd_write((1<<LCD_DDRAM)+LCD_START_LINE4,0);
+            lcd_command((1<<LCD_DDRAM)+LCD_START_LINE4);
         }else if ( pos == LCD_START_LINE4+LCD_DISP_LENGTH ) {
-            lcd_write((1<<LCD_DDRAM)+LCD_START_LINE1,0);
+            lcd_command((1<<LCD_DDRAM)+LCD_START_LINE1);
         }
 #endif
-        lcd_waitbusy();
 #endif
-        lcd_write(c, 1);
+        lcd_data(c);
     }
 
 }/* lcd_putc */
@@ -66,6 +66,18 @@
 #define LCD_START_LINE4  0x54     /**< DDRAM address of first char of line 4 */
 #define LCD_WRAP_LINES      0     /**< 0: no wrap, 1: wrap at end of visibile line */
 
+/**
+ *  @name  Definitions for bus timing
+ *  The cursor position is tracked in software, so the busy flag is the only 
+ *  thing ever read back. With LCD_TIMED_WRITES=1 nothing is read at all and
+ *  each write is followed by a fixed delay instead, which makes the cost of 
+ *  a write predictable. The delays are the HD44780 execution times at 
+ *  270kHz plus margin, and include nothing for the time spent in lcd_write
+ */
+#define LCD_TIMED_WRITES    0     /**< 0: poll busy flag, 1: fixed delays      */
+#define LCD_DELAY_WRITE_US  50    /**< data write and most instructions, 37us  */
+#define LCD_DELAY_CLEAR_US  2000  /**< clear display and return home, 1.52ms   */
+
 
 #define LCD_IO_MODE      1         /**< 0: memory mapped mode, 1: IO port mode */
 #if LCD_IO_MODE
@@ -0,0 +1,95 @@
+/* 
+load.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* All load hardware access lives here so that the state machine never
+ * touches Timer1 or the OpAmp enable directly */
+
+#include <util/delay.h>
+#include <util/atomic.h>
+#include <avr/io.h>
+#include "types.h"
+#include "load.h"
+
+static volatile uint16 w_DutyFine; /* 1 / 2^C_LOAD_DITHER_BITS counts */
+static uint8 u_DitherError;        /* Timer1 interrupt only */
+
+/* Power up the load OpAmp and wait for it to settle */
+void LoadPowerOn( void )
+{
+  C_BOARD_OPAMP_PORT |= _BV(C_BOARD_OPAMP_BIT);
+  _delay_ms(100);
+}
+
+/* Power down the load OpAmp */
+void LoadPowerOff( void )
+{
+  C_BOARD_OPAMP_PORT &= ~_BV(C_BOARD_OPAMP_BIT);
+}
+
+/* Set load PWM duty cycle ( Timer1 compare counts ) */
+void LoadSetDuty( uint16 w_Duty )
+{
+  LoadSetDutyFine( w_Duty << C_LOAD_DITHER_BITS );
+}
+
+/* Set load PWM duty cycle in fractional counts. Written from both the 
+ * main loop and the waveform replay in the Timer1 interrupt, so the two 
+ * byte store must not be interrupted */
+void LoadSetDutyFine( uint16 w_Duty )
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    w_DutyFine = w_Duty;
+  }
+}
+
+/* Returns PWM duty cycle in whole counts */
+uint16 LoadGetDuty( void )
+{
+  uint16 w_Duty;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    w_Duty = w_DutyFine;
+  }
+
+  return( w_Duty >> C_LOAD_DITHER_BITS );
+}
+
+/* Load the next PWM period's compare values. Accumulates the fraction and
+ * carries whole counts into this period. Every channel gets the same value */
+void LoadDither( void )
+{
+  uint16 w_Duty = w_DutyFine;
+
+  u_DitherError += w_Duty & ( ( 1 << C_LOAD_DITHER_BITS ) - 1 );
+  w_Duty >>= C_LOAD_DITHER_BITS;
+
+  if( u_DitherError >= ( 1 << C_LOAD_DITHER_BITS ) )
+  {
+    u_DitherError -= ( 1 << C_LOAD_DITHER_BITS );
+    w_Duty++;
+  }
+
+  OCR1B = w_Duty;
+
+#if C_LOAD_CHANNELS > 1
+  OCR1A = w_Duty;
+#endif
+}
@@ -0,0 +1,82 @@
+/* 
+load.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef LOAD_H
+#define LOAD_H
+
+#include "types.h"
+#include "board.h"
+
+/* Timer1 drives the load PWM in fast PWM mode with ICR1 as TOP, and its 
+ * overflow interrupt is also the millisecond timebase. Fewer counts raise 
+ * the PWM frequency, 1MHz / ( C_LOAD_PWM_TOP + 1 ), at the cost of coarser
+ * duty steps, which the dither wins back. At most 999 so the interrupt 
+ * comes at least once per millisecond, and much below 500 the interrupt 
+ * rate starts to eat into the 1MHz CPU */
+#define C_LOAD_PWM_TOP  999
+#define C_LOAD_DUTY_MAX C_LOAD_PWM_TOP
+
+/* First order sigma-delta dither. The duty cycle is held with 
+ * C_LOAD_DITHER_BITS fractional bits and the fraction left over in each 
+ * PWM period is carried into the next, so the average duty resolves 
+ * 1 / 2^C_LOAD_DITHER_BITS of a count ( ~0.07mA at 1000 counts ). The 
+ * pattern repeats at most every 2^C_LOAD_DITHER_BITS periods, well inside 
+ * the INA219 averaging window. More bits give finer steps but slower, 
+ * less well filtered patterns */
+#define C_LOAD_DITHER_BITS 4
+
+/* Load channels, driven alike: OC1B, and OC1A on a board with two. They 
+ * share the one INA219 reading, so the calibration and regulator see one 
+ * load of C_LOAD_CHANNELS times the range */
+#define C_LOAD_CHANNELS C_BOARD_LOAD_CHANNELS
+
+#if C_LOAD_PWM_TOP > 999
+#error "Timer1 interrupt must come at least once per millisecond"
+#endif
+
+#if C_LOAD_DITHER_BITS > 7
+#error "Dither error must fit a byte"
+#endif
+
+#if ( C_LOAD_PWM_TOP << C_LOAD_DITHER_BITS ) > 65535
+#error "Fine duty cycle must fit 16 bits"
+#endif
+
+/* Power up the load OpAmp and wait for it to settle */
+void LoadPowerOn( void );
+
+/* Power down the load OpAmp */
+void LoadPowerOff( void );
+
+/* Set load PWM duty cycle ( Timer1 compare counts ). Safe from interrupts */
+void LoadSetDuty( uint16 w_Duty );
+
+/* Set load PWM duty cycle in 1 / 2^C_LOAD_DITHER_BITS counts. Safe from 
+ * interrupts */
+void LoadSetDutyFine( uint16 w_Duty );
+
+/* Returns PWM duty cycle in whole counts */
+uint16 LoadGetDuty( void );
+
+/* Load the next PWM period's compare values. Timer1 overflow interrupt 
+ * only. The compare registers are double buffered, so they take effect 
+ * from the next period */
+void LoadDither( void );
+
+#endif
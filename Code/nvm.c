@@ -0,0 +1,250 @@
+/* 
+nvm.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <util/atomic.h>
+#include "types.h"
+#include "nvm.h"
+
+typedef struct
+{
+  uint16 w_Addr;
+  uint8  u_Length;
+  uint8  a_Data[C_NVM_BUFFER_SIZE];
+} NvmWriteType;
+
+/* Write queue. The head entry is the one being programmed */
+static NvmWriteType a_NvmQueue[C_NVM_QUEUE_SIZE];
+static uint8 u_NvmHead;           /* Written by EE_READY_vect only */
+static uint8 u_NvmTail;           /* Written by NvmWrite only */
+static volatile uint8 u_NvmCount;
+static uint8 u_NvmIndex;          /* Next byte of the head entry */
+
+/* Returns TRUE while writes are queued. The last entry leaves the queue on 
+ * the interrupt after its last byte, when programming has finished */
+uint8 NvmBusy( void )
+{
+  return( u_NvmCount != 0 );
+}
+
+/* Read from EEPROM */
+void NvmRead( uint16 w_Addr, void *p_Data, uint8 u_Length )
+{
+  NvmWriteType *p_Write;
+  uint8 u_Entry;
+  uint8 u_Index;
+  uint16 w_Offset;
+
+  /* Keep the interrupt off the EEPROM registers until the queue has been 
+   * laid over the result. The library still waits for the byte being 
+   * programmed, at most 3.4ms */
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    EECR &= ~_BV(EERIE);
+  }
+
+  eeprom_read_block( p_Data, (uint8 *)w_Addr, u_Length );
+
+  /* Oldest first, so the newest queued value of a byte wins */
+  for( u_Entry = 0; u_Entry < u_NvmCount; u_Entry++ )
+  {
+    p_Write = &a_NvmQueue[( u_NvmHead + u_Entry ) % C_NVM_QUEUE_SIZE];
+
+    for( u_Index = 0; u_Index < p_Write->u_Length; u_Index++ )
+    {
+      w_Offset = p_Write->w_Addr + u_Index - w_Addr;
+
+      if( w_Offset < u_Length )
+        ( (uint8 *)p_Data )[w_Offset] = p_Write->a_Data[u_Index];
+    }
+  }
+
+  if( u_NvmCount )
+    EECR |= _BV(EERIE);
+}
+
+/* Queue a write */
+uint8 NvmWrite( uint16 w_Addr, const void *p_Data, uint8 u_Length )
+{
+  NvmWriteType *p_Write = &a_NvmQueue[u_NvmTail];
+
+  if( ( u_Length > C_NVM_BUFFER_SIZE ) || ( u_NvmCount == C_NVM_QUEUE_SIZE ) )
+    return( FALSE );
+
+  /* The tail entry is free, so the interrupt is not looking at it */
+  memcpy( p_Write->a_Data, p_Data, u_Length );
+  p_Write->w_Addr = w_Addr;
+  p_Write->u_Length = u_Length;
+  u_NvmTail = ( u_NvmTail + 1 ) % C_NVM_QUEUE_SIZE;
+
+  /* Fires straight away if the EEPROM is idle */
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    u_NvmCount++;
+    EECR |= _BV(EERIE);
+  }
+
+  return( TRUE );
+}
+
+/* Program the next byte that differs, moving down the queue as entries 
+ * complete, or finish */
+ISR ( EE_READY_vect )
+{
+  NvmWriteType *p_Write;
+  uint8 u_Index = u_NvmIndex;
+
+  while( u_NvmCount )
+  {
+    p_Write = &a_NvmQueue[u_NvmHead];
+
+    while( u_Index < p_Write->u_Length )
+    {
+      EEAR = p_Write->w_Addr + u_Index;
+      EECR |= _BV(EERE);
+
+      if( EEDR != p_Write->a_Data[u_Index] )
+      {
+        /* Erase and write. EEPE must follow EEMPE within 4 cycles */
+        EEDR = p_Write->a_Data[u_Index];
+        EECR |= _BV(EEMPE);
+        EECR |= _BV(EEPE);
+        u_NvmIndex = u_Index + 1;
+        return;
+      }
+
+      u_Index++;
+    }
+
+    u_NvmHead = ( u_NvmHead + 1 ) % C_NVM_QUEUE_SIZE;
+    u_NvmCount--;
+    u_Index = 0;
+  }
+
+  u_NvmIndex = 0;
+  EECR &= ~_BV(EERIE);
+}
+
+/* Compute CRC of everything but the CRC itself */
+static uint16 NvmRingCrc( const NvmRingType *p_Ring, void *p_Record )
+{
+  uint16 w_Crc = 0xFFFF;
+  uint8 *p_Current = (uint8 *)p_Record;
+  uint8 *p_End = p_Current + p_Ring->u_Size - sizeof( uint16 );
+
+  while( p_Current < p_End )
+  {
+    w_Crc = _crc_ccitt_update( w_Crc, *p_Current++ );
+  }
+
+  return( w_Crc );
+}
+
+/* Read a ring slot */
+uint8 NvmRingReadSlot( const NvmRingType *p_Ring, uint8 u_Slot, void *p_Record )
+{
+  uint16 w_Stored;
+
+  NvmRead( p_Ring->w_Base + (uint16)u_Slot * p_Ring->u_Size, p_Record, p_Ring->u_Size );
+  memcpy( &w_Stored, (uint8 *)p_Record + p_Ring->u_Size - sizeof( w_Stored ), sizeof( w_Stored ) );
+
+  return( NvmRingCrc( p_Ring, p_Record ) == w_Stored );
+}
+
+/* Check a ring slot
+ *   p_Sequence - Receives the slot's sequence number
+ *   Returns TRUE if the CRC matches
+ */
+static uint8 NvmRingCheckSlot( const NvmRingType *p_Ring, uint8 u_Slot, uint8 *p_Sequence )
+{
+  uint8 a_Record[C_NVM_BUFFER_SIZE];
+  uint8 u_Valid = NvmRingReadSlot( p_Ring, u_Slot, a_Record );
+
+  *p_Sequence = a_Record[0];
+
+  return( u_Valid );
+}
+
+/* Find the newest record */
+uint8 NvmRingFindNewest( const NvmRingType *p_Ring, void *p_Record, uint8 *p_Count )
+{
+  uint8 u_Slot;
+  uint8 u_Sequence;
+  uint8 u_NewestSequence = 0;
+  uint8 u_Newest = p_Ring->u_Slots;
+  uint8 u_Count = 0;
+
+  for( u_Slot = 0; u_Slot < p_Ring->u_Slots; u_Slot++ )
+  {
+    if( !NvmRingCheckSlot( p_Ring, u_Slot, &u_Sequence ) )
+      continue;
+
+    u_Count++;
+
+    /* Valid records are never more than u_Slots apart, so one is newer 
+     * if it is less than half the sequence range ahead */
+    if( ( u_Newest == p_Ring->u_Slots ) || 
+        ( (uint8)( u_Sequence - u_NewestSequence - 1 ) < 0x7F ) )
+    {
+      u_Newest = u_Slot;
+      u_NewestSequence = u_Sequence;
+    }
+  }
+
+  if( p_Count )
+    *p_Count = u_Count;
+
+  if( p_Record && ( u_Newest != p_Ring->u_Slots ) )
+    NvmRingReadSlot( p_Ring, u_Newest, p_Record );
+
+  return( u_Newest );
+}
+
+/* Append a record */
+uint8 NvmRingAppend( const NvmRingType *p_Ring, void *p_Record )
+{
+  uint8 u_Slot = NvmRingFindNewest( p_Ring, NULL, NULL );
+  uint8 u_Sequence = 0;
+  uint16 w_Crc;
+
+  if( u_Slot == p_Ring->u_Slots )
+  {
+    /* Empty ring */
+    u_Slot = 0;
+  }
+  else
+  {
+    NvmRingCheckSlot( p_Ring, u_Slot, &u_Sequence );
+    u_Sequence++;
+    u_Slot = ( u_Slot + 1 ) % p_Ring->u_Slots;
+  }
+
+  *(uint8 *)p_Record = u_Sequence;
+  w_Crc = NvmRingCrc( p_Ring, p_Record );
+  memcpy( (uint8 *)p_Record + p_Ring->u_Size - sizeof( w_Crc ), &w_Crc, sizeof( w_Crc ) );
+
+  if( !NvmWrite( p_Ring->w_Base + (uint16)u_Slot * p_Ring->u_Size, p_Record, p_Ring->u_Size ) )
+    return( p_Ring->u_Slots );
+
+  return( u_Slot );
+}
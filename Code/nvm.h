@@ -0,0 +1,79 @@
+/* 
+nvm.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef NVM_H
+#define NVM_H
+
+#include "types.h"
+
+/* Non-volatile storage. Writes are copied into a queue and programmed one 
+ * byte per EE_READY interrupt, so the caller never waits the 3.4ms per byte 
+ * programming time, not even behind an earlier write. Bytes that already 
+ * hold the new value are skipped, which saves both time and wear. Reads see
+ * queued writes as if they had already landed. All EEPROM access must go 
+ * through here, as the interrupt owns the EEPROM registers while a write is
+ * in progress */
+#define C_NVM_BUFFER_SIZE 27 /* Largest single write, the calibration record */
+
+/* Enough for the worst burst, the end of a discharge appending history and
+ * clearing the checkpoint while a periodic checkpoint is still programming */
+#define C_NVM_QUEUE_SIZE 3
+
+/* Slot ring. Records are written to the slot after the newest one, so the 
+ * last good record survives a reset during a write and the wear is spread 
+ * over all slots. Records must start with a uint8 sequence number and end 
+ * with a uint16 CRC-CCITT of all preceding bytes, both filled in by 
+ * NvmRingAppend */
+typedef struct
+{
+  uint16 w_Base;  /* EEPROM address of slot 0 */
+  uint8  u_Slots;
+  uint8  u_Size;  /* Record size, at most C_NVM_BUFFER_SIZE */
+} NvmRingType;
+
+/* Read from EEPROM, including writes still in the queue */
+void NvmRead( uint16 w_Addr, void *p_Data, uint8 u_Length );
+
+/* Queue a write of at most C_NVM_BUFFER_SIZE bytes. Never waits
+ *   Returns FALSE if the queue is full and the write was dropped
+ */
+uint8 NvmWrite( uint16 w_Addr, const void *p_Data, uint8 u_Length );
+
+/* Returns TRUE while writes are queued */
+uint8 NvmBusy( void );
+
+/* Read a ring slot
+ *   Returns TRUE if it holds a valid record
+ */
+uint8 NvmRingReadSlot( const NvmRingType *p_Ring, uint8 u_Slot, void *p_Record );
+
+/* Find the newest record, the valid one with the highest sequence number
+ * allowing for wrap. A bad slot anywhere in the ring only loses itself
+ *   p_Record - Receives the newest record, may be NULL
+ *   p_Count - Receives the number of valid records, may be NULL
+ *   Returns slot index, or u_Slots if the ring is empty
+ */
+uint8 NvmRingFindNewest( const NvmRingType *p_Ring, void *p_Record, uint8 *p_Count );
+
+/* Append a record. Sequence and CRC are filled in here
+ *   Returns the slot written, or u_Slots if the write queue was full
+ */
+uint8 NvmRingAppend( const NvmRingType *p_Ring, void *p_Record );
+
+#endif
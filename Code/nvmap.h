@@ -0,0 +1,37 @@
+/* 
+nvmap.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef NVMAP_H
+#define NVMAP_H
+
+/* EEPROM layout ( ATmega168 has 512 bytes ) */
+#define C_NVM_ADDR_CONFIG_LEGACY 0 /* z_ConfigStructType + XOR checksum, read only */
+#define C_NVM_ADDR_CALIB  16  /* C_CALIB_SLOTS * CalibRecordType */
+#define C_NVM_ADDR_HISTORY 70 /* C_HISTORY_SLOTS * HistoryRecordType */
+#define C_NVM_ADDR_CHECKPOINT 326 /* C_CHECKPOINT_SLOTS * CheckpointRecordType */
+#define C_NVM_ADDR_PROFILE 410 /* ProfileType, user profile, read only */
+#define C_NVM_ADDR_CONFIG 444 /* C_CONFIG_SLOTS * ConfigRecordType */
+#define C_NVM_SIZE 512
+
+/* Fails the build if a region runs into the one after it. Each module 
+ * checks its own region where its record type is known */
+#define C_NVM_ASSERT_FITS( name, addr, size, end ) \
+  typedef char a_##name##Fits[( (addr) + (size) <= (end) ) ? 1 : -1]
+
+#endif
@@ -0,0 +1,229 @@
+/* 
+profile.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include "common.h"
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "types.h"
+#include "control.h"
+#include "nvmap.h"
+#include "nvm.h"
+#include "profile.h"
+
+#define CC_V( pct, mv )  { C_PROFILE_TYPE( PROFILE_STEP_CC, PROFILE_END_VOLTAGE ), pct, mv }
+#define CC_T( pct, s )   { C_PROFILE_TYPE( PROFILE_STEP_CC, PROFILE_END_TIME ), pct, s }
+#define REST_T( s )      { C_PROFILE_TYPE( PROFILE_STEP_REST, PROFILE_END_TIME ), 0, s }
+
+/* Capacity left at the knee: once the cutoff is reached at full current, 
+ * let the pack recover and carry on at half and a fifth of it */
+static const ProfileType z_ProfileKnee PROGMEM = 
+  { 0, 5, { CC_V( 100, 0 ), REST_T( 120 ), CC_V( 50, 0 ), REST_T( 120 ), CC_V( 20, 0 ) }, 0 };
+
+/* Acceptance load steps: light and full load, recovery, then full load 
+ * down to the cutoff */
+static const ProfileType z_ProfileSteps PROGMEM = 
+  { 0, 4, { CC_T( 20, 600 ), CC_T( 100, 600 ), REST_T( 300 ), CC_V( 100, 0 ) }, 0 };
+
+static const ProfileType * const p_Profiles[C_PROFILE_BUILTIN] PROGMEM = {
+  &z_ProfileKnee,
+  &z_ProfileSteps };
+
+static const NvmRingType z_ProfileRing = 
+  { C_NVM_ADDR_PROFILE, 1, sizeof( ProfileType ) };
+
+C_NVM_ASSERT_FITS( Profile, C_NVM_ADDR_PROFILE, sizeof( ProfileType ), C_NVM_ADDR_CONFIG );
+
+static ProfileType z_Profile;
+static ProfileStepType *p_Step;  /* Running step */
+static uint8  u_Step;
+static uint16 w_BaseCurrent;
+static uint8  u_NumCells;
+static uint16 w_Cutoff;          /* Pack cutoff in mV */
+static uint32 q_StepMs;
+static uint32 q_StepStartMas;    /* Charge discharged when the step started */
+static uint16 w_LastTimestamp;
+static uint8  u_HaveTimestamp;
+
+/* Load a profile to run */
+uint8 ProfileLoad( uint8 u_Index )
+{
+  uint8 u_Check;
+
+  if( u_Index < C_PROFILE_BUILTIN )
+  {
+    memcpy_P( &z_Profile, (PGM_P)pgm_read_word( &p_Profiles[u_Index] ), sizeof( ProfileType ) );
+    return( TRUE );
+  }
+
+  if( !NvmRingReadSlot( &z_ProfileRing, 0, &z_Profile ) ||
+      ( z_Profile.u_Steps == 0 ) || ( z_Profile.u_Steps > C_PROFILE_STEPS_MAX ) )
+  {
+    return( FALSE );
+  }
+
+  for( u_Check = 0; u_Check < z_Profile.u_Steps; u_Check++ )
+  {
+    if( ( ( z_Profile.a_Step[u_Check].u_Type >> 4 ) >= PROFILE_STEP_MAX ) ||
+        ( ( z_Profile.a_Step[u_Check].u_Type & 0x0F ) >= PROFILE_END_MAX ) )
+    {
+      return( FALSE );
+    }
+  }
+
+  return( TRUE );
+}
+
+/* Charge discharged so far in mA seconds */
+static uint32 ProfileCharge( void )
+{
+  return( z_Status.w_CapacityDischarged * 3600UL + z_Status.w_CapacityRemainder );
+}
+
+/* Make u_Step the running step */
+static void ProfileEnterStep( void )
+{
+  p_Step = &z_Profile.a_Step[u_Step];
+  q_StepMs = 0;
+  q_StepStartMas = ProfileCharge();
+}
+
+/* Start the loaded profile at its first step */
+void ProfileStart( uint16 w_Current, uint8 u_Cells, uint16 w_CellCutoff )
+{
+  w_BaseCurrent = w_Current;
+  u_NumCells = u_Cells;
+  w_Cutoff = w_CellCutoff * u_Cells;
+  u_HaveTimestamp = FALSE;
+  u_Step = 0;
+  ProfileEnterStep();
+}
+
+/* Check the end condition of the running step */
+ProfileStatusEnumType ProfileProcess( Ina219SampleType *p_Sample )
+{
+  uint8 u_Done = FALSE;
+  uint8 u_Rest = ( ( p_Step->u_Type >> 4 ) == PROFILE_STEP_REST );
+  uint8 u_Settled;
+  uint16 w_Voltage;
+
+  /* Step time from conversion timestamps. The first conversion of a run 
+   * only sets the reference */
+  if( u_HaveTimestamp )
+    q_StepMs += (uint16)( p_Sample->w_Timestamp - w_LastTimestamp );
+
+  w_LastTimestamp = p_Sample->w_Timestamp;
+  u_HaveTimestamp = TRUE;
+
+  u_Settled = ( q_StepMs >= C_PROFILE_SETTLE_MS );
+
+  switch( p_Step->u_Type & 0x0F )
+  {
+    case PROFILE_END_VOLTAGE:
+    {
+      w_Voltage = p_Step->w_End ? p_Step->w_End * u_NumCells : w_Cutoff;
+
+      if( u_Rest )
+        u_Done = ( p_Sample->w_Voltage >= w_Voltage );
+      else
+        u_Done = u_Settled && ( p_Sample->w_Voltage < w_Voltage );
+      break;
+    }
+
+    case PROFILE_END_TIME:
+    {
+      u_Done = ( q_StepMs >= p_Step->w_End * 1000UL );
+      break;
+    }
+
+    case PROFILE_END_CAPACITY:
+    {
+      u_Done = ( ProfileCharge() - q_StepStartMas >= p_Step->w_End * 3600UL );
+      break;
+    }
+
+    case PROFILE_END_CURRENT:
+    {
+      u_Done = u_Settled && ( p_Sample->w_Current < p_Step->w_End );
+      break;
+    }
+
+    default:
+    {
+      u_Done = TRUE;
+      break;
+    }
+  }
+
+  /* Never discharge past the cutoff */
+  if( !u_Rest && u_Settled && ( p_Sample->w_Voltage < w_Cutoff ) )
+    u_Done = TRUE;
+
+  if( !u_Done )
+    return( PROFILE_RUNNING );
+
+  if( ++u_Step == z_Profile.u_Steps )
+    return( PROFILE_DONE );
+
+  ProfileEnterStep();
+
+  return( PROFILE_NEXT_STEP );
+}
+
+/* Load current for the running step */
+uint16 ProfileSetpoint( uint16 w_Voltage )
+{
+  uint32 q_Current;
+
+  switch( p_Step->u_Type >> 4 )
+  {
+    case PROFILE_STEP_CC:
+    {
+      /* mA * % / 10 = 0.1mA */
+      q_Current = (uint32)w_BaseCurrent * p_Step->w_Setpoint / 10;
+      return( q_Current > C_CONTROL_SETPOINT_MAX ? C_CONTROL_SETPOINT_MAX : q_Current );
+    }
+
+    case PROFILE_STEP_CP:
+      return( ControlPowerSetpoint( p_Step->w_Setpoint, w_Voltage ) );
+
+    case PROFILE_STEP_CR:
+      return( ControlResistanceSetpoint( p_Step->w_Setpoint, w_Voltage ) );
+
+    default:
+      return( 0 );
+  }
+}
+
+/* Returns the running step's ProfileStepEnumType */
+uint8 ProfileGetStepType( void )
+{
+  return( p_Step->u_Type >> 4 );
+}
+
+/* Returns the index of the running step */
+uint8 ProfileGetStep( void )
+{
+  return( u_Step );
+}
+
+/* Returns the number of steps in the loaded profile */
+uint8 ProfileGetStepCount( void )
+{
+  return( z_Profile.u_Steps );
+}
@@ -0,0 +1,120 @@
+/* 
+profile.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "types.h"
+#include "ina219.h"
+
+/* Discharge profiles. A profile is a table of up to C_PROFILE_STEPS_MAX 
+ * steps, each a load mode with a setpoint and an end condition, run in 
+ * order. Built-in profiles live in program memory, the user profile in 
+ * EEPROM at C_NVM_ADDR_PROFILE, laid out as a one slot NVM ring so it is 
+ * CRC checked. The firmware never writes it, Tools/profile2hex.c makes an 
+ * EEPROM image of it from a text description.
+ *
+ * End conditions are checked on every conversion. Voltage and current ends 
+ * are ignored for the first C_PROFILE_SETTLE_MS of a step, while the load
+ * settles. Every loaded step also ends once the battery is below the cell 
+ * type's full discharge cutoff, whatever its own end condition */
+#define C_PROFILE_STEPS_MAX 6
+#define C_PROFILE_SETTLE_MS 1000
+
+#define C_PROFILE_BUILTIN   2                  /* Built-in profiles */
+#define C_PROFILE_USER      C_PROFILE_BUILTIN  /* Index of the EEPROM profile */
+
+typedef enum
+{
+  PROFILE_STEP_CC,    /* Setpoint is % of the configured discharge current */
+  PROFILE_STEP_CP,    /* Setpoint is 0.1W */
+  PROFILE_STEP_CR,    /* Setpoint is 0.1 Ohm */
+  PROFILE_STEP_REST,  /* Load off */
+  PROFILE_STEP_MAX
+} ProfileStepEnumType;
+
+typedef enum
+{
+  PROFILE_END_VOLTAGE,  /* mV per cell, 0 for the cutoff. Rest steps end above it */
+  PROFILE_END_TIME,     /* Seconds */
+  PROFILE_END_CAPACITY, /* mAh discharged during the step */
+  PROFILE_END_CURRENT,  /* mA. Ends below it */
+  PROFILE_END_MAX
+} ProfileEndEnumType;
+
+#define C_PROFILE_TYPE( step, end ) ( ( (step) << 4 ) | (end) )
+
+typedef struct
+{
+  uint8  u_Type;      /* C_PROFILE_TYPE( ProfileStepEnumType, ProfileEndEnumType ) */
+  uint16 w_Setpoint;
+  uint16 w_End;
+} ProfileStepType;
+
+typedef struct
+{
+  uint8  u_Sequence;  /* Unused, NVM ring slot layout */
+  uint8  u_Steps;
+  ProfileStepType a_Step[C_PROFILE_STEPS_MAX];
+  uint16 w_Crc;       /* CRC-CCITT of all preceding bytes */
+} ProfileType;
+
+typedef enum
+{
+  PROFILE_RUNNING,
+  PROFILE_NEXT_STEP,
+  PROFILE_DONE
+} ProfileStatusEnumType;
+
+/* Load a profile to run
+ *   u_Index - Built-in profile, or C_PROFILE_USER
+ *   Returns TRUE if success, FALSE if the user profile is missing or invalid
+ */
+uint8 ProfileLoad( uint8 u_Index );
+
+/* Start the loaded profile at its first step
+ *   w_Current - Configured discharge current in mA, scales CC steps
+ *   u_Cells - Number of cells, scales voltage ends
+ *   w_CellCutoff - Full discharge cutoff per cell in mV
+ */
+void ProfileStart( uint16 w_Current, uint8 u_Cells, uint16 w_CellCutoff );
+
+/* Check the end condition of the running step with a new conversion
+ *   p_Sample - Latest conversion
+ *   Returns PROFILE_NEXT_STEP when a new step was started, PROFILE_DONE 
+ *   after the last one
+ */
+ProfileStatusEnumType ProfileProcess( Ina219SampleType *p_Sample );
+
+/* Load current for the running step
+ *   w_Voltage - Battery voltage in mV
+ *   Returns setpoint in 0.1mA, 0 for a rest step
+ */
+uint16 ProfileSetpoint( uint16 w_Voltage );
+
+/* Returns the running step's ProfileStepEnumType */
+uint8 ProfileGetStepType( void );
+
+/* Returns the index of the running step */
+uint8 ProfileGetStep( void );
+
+/* Returns the number of steps in the loaded profile */
+uint8 ProfileGetStepCount( void );
+
+#endif
@@ -0,0 +1,322 @@
+/* 
+sample.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include <avr/pgmspace.h>
+#include "common.h"
+#include "types.h"
+#include "isr.h"
+#include "ina219.h"
+#include "sample.h"
+#include "twi.h"
+
+/* The INA219 free runs at its conversion rate. Every C_SAMPLE_POLL_MS the bus
+ * voltage register is polled and once CNVR is set the rest of the conversion
+ * is read and integrated, so every conversion is counted exactly once.
+ *
+ * With several sensors each tick serves one of them. A turn lasts a tick,
+ * or longer when the poll finds a conversion: the poll and the three reads
+ * after it are four register transfers, about 6ms on the 62kHz bus with 
+ * the handoffs between them. Ticks that come while the bus is busy wait 
+ * for it. The load sensor, the only one regulated and integrated on, has 
+ * every other turn, so it is polled at least every 12ms and catches every 
+ * averaged ( 17ms ) conversion. The others share the remaining turns in 
+ * order and are read less often, each about every 31ms with four */
+
+static enum
+{
+  SAMPLE_STOPPED,
+  SAMPLE_IDLE,
+  SAMPLE_POLLING,
+  SAMPLE_READING
+} e_SampleState = SAMPLE_STOPPED;
+
+static uint8  u_CountCharge;
+static uint8  u_HavePrevious;
+static uint16 w_PrevRawCurrent;
+static uint16 w_PrevTimestamp;
+static uint16 w_ReadyTimestamp;
+static uint8  u_Sensor;
+static uint8  u_NextOther;   /* Next sensor other than the load's to serve */
+static uint8  u_TickPending;
+static Ina219SampleType a_Latest[C_SAMPLE_SENSORS];
+
+/* Whole mA seconds are carried out of the charge fraction a decade at a 
+ * time, as FormatNumber renders digits, rather than with a 32 bit divide */
+#define C_SAMPLE_CARRY_STEPS 5
+
+static const uint32 q_SampleCarryUnits[C_SAMPLE_CARRY_STEPS] PROGMEM = 
+{
+  10000UL * C_CHARGE_UNITS_PER_MAS, 1000UL * C_CHARGE_UNITS_PER_MAS, 
+  100UL * C_CHARGE_UNITS_PER_MAS, 10UL * C_CHARGE_UNITS_PER_MAS, C_CHARGE_UNITS_PER_MAS
+};
+
+static const uint16 w_SampleCarryMas[C_SAMPLE_CARRY_STEPS] PROGMEM = { 10000, 1000, 100, 10, 1 };
+
+static Ina219Type a_Sensor[C_SAMPLE_SENSORS] = 
+{
+  C_BOARD_INA219_0,
+#if C_SAMPLE_SENSORS > 1
+  C_BOARD_INA219_1,
+#endif
+#if C_SAMPLE_SENSORS > 2
+  C_BOARD_INA219_2,
+#endif
+#if C_SAMPLE_SENSORS > 3
+  C_BOARD_INA219_3,
+#endif
+};
+
+/* Initialize the TWI controller and every INA219 */
+void SampleInit( void )
+{
+  uint8 u_Index;
+
+  TWIInit();
+
+  for( u_Index = 0; u_Index < C_SAMPLE_SENSORS; u_Index++ )
+    ina219_init( &a_Sensor[u_Index] );
+}
+
+/* Returns the driver handle of one INA219 */
+Ina219Type *SampleGetSensor( uint8 u_Sensor )
+{
+  return( &a_Sensor[u_Sensor] );
+}
+
+/* Start polling the INA219 for completed conversions */
+void SampleStart( uint8 u_Count )
+{
+  u_CountCharge = u_Count;
+  u_HavePrevious = FALSE;
+  u_Sensor = C_SAMPLE_SENSORS - 1; /* The first tick serves sensor 0 */
+  u_NextOther = 1;
+  u_TickPending = FALSE;
+  e_SampleState = SAMPLE_IDLE;
+}
+
+/* Stop polling the INA219 */
+void SampleStop( void )
+{
+  e_SampleState = SAMPLE_STOPPED;
+}
+
+/* Add to a total that stops at its maximum rather than wrap */
+static void SampleAddSaturate( uint16 *p_Total, uint32 q_Add )
+{
+  q_Add += *p_Total;
+  *p_Total = ( q_Add > 0xFFFF ) ? 0xFFFF : q_Add;
+}
+
+/* Add one conversion to the charge and energy accumulators */
+static void SampleIntegrate( uint16 w_RawCurrent, uint16 w_Voltage, uint16 w_Timestamp )
+{
+  uint32 q_Charge;
+  uint32 q_Units;
+  uint16 w_Mas;
+  uint16 w_Elapsed;
+  uint8  u_Step;
+
+  if( u_HavePrevious )
+  {
+    w_Elapsed = w_Timestamp - w_PrevTimestamp;
+
+    if( w_Elapsed > C_SAMPLE_MAX_GAP_MS )
+      w_Elapsed = C_SAMPLE_MAX_GAP_MS;
+
+    /* Trapezoid: ( I0 + I1 ) * dt, in C_CHARGE_UNITS_PER_MAS units. The 
+     * sum is widened first as it can pass 32767 */
+    q_Charge = ( (uint32)w_PrevRawCurrent + w_RawCurrent ) * w_Elapsed;
+    q_Charge += z_Status.w_CapacityFraction;
+
+    if( q_Charge < C_CHARGE_UNITS_PER_MAS )
+    {
+      z_Status.w_CapacityFraction = q_Charge;
+    }
+    else
+    {
+      /* Carry whole mA seconds into the remainder and whole mAh out of it.
+       * Energy follows at the present battery voltage: mA seconds * mV = uJ.
+       * The readings are bounded ( below 32768 x 0.1mA and 33100mV, see 
+       * Ina219SampleType ) and so is the gap, so w_Mas stays below 53700 
+       * and the product below 1.8e9, inside 32 bits with the remainder 
+       * added. That is at most 41 subtractions after the longest gap and
+       * under 20 per averaged conversion. The remainders rarely reach a 
+       * whole unit, so they are only divided when they do */
+      w_Mas = 0;
+
+      for( u_Step = 0; u_Step < C_SAMPLE_CARRY_STEPS; u_Step++ )
+      {
+        q_Units = pgm_read_dword( &q_SampleCarryUnits[u_Step] );
+
+        while( q_Charge >= q_Units )
+        {
+          q_Charge -= q_Units;
+          w_Mas += pgm_read_word( &w_SampleCarryMas[u_Step] );
+        }
+      }
+
+      z_Status.w_CapacityFraction = q_Charge;
+
+      q_Charge = z_Status.w_CapacityRemainder + w_Mas;
+
+      if( q_Charge >= 3600 )
+      {
+        SampleAddSaturate( &z_Status.w_CapacityDischarged, q_Charge / 3600 );
+        q_Charge %= 3600;
+      }
+
+      z_Status.w_CapacityRemainder = q_Charge;
+
+      z_Status.q_EnergyRemainder += (uint32)w_Mas * w_Voltage;
+
+      if( z_Status.q_EnergyRemainder >= C_ENERGY_UJ_PER_UNIT )
+      {
+        SampleAddSaturate( &z_Status.w_EnergyDischarged, 
+                           z_Status.q_EnergyRemainder / C_ENERGY_UJ_PER_UNIT );
+        z_Status.q_EnergyRemainder %= C_ENERGY_UJ_PER_UNIT;
+      }
+    }
+  }
+
+  w_PrevRawCurrent = w_RawCurrent;
+  w_PrevTimestamp = w_Timestamp;
+  u_HavePrevious = TRUE;
+}
+
+/* Run the sampling engine from an ISR event */
+uint8 SampleProcess( uint8 u_Flags, uint16 w_Timestamp )
+{
+  uint8 u_NewSample = FALSE;
+
+  if( u_Flags & C_ISR_FLAG_SAMPLE_TICK )
+    u_TickPending = TRUE;
+
+  switch( e_SampleState )
+  {
+    case SAMPLE_POLLING:
+    {
+      if( u_Flags & C_ISR_FLAG_CONVERSION_POLL )
+      {
+        e_SampleState = SAMPLE_IDLE;
+
+        if( ina219_conversion_ready( &a_Sensor[u_Sensor] ) )
+        {
+          /* Time the poll completed, not when we got around to it */
+          w_ReadyTimestamp = w_Timestamp;
+
+          if( ina219_start_sample( &a_Sensor[u_Sensor] ) )
+            e_SampleState = SAMPLE_READING;
+        }
+      }
+      break;
+    }
+
+    case SAMPLE_READING:
+    {
+      if( u_Flags & C_ISR_FLAG_SAMPLE_READY )
+      {
+        ina219_get_sample( &a_Sensor[u_Sensor], &a_Latest[u_Sensor] );
+        a_Latest[u_Sensor].w_Timestamp = w_ReadyTimestamp;
+        e_SampleState = SAMPLE_IDLE;
+
+        if( u_Sensor != C_SAMPLE_LOAD_SENSOR )
+          break;
+
+        if( u_CountCharge )
+          SampleIntegrate( a_Latest[u_Sensor].w_RawCurrent, a_Latest[u_Sensor].w_Voltage, 
+                           w_ReadyTimestamp );
+
+        u_NewSample = TRUE;
+      }
+      break;
+    }
+
+    default:
+    {
+      break;
+    }
+  }
+
+  /* A tick that came while the bus was busy is served as soon as it is 
+   * free, so a conversion read does not cost the next sensor its turn */
+  if( ( e_SampleState == SAMPLE_IDLE ) && u_TickPending )
+  {
+    u_TickPending = FALSE;
+
+    if( ( C_SAMPLE_SENSORS == 1 ) || ( u_Sensor != C_SAMPLE_LOAD_SENSOR ) )
+    {
+      u_Sensor = C_SAMPLE_LOAD_SENSOR;
+    }
+    else
+    {
+      u_Sensor = u_NextOther;
+
+      if( ++u_NextOther == C_SAMPLE_SENSORS )
+        u_NextOther = 1;
+    }
+
+    if( ina219_start_poll( &a_Sensor[u_Sensor] ) )
+      e_SampleState = SAMPLE_POLLING;
+  }
+
+  return( u_NewSample );
+}
+
+/* Returns the most recently read load sensor conversion */
+void SampleGetLatest( Ina219SampleType *p_Sample )
+{
+  *p_Sample = a_Latest[C_SAMPLE_LOAD_SENSOR];
+}
+
+/* Returns the most recently read conversion of any sensor */
+void SampleGetSensorLatest( uint8 u_Sensor, Ina219SampleType *p_Sample )
+{
+  *p_Sample = a_Latest[u_Sensor];
+}
+
+/* Average voltage over a discharge */
+uint16 SampleAverageVoltage( uint32 q_EnergyMilliJ, uint32 q_ChargeMas )
+{
+  /* mJ * 1000 / mA seconds = mV. Halve both until the product fits, which 
+   * only costs precision once the totals are large */
+  while( q_EnergyMilliJ > 0xFFFFFFFFUL / 1000 )
+  {
+    q_EnergyMilliJ >>= 1;
+    q_ChargeMas >>= 1;
+  }
+
+  if( q_ChargeMas == 0 )
+    return( 0 );
+
+  q_EnergyMilliJ = q_EnergyMilliJ * 1000 / q_ChargeMas;
+
+  return( q_EnergyMilliJ > 0xFFFF ? 0xFFFF : q_EnergyMilliJ );
+}
+
+/* Average power over a discharge */
+uint16 SampleAveragePower( uint32 q_EnergyMilliJ, uint32 q_Seconds )
+{
+  /* mJ / s = mW */
+  if( q_Seconds == 0 )
+    return( 0 );
+
+  q_EnergyMilliJ /= q_Seconds;
+
+  return( q_EnergyMilliJ > 0xFFFF ? 0xFFFF : q_EnergyMilliJ );
+}
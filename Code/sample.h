@@ -0,0 +1,95 @@
+/* 
+sample.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "types.h"
+#include "ina219.h"
+#include "board.h"
+
+#if ( C_BOARD_INA219_COUNT < 1 ) || ( C_BOARD_INA219_COUNT > C_INA219_MAX_DEVICES )
+#error "Unsupported number of INA219 sensors"
+#endif
+
+/* Charge is integrated in units of 0.1mA * 1ms / 2 ( trapezoid sum of raw
+ * INA219 current readings times elapsed ms ). This many make up one mA second */
+#define C_CHARGE_UNITS_PER_MAS 20000
+
+/* Energy is counted in 10mWh units, 36J each */
+#define C_ENERGY_UJ_PER_UNIT 36000000UL
+
+/* Longest interval integrated between two conversions. A longer gap means 
+ * sampling stalled; counting it as this long keeps the charge and energy 
+ * products inside 32 bits for any reading, see SampleIntegrate */
+#define C_SAMPLE_MAX_GAP_MS 16384
+
+/* INA219 sensors sampled, and the one measuring the load. The load sensor
+ * is served every other turn, the others in order from 1 in between */
+#define C_SAMPLE_SENSORS     C_BOARD_INA219_COUNT
+#define C_SAMPLE_LOAD_SENSOR 0
+
+/* Initialize the TWI controller and every INA219 */
+void SampleInit( void );
+
+/* Returns the driver handle of one INA219, for changing its conversion rate
+ *   u_Sensor - Index below C_SAMPLE_SENSORS
+ */
+Ina219Type *SampleGetSensor( uint8 u_Sensor );
+
+/* Start polling the INA219 for completed conversions
+ *   u_CountCharge - TRUE to integrate every conversion into z_Status
+ */
+void SampleStart( uint8 u_CountCharge );
+
+/* Stop polling the INA219 */
+void SampleStop( void );
+
+/* Run the sampling engine from an ISR event
+ *   u_Flags - ISR flags
+ *   w_Timestamp - Time the event was posted
+ *   Returns TRUE if a new load sensor conversion was read ( and integrated )
+ */
+uint8 SampleProcess( uint8 u_Flags, uint16 w_Timestamp );
+
+/* Returns the most recently read load sensor conversion */
+void SampleGetLatest( Ina219SampleType *p_Sample );
+
+/* Returns the most recently read conversion of any sensor. w_Timestamp 
+ * tells how fresh it is
+ *   u_Sensor - Index below C_SAMPLE_SENSORS
+ */
+void SampleGetSensorLatest( uint8 u_Sensor, Ina219SampleType *p_Sample );
+
+/* Average voltage over a discharge ( energy / charge ). Called once per 
+ * screen update, not per conversion, as it divides
+ *   q_EnergyMilliJ - Energy discharged in mJ
+ *   q_ChargeMas - Charge discharged in mA seconds
+ *   Returns mV, 0 if nothing was discharged
+ */
+uint16 SampleAverageVoltage( uint32 q_EnergyMilliJ, uint32 q_ChargeMas );
+
+/* Average power over a discharge ( energy / time )
+ *   q_EnergyMilliJ - Energy discharged in mJ
+ *   q_Seconds - Duration in seconds
+ *   Returns mW, 0 if no time has passed
+ */
+uint16 SampleAveragePower( uint32 q_EnergyMilliJ, uint32 q_Seconds );
+
+#endif
@@ -17,31 +17,100 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
 */
 
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
 #include "sound.h"
 #include "types.h"
-#include <avr/io.h>
+#include "board.h"
 
-/* Bit bang a squarewave at a specific frequency and duration */
-void playNote( uint16 period_us, uint16 duration_ms )
-{
-  uint8  u_StartCnt;
-  uint8  u_HalfPeriod;
+const SoundNoteType z_MelodyStartup[] PROGMEM = {
+  SOUND_NOTE( 3033, 100 ),
+  SOUND_NOTE( 2551, 100 ),
+  SOUND_NOTE( 1911, 100 ),
+  SOUND_END };
 
-  uint16 w_LoopCount = ((uint32)duration_ms * 1000) / period_us;
+const SoundNoteType z_MelodyFinished[] PROGMEM = {
+  SOUND_NOTE( 3033, 100 ),
+  SOUND_NOTE( 2551, 100 ),
+  SOUND_NOTE( 1911, 100 ),
+  SOUND_REST( 1500 ),
+  SOUND_END };
 
-  u_HalfPeriod = (uint8)( period_us >> 4 ); // Div 2 for half period. Div 8 for prescaler
+static const SoundNoteType *p_Melody;
+static const SoundNoteType *p_Note;
+static volatile uint8 u_Repeat = 0;
+static uint8  u_Silent;
+static uint16 w_Count;
 
-  PORTC &= ~_BV(PORTC2);
+/* Load next note. Returns FALSE at end of melody */
+static uint8 SoundLoadNote( void )
+{
+  w_Count = pgm_read_word( &p_Note->w_Count );
 
-  while( w_LoopCount-- )
+  if( w_Count == 0 )
   {
-    u_StartCnt = TCNT0;
-  	while( (uint8)(TCNT0 - u_StartCnt) < u_HalfPeriod );
-    PORTC |= _BV(PORTC2);
+    if( --u_Repeat == 0 )
+      return( FALSE );
+
+    p_Note = p_Melody;
+    w_Count = pgm_read_word( &p_Note->w_Count );
+  }
+
+  OCR0A = pgm_read_byte( &p_Note->u_Compare );
+  u_Silent = pgm_read_byte( &p_Note->u_Silent );
+  p_Note++;
+
+  return( TRUE );
+}
+
+/* Start playing a melody in the background */
+void SoundPlay( const SoundNoteType *p_NewMelody, uint8 u_NewRepeat )
+{
+  SoundStop();
+
+  if( u_NewRepeat == 0 )
+    return;
+
+  p_Melody = p_NewMelody;
+  p_Note = p_NewMelody;
+  u_Repeat = u_NewRepeat;
 
-  	u_StartCnt = TCNT0;
-  	while( (uint8)(TCNT0 - u_StartCnt) < u_HalfPeriod );
-    PORTC &= ~_BV(PORTC2);
+  if( SoundLoadNote() )
+  {
+    TCNT0 = 0;
+    TIFR0 = _BV(OCF0A);
+    TIMSK0 |= _BV(OCIE0A);
   }
 }
 
+/* Stop playing */
+void SoundStop( void )
+{
+  TIMSK0 &= ~_BV(OCIE0A);
+  u_Repeat = 0;
+  C_BOARD_SPEAKER_PORT &= ~_BV(C_BOARD_SPEAKER_BIT);
+}
+
+/* Returns TRUE while a melody is playing */
+uint8 SoundBusy( void )
+{
+  return( u_Repeat != 0 );
+}
+
+/* Timer 0 compare interrupt. Toggles speaker and sequences notes */
+ISR ( TIMER0_COMPA_vect )
+{
+  if( !u_Silent )
+    C_BOARD_SPEAKER_PIN = _BV(C_BOARD_SPEAKER_BIT); // Writing PIN toggles the output
+
+  if( --w_Count == 0 )
+  {
+    C_BOARD_SPEAKER_PORT &= ~_BV(C_BOARD_SPEAKER_BIT);
+
+    if( !SoundLoadNote() )
+    {
+      TIMSK0 &= ~_BV(OCIE0A);
+    }
+  }
+}
@@ -20,9 +20,41 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #ifndef SOUND_H
 #define SOUND_H
 
+#include <avr/pgmspace.h>
 #include "types.h"
 
-/* Bit bang a squarewave at a specific frequency and duration */
-void playNote( uint16 period_us, uint16 duration_ms );
+/* Melodies are tables of notes in flash played from the Timer0 compare 
+ * interrupt. Timer0 runs at 125kHz ( 8us per count ) in CTC mode; each 
+ * compare match toggles the speaker for a note or counts 1ms for a rest */
+typedef struct
+{
+  uint8  u_Compare; /* OCR0A value */
+  uint8  u_Silent;  /* TRUE for a rest */
+  uint16 w_Count;   /* Compare matches until next note. 0 ends the melody */
+} SoundNoteType;
+
+/* Note of period_us ( up to 4096us ) for duration_ms */
+#define SOUND_NOTE( period_us, duration_ms ) \
+  { (period_us) / 16 - 1, FALSE, (uint16)( ( (uint32)(duration_ms) * 2000 ) / (period_us) ) }
+
+/* Silence for duration_ms */
+#define SOUND_REST( duration_ms ) { 124, TRUE, (duration_ms) }
+
+#define SOUND_END { 0, FALSE, 0 }
+
+extern const SoundNoteType z_MelodyStartup[] PROGMEM;
+extern const SoundNoteType z_MelodyFinished[] PROGMEM;
+
+/* Start playing a melody in the background
+ *   p_Melody - Note table in program memory
+ *   u_Repeat - Number of times to play it
+ */
+void SoundPlay( const SoundNoteType *p_Melody, uint8 u_Repeat );
+
+/* Stop playing */
+void SoundStop( void );
+
+/* Returns TRUE while a melody is playing */
+uint8 SoundBusy( void );
 
 #endif
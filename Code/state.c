@@ -18,17 +18,29 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
 #include "common.h"
-#include <util/delay.h>
 #include <util/atomic.h>
 #include <string.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include "isr.h"
 #include "state.h"
 #include "types.h"
 #include "config.h"
-#include "lcd.h"
-#include "ina219.h"
+#include "disp.h"
+#include "format.h"
+#include "ina219.h"
 #include "sound.h"
+#include "load.h"
+#include "sample.h"
+#include "control.h"
+#include "calib.h"
+#include "history.h"
+#include "checkpoint.h"
+#include "ir.h"
+#include "profile.h"
+#include "wave.h"
+#include "telemetry.h"
+#include "board.h"
 
 #define MIN_CELLS_NIMH 4
 #define MIN_CELLS_LIPO 1
@@ -37,8 +49,21 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define CELL_CUTOFF_LIPO_FULL_DISCHARGE 3000 /* mV */
 #define CELL_CUTOFF_NIMH_STORAGE        900  /* mV */ 
 #define CELL_CUTOFF_LIPO_STORAGE        3800 /* mV */       
-#define CUSTOM_CURRENT_MAX              1000 /* mA */
+#define CUSTOM_CURRENT_MAX              ( 1000 * C_LOAD_CHANNELS ) /* mA */
 #define CUSTOM_CURRENT_INCREMENT        10
+#define POWER_MIN                       1    /* 0.1W */
+#define POWER_MAX                       250  /* 0.1W */
+#define POWER_INCREMENT                 1
+#define RESISTANCE_MIN                  10   /* 0.1 Ohm */
+#define RESISTANCE_MAX                  1000 /* 0.1 Ohm */
+#define RESISTANCE_INCREMENT            5
+#define TAPER_END_MIN                   10   /* mA */
+#define TAPER_END_MAX                   500  /* mA */
+#define TAPER_END_INCREMENT             10
+#define TAPER_END_SECONDS               5    /* Below the end current this long */
+#define CALIBRATE_MIN_VOLTAGE           3000 /* mV */
+#define IR_TEST_PULSES                  4
+#define IR_INTERVAL                     60   /* Seconds between pulses while discharging */
 
 static enum
 {
@@ -48,204 +73,610 @@ static enum
   STATE_CONFIG_SET_NUM_CELLS,
   STATE_CONFIG_SET_CURRENT,
   STATE_CONFIG_SET_CURRENT_CUSTOM,
+  STATE_CONFIG_SET_POWER,
+  STATE_CONFIG_SET_RESISTANCE,
+  STATE_CONFIG_SET_TAPER_END,
+  STATE_CONFIG_SET_PROFILE,
   STATE_WAIT_BATTERY,
   STATE_DISCHARGE,
-  STATE_FINISHED
+  STATE_FINISHED,
+  STATE_CALIBRATE,
+  STATE_CALIBRATE_FINISHED,
+  STATE_HISTORY,
+  STATE_RESUME,
+  STATE_IR_TEST,
+  STATE_IR_FINISHED
 } e_State = STATE_INIT;
 
-static const char *p_ModeStrings[] = {
-  "Full Discharge  ", 
-  "Storage         " };
+static const char a_ModeFullDischarge[] PROGMEM = "Full Discharge  ";
+static const char a_ModeStorage[] PROGMEM       = "Storage         ";
+static const char a_ModePower[] PROGMEM         = "Const Power     ";
+static const char a_ModeResistance[] PROGMEM    = "Const Resistance";
+static const char a_ModeIRTest[] PROGMEM        = "IR Test         ";
+static const char a_ModeProfile[] PROGMEM       = "Profile         ";
+static const char a_ModeWave[] PROGMEM          = "Waveform        ";
+static const char a_ModeCalibrate[] PROGMEM     = "Calibrate       ";
+static const char a_ModeHistory[] PROGMEM       = "History         ";
+
+static PGM_P const p_ModeStrings[] PROGMEM = {
+  a_ModeFullDischarge, 
+  a_ModeStorage,
+  a_ModePower,
+  a_ModeResistance,
+  a_ModeIRTest,
+  a_ModeProfile,
+  a_ModeWave,
+  a_ModeCalibrate,
+  a_ModeHistory };
+
+static const char a_CellTypeNimh[] PROGMEM = "NIMH            ";
+static const char a_CellTypeLipo[] PROGMEM = "LiPo            ";
+
+static PGM_P const p_CellTypeStrings[] PROGMEM = {
+  a_CellTypeNimh, 
+  a_CellTypeLipo };
+
+static const char a_Current50[] PROGMEM     = "50mA            ";
+static const char a_Current100[] PROGMEM    = "100mA           ";
+static const char a_Current500[] PROGMEM    = "500mA           ";
+static const char a_Current1000[] PROGMEM   = "1000mA          ";
+static const char a_CurrentCustom[] PROGMEM = "Custom          ";
+
+static PGM_P const p_DischargeCurrentStrings[] PROGMEM = { 
+  a_Current50, 
+  a_Current100,
+  a_Current500, 
+  a_Current1000,
+  a_CurrentCustom };
+
+static const char a_ProfileKnee[] PROGMEM  = "Knee Capacity   ";
+static const char a_ProfileSteps[] PROGMEM = "Load Steps      ";
+static const char a_ProfileUser[] PROGMEM  = "User ( EEPROM ) ";
+
+static PGM_P const p_ProfileStrings[] PROGMEM = {
+  a_ProfileKnee,
+  a_ProfileSteps,
+  a_ProfileUser };
+
+static const char a_StepCC[] PROGMEM   = "CC  ";
+static const char a_StepCP[] PROGMEM   = "CP  ";
+static const char a_StepCR[] PROGMEM   = "CR  ";
+static const char a_StepRest[] PROGMEM = "Rest";
+
+static PGM_P const p_StepStrings[] PROGMEM = {
+  a_StepCC,
+  a_StepCP,
+  a_StepCR,
+  a_StepRest };
+
+static const char a_ResumeNo[] PROGMEM  = "No              ";
+static const char a_ResumeYes[] PROGMEM = "Yes             ";
+
+static PGM_P const p_ResumeStrings[] PROGMEM = {
+  a_ResumeNo,
+  a_ResumeYes };
+
+static const uint16 w_DischargeCurrentLookup[] PROGMEM = { 50, 100, 500, 1000 };
+
+static uint8 u_CalibRunning;
+static uint8 u_HistoryIndex;
+static uint8 u_HistoryPage;
+static uint8 u_Resume;
+static uint8 u_CheckpointSeconds;
+static uint8 u_DischargePage;
+static uint8 u_Taper;
+static uint8 u_TaperEndSeconds;
+static uint16 w_IRSeconds;
+static uint16 w_IRInterval;
+static uint16 w_IRDuty;
+static uint16 w_WaveMinVoltage;
+static uint16 w_WaveSagCurrent;
+
+/* Display a multi-digit number on the LCD. See FormatNumber */
+static void StateDisplayNumber( uint16 w_Number, uint8 u_FieldSize, 
+                         uint8 u_DigitsAfterDecimal, char u_FillChar )
+{
+  char a_Buffer[C_FORMAT_FIELD_MAX + 1];
 
-static const char *p_CellTypeStrings[] = {
-  "NIMH            ", 
-  "LiPo            " };
+  FormatNumber( a_Buffer, w_Number, u_FieldSize, u_DigitsAfterDecimal, u_FillChar );
+  DispPuts( a_Buffer );
+}
 
-static const char *p_DischargeCurrentStrings[] = { 
-  "50mA            ", 
-  "100mA           ",
-  "500mA           ", 
-  "1000mA          ",
-  "Custom          " };
+/* Display a formatted time on the LCD
+ *   p_Separator - Program memory string put between the fields
+ */
+static void StateDispTime( uint8 u_Hours, uint8 u_Minutes, uint8 u_Seconds, 
+                           PGM_P p_Separator )
+{
+  /* Hours */
+  StateDisplayNumber( u_Hours, 2, 0, '0' );
+  DispPuts_p( p_Separator );
 
-static const uint16 w_DischargeCurrentLookup[] = { 50, 100, 500, 1000 };
+  /* Minutes */
+  StateDisplayNumber( u_Minutes, 2, 0, '0' );
+  DispPuts_p( p_Separator );
 
-/* Routine to disable OpAmp to save power */
-static void StateOpAmpPowerOn( void )
+  /* Seconds */
+  StateDisplayNumber( u_Seconds, 2, 0, '0' );
+}
+
+/* Display a value in tenths as "nnn.n" */
+static void StateDisplayTenths( uint16 w_Number )
 {
-  PORTB |= _BV(PORTB5);
-  _delay_ms(100);
+  /* The decimal point takes the place of the lowest digit */
+  StateDisplayNumber( w_Number * 10, 5, 1, ' ' );
 }
 
-/* Routine to enable OpAmp */
-static void StateOpAmpPowerOff( void )
+/* Display resistance in 0.1mOhm as "nnn.n", or " nnnn" from 1 Ohm up */
+static void StateDisplayResistance( uint16 w_Resistance )
 {
-  PORTB &= ~_BV(PORTB5);
+  if( w_Resistance < 10000 )
+  {
+    StateDisplayNumber( w_Resistance / 10, 3, 0, ' ' );
+    DispPutc( '.' );
+    DispPutc( '0' + w_Resistance % 10 );
+  }
+  else
+    StateDisplayNumber( w_Resistance / 10, 5, 0, ' ' );
 }
 
-/* Display a multi-digit number on the LCD
- * w_Number - Number to display
- * u_FieldSize - Size of the field to be displayed, elements of the field not containing
- *   numerical digits will be filled with u_FillChar
- * u_DigitsAfterDecimal - Number of digits to after decimal point. If '0' then no decimal
- *   point displayed
- * u_FillChar - Character used to fill empty field positions
+/* Display energy in 10mWh as "nnn.nWh" */
+static void StateDisplayEnergy( uint16 w_Energy )
+{
+  StateDisplayNumber( w_Energy, 5, 1, ' ' );
+  DispPuts_P( "Wh" );
+}
+
+/* Display average voltage and power as "Avg nn.nnV nn.nnW"
+ *   q_EnergyMilliJ - Energy discharged in mJ
+ *   q_ChargeMas - Charge discharged in mA seconds
+ *   u_Hours, u_Minutes, u_Seconds - Duration
  */
-static void StateDisplayNumber( uint16 w_Number, uint8 u_FieldSize, 
-                         uint8 u_DigitsAfterDecimal, char u_FillChar )
+static void StateDisplayAverages( uint32 q_EnergyMilliJ, uint32 q_ChargeMas, 
+                                  uint8 u_Hours, uint8 u_Minutes, uint8 u_Seconds )
 {
-  uint16 w_Temp;
-  uint16 w_Divisor = 1;
-  uint8 u_Count;
-  uint8 u_DecimalPlaceIndex = 0;
-  uint8 u_NonZeroDigitFound = FALSE;
+  uint32 q_Duration = u_Hours * 3600UL + u_Minutes * 60 + u_Seconds;
 
-  if( u_FieldSize > 8 || u_DigitsAfterDecimal > u_FieldSize - 2 )
-    return;
+  DispPuts_P( "Avg" );
+  StateDisplayNumber( SampleAverageVoltage( q_EnergyMilliJ, q_ChargeMas ), 5, 2, ' ' );
+  DispPuts_P( "V " );
+  StateDisplayNumber( SampleAveragePower( q_EnergyMilliJ, q_Duration ), 5, 2, ' ' );
+  DispPutc( 'W' );
+}
+
+/* Display averages of the running discharge */
+static void StateDisplayStatusAverages( void )
+{
+  StateDisplayAverages( z_Status.w_EnergyDischarged * 36000UL + z_Status.q_EnergyRemainder / 1000,
+                        z_Status.w_CapacityDischarged * 3600UL + z_Status.w_CapacityRemainder,
+                        z_Status.u_Hours, z_Status.u_Minutes, z_Status.u_Seconds );
+}
+
+/* Draw the second discharge line: time and Wh, or averages */
+static void StateDisplayDischargeLine( void )
+{
+  DispGotoXY(0,1);
 
-  if( u_DigitsAfterDecimal )
+  if( u_DischargePage == 0 )
   {
-    u_DecimalPlaceIndex = u_FieldSize - u_DigitsAfterDecimal - 1;
+    StateDispTime( z_Status.u_Hours, z_Status.u_Minutes, z_Status.u_Seconds, PSTR(":") );
+    DispPutc( ' ' );
+    StateDisplayEnergy( z_Status.w_EnergyDischarged );
   }
-
-  for( u_Count = 1; u_Count < u_FieldSize; u_Count++ )
+  else
+  if( u_DischargePage == 1 )
+    StateDisplayStatusAverages();
+  else
+  if( z_Config.e_Mode == MODE_WAVE )
   {
-    w_Divisor *= 10;
+    /* Deepest sag so far and the current that caused it */
+    DispPuts_P( "Sag" );
+    StateDisplayNumber( w_WaveMinVoltage, 5, 2, ' ' );
+    DispPuts_P( "V " );
+    StateDisplayNumber( w_WaveSagCurrent, 4, 0, ' ' );
+    DispPuts_P( "mA" );
   }
-
-  for( u_Count = 0; u_Count < u_FieldSize; u_Count++ )  
+  else
+  if( z_Config.e_Mode == MODE_PROFILE )
   {
-    if( u_DigitsAfterDecimal && ( u_Count == u_DecimalPlaceIndex ) )
-    {
-      lcd_putc('.');
-      u_NonZeroDigitFound = TRUE;
-    }
-    else
-    {
-      w_Temp = w_Number / w_Divisor;
-
-      if( w_Temp )
-      {
-        lcd_putc( (uint8)w_Temp + 48 );
-        w_Number -= w_Temp * w_Divisor;
-        u_NonZeroDigitFound = TRUE;
-      }
-      else
-      {
-        if( !u_NonZeroDigitFound )
-        {
-          if( u_Count + 1 == u_DecimalPlaceIndex )
-          {
-            lcd_putc('0');
-          }
-          else
-          {
-            if( u_Count == u_FieldSize - 1 )
-              lcd_putc('0');
-            else
-              lcd_putc( u_FillChar );
-          }
-        }
-        else
-        {
-          lcd_putc('0');
-        }
-      }
-
-      w_Divisor /= 10;
-    }
+    /* Running profile step */
+    DispPuts_P( "Step " );
+    DispPutc( '1' + ProfileGetStep() );
+    DispPutc( '/' );
+    DispPutc( '0' + ProfileGetStepCount() );
+    DispPutc( ' ' );
+    DispPutsTable_p( p_StepStrings, ProfileGetStepType() );
+    DispPuts_P( "   " );
+  }
+  else
+  {
+    uint16 w_Capacity;
+    uint16 w_Resistance;
+
+    /* Latest internal resistance ( \xF4 is Ohm in the LCD font ) */
+    IRCurveGet( IRCurveCount() - 1, &w_Capacity, &w_Resistance );
+    DispPuts_P( "IR   " );
+    StateDisplayResistance( w_Resistance );
+    DispPuts_P( " m\xF4   " );
   }
 }
 
-/* Display a formatted time on the LCD */
-static void StateDispTime( uint8 u_Hours, uint8 u_Minutes, uint8 u_Seconds )
+/* Returns the configured constant discharge current in mA */
+static uint16 StateConfiguredCurrent( void )
 {
-  /* Hours */
-  StateDisplayNumber( u_Hours, 2, 0, '0' );
-  lcd_puts(" : ");
-
-  /* Minutes */
-  StateDisplayNumber( u_Minutes, 2, 0, '0' );
-  lcd_puts(" : ");
+  if( z_Config.e_DischargeCurrent == DISCHARGE_CURRENT_CUSTOM )
+    return( z_Config.w_DischargeCurrentCustom );
+  else
+    return( pgm_read_word( &w_DischargeCurrentLookup[z_Config.e_DischargeCurrent] ) );
+}
 
-  /* Seconds */
-  StateDisplayNumber( u_Seconds, 2, 0, '0' );
+/* Load current that gives the configured power or resistance at the present
+ * battery voltage. Not used in the constant current modes
+ *   w_Voltage - Battery voltage in mV
+ *   Returns load current setpoint in 0.1mA
+ */
+static uint16 StateLoadSetpoint( uint16 w_Voltage )
+{
+  if( z_Config.e_Mode == MODE_CONSTANT_POWER )
+    return( ControlPowerSetpoint( z_Config.w_Power, w_Voltage ) );
+  else
+    return( ControlResistanceSetpoint( z_Config.w_Resistance, w_Voltage ) );
 }
 
 /* Handle transition to config state */
 static void StateEnterConfig( void )
 {
   /* Disable PWM */
-  OCR1B = 0;
+  IRStop();
+  WaveStop();
+  LoadSetDuty( 0 );
+  SampleStop();
 
   /* Clear Status */
   memset( &z_Status, 0, sizeof( z_Status ) );
         
-  lcd_clrscr();
-  lcd_puts("Mode:\n");
-  lcd_puts( p_ModeStrings[z_Config.e_Mode] );
+  DispClear();
+  DispPuts_P("Mode:\n");
+  DispPutsTable_p( p_ModeStrings, z_Config.e_Mode );
   e_State = STATE_CONFIG_SET_MODE;
 }
 
+/* Handle transition to wait for battery state */
+static void StateEnterWaitBattery( void )
+{
+  SampleStart( FALSE );
+  e_State = STATE_WAIT_BATTERY;
+}
+
+/* Handle the end of current selection. Storage mode goes on to ask where
+ * its constant voltage phase ends */
+static void StateEnterCurrentSelected( void )
+{
+  if( z_Config.e_Mode == MODE_STORAGE )
+  {
+    DispClear();
+    DispPuts_P("CV End Current:\n");
+    StateDisplayNumber( z_Config.w_TaperEnd, 4, 0, ' ' );
+    DispPuts_P(" mA");
+    e_State = STATE_CONFIG_SET_TAPER_END;
+  }
+  else
+    StateEnterWaitBattery();
+}
+
 /* Handle transition to discharge state */
 static void StateEnterDischarge( void )
 {
-  uint32 q_Temp;
+  uint16 w_Duty;
 
   /* Store config parameters to EEPROM */
   ConfigWriteEEPROM( &z_Config );
   
-  lcd_clrscr();
+  DispClear();
 
-  if( z_Config.e_DischargeCurrent == DISCHARGE_CURRENT_CUSTOM )
-    z_Status.w_DischargeCurrent = z_Config.w_DischargeCurrentCustom;
+  if( ( z_Config.e_Mode == MODE_CONSTANT_POWER ) || 
+      ( z_Config.e_Mode == MODE_CONSTANT_RESISTANCE ) )
+  {
+    Ina219SampleType z_Sample;
+
+    /* Starting point only, the setpoint follows the voltage from here on */
+    SampleGetLatest( &z_Sample );
+    z_Status.w_DischargeCurrent = StateLoadSetpoint( z_Sample.w_Voltage ) / 10;
+  }
   else
-    z_Status.w_DischargeCurrent = w_DischargeCurrentLookup[z_Config.e_DischargeCurrent];
+  if( z_Config.e_Mode == MODE_PROFILE )
+  {
+    Ina219SampleType z_Sample;
+
+    /* Profile steps set the load from here on */
+    ProfileStart( StateConfiguredCurrent(), z_Config.u_NumCells, 
+                  ( z_Config.e_CellType == CELL_TYPE_LIPO ) ? 
+                  CELL_CUTOFF_LIPO_FULL_DISCHARGE : CELL_CUTOFF_NIMH_FULL_DISCHARGE );
+    SampleGetLatest( &z_Sample );
+    z_Status.w_DischargeCurrent = ProfileSetpoint( z_Sample.w_Voltage ) / 10;
+  }
+  else
+    z_Status.w_DischargeCurrent = StateConfiguredCurrent();
 
   if( z_Config.e_CellType == CELL_TYPE_NIMH )
   {
     /* NIMH */
-    if( z_Config.e_Mode == MODE_FULL_DISCHARGE )
+    if( z_Config.e_Mode == MODE_STORAGE )
     {
-      /* Full Discharge */
-      z_Status.w_CutoffVoltage = CELL_CUTOFF_NIMH_FULL_DISCHARGE;
+      /* Storage */
+      z_Status.w_CutoffVoltage = CELL_CUTOFF_NIMH_STORAGE;
     }
     else
     {
-      /* Storage */
-      z_Status.w_CutoffVoltage = CELL_CUTOFF_NIMH_STORAGE;
+      /* All other modes */
+      z_Status.w_CutoffVoltage = CELL_CUTOFF_NIMH_FULL_DISCHARGE;
     }
   }
   else
   {
     /* LIPO */
-    if( z_Config.e_Mode == MODE_FULL_DISCHARGE )
+    if( z_Config.e_Mode == MODE_STORAGE )
     {
-      /* Full Discharge */
-      z_Status.w_CutoffVoltage = CELL_CUTOFF_LIPO_FULL_DISCHARGE;
+      /* Storage */
+      z_Status.w_CutoffVoltage = CELL_CUTOFF_LIPO_STORAGE;
     }
     else
     {
-      /* Storage */
-      z_Status.w_CutoffVoltage = CELL_CUTOFF_LIPO_STORAGE;
+      /* All other modes */
+      z_Status.w_CutoffVoltage = CELL_CUTOFF_LIPO_FULL_DISCHARGE;
     }
   }
 
   z_Status.w_CutoffVoltage *= z_Config.u_NumCells;
 
   /* Turn on OpAmp */
-  StateOpAmpPowerOn();
+  LoadPowerOn();
+
+  /* Set PWM to approximate current discharge. Regulator fine tunes it from 
+   * every conversion */
+  w_Duty = CalibFeedForward( z_Status.w_DischargeCurrent );
 
-  /* Set PWM to approximate current discharge. Will be fine tuned at 1Hz rate */
-  q_Temp = ( ( ( uint32 ) z_Status.w_DischargeCurrent ) * 1000 ) / 1094;
-  OCR1B = (uint16) q_Temp;
+  if( u_Resume )
+  {
+    CheckpointRecordType z_Checkpoint;
+
+    /* Carry on from the interrupted session, reseeding the regulator with
+     * the duty it had settled on */
+    if( CheckpointRead( &z_Checkpoint ) )
+    {
+      z_Status.w_CapacityDischarged = z_Checkpoint.w_CapacityDischarged;
+      z_Status.w_CapacityRemainder = z_Checkpoint.w_CapacityRemainder;
+      z_Status.w_CapacityFraction = z_Checkpoint.w_CapacityFraction;
+      z_Status.w_EnergyDischarged = z_Checkpoint.w_EnergyDischarged;
+      z_Status.q_EnergyRemainder = z_Checkpoint.q_EnergyRemainder;
+      z_Status.u_Hours = z_Checkpoint.u_Hours;
+      z_Status.u_Minutes = z_Checkpoint.u_Minutes;
+      z_Status.u_Seconds = z_Checkpoint.u_Seconds;
+      w_Duty = z_Checkpoint.w_Duty;
+    }
+
+    u_Resume = FALSE;
+  }
+
+  u_CheckpointSeconds = 0;
+  u_DischargePage = 0;
+  u_Taper = FALSE;
+  w_IRSeconds = 0;
+  w_IRInterval = IR_INTERVAL;
+  IRCurveReset();
+  ControlStart( z_Status.w_DischargeCurrent * 10, w_Duty );
+  LoadSetDuty( w_Duty );
+
+  /* Configured current is the waveform's full scale */
+  if( z_Config.e_Mode == MODE_WAVE )
+  {
+    w_WaveMinVoltage = 0xFFFF;
+    w_WaveSagCurrent = 0;
+    WaveStart( z_Status.w_DischargeCurrent );
+  }
+
+  /* Integrate every conversion from here on */
+  SampleStart( TRUE );
 
   e_State = STATE_DISCHARGE;
 }
 
-/* Process ISR flags */
-void StateProcessFlags( uint8 u_Flags )
+/* Handle transition to internal resistance test state */
+static void StateEnterIRTest( void )
+{
+  ConfigWriteEEPROM( &z_Config );
+
+  DispClear();
+  DispPuts_P("IR Test");
+
+  LoadPowerOn();
+  SampleStart( FALSE );
+  IRStart( StateConfiguredCurrent(), IR_TEST_PULSES );
+  e_State = STATE_IR_TEST;
+}
+
+/* Handle a battery being connected */
+static void StateEnterBatteryFound( void )
+{
+  if( z_Config.e_Mode == MODE_IR_TEST )
+    StateEnterIRTest();
+  else
+    StateEnterDischarge();
+}
+
+/* Handle transition to finished state */
+static void StateEnterFinished( void )
+{
+  HistoryRecordType z_Record;
+  Ina219SampleType z_Sample;
+
+  /* Log session. Voltage is the loaded voltage that triggered cutoff */
+  SampleGetLatest( &z_Sample );
+  z_Record.u_Mode = z_Config.e_Mode;
+  z_Record.u_Cells = ( z_Config.e_CellType << 4 ) | z_Config.u_NumCells;
+  if( z_Config.e_Mode == MODE_CONSTANT_POWER )
+    z_Record.w_DischargeCurrent = z_Config.w_Power;
+  else
+  if( z_Config.e_Mode == MODE_CONSTANT_RESISTANCE )
+    z_Record.w_DischargeCurrent = z_Config.w_Resistance;
+  else
+  if( z_Config.e_Mode == MODE_PROFILE )
+    z_Record.w_DischargeCurrent = StateConfiguredCurrent();
+  else
+    z_Record.w_DischargeCurrent = z_Status.w_DischargeCurrent;
+  z_Record.w_Capacity = z_Status.w_CapacityDischarged;
+  z_Record.u_Hours = z_Status.u_Hours;
+  z_Record.u_Minutes = z_Status.u_Minutes;
+  z_Record.u_Seconds = z_Status.u_Seconds;
+  z_Record.w_EndVoltage = z_Sample.w_Voltage;
+  z_Record.w_Energy = z_Status.w_EnergyDischarged;
+  HistoryAppend( &z_Record );
+
+  /* Turn off load */
+  IRStop();
+  WaveStop();
+  LoadSetDuty( 0 );
+  SampleStart( FALSE );
+
+  /* Nothing left to resume */
+  CheckpointClear();
+
+  /* Turn off LED */
+  C_BOARD_LED_PORT &= ~_BV(C_BOARD_LED_BIT);
+
+  /* Display time elapsed, mAh and Wh discharged */
+  DispClear();
+
+  /* mAh, Wh */
+  StateDisplayNumber( z_Status.w_CapacityDischarged, 4, 0, ' ' );
+  DispPuts_P( "mAh  " );
+  StateDisplayEnergy( z_Status.w_EnergyDischarged );
+
+  /* Time. Encoder flips to averages */
+  DispGotoXY(0,1);
+  DispPuts_P( "  " );
+  StateDispTime( z_Status.u_Hours, z_Status.u_Minutes, z_Status.u_Seconds, PSTR(" : ") );
+  u_DischargePage = 0;
+
+  /* Play some tones */
+  SoundPlay( z_MelodyFinished, 5 );
+
+  e_State = STATE_FINISHED;
+}
+
+/* Draw the selected history record */
+static void StateDisplayHistory( void )
+{
+  HistoryRecordType z_Record;
+
+  DispClear();
+
+  if( !HistoryRead( u_HistoryIndex, &z_Record ) )
+  {
+    DispPuts_P( "History:\nEmpty" );
+    return;
+  }
+
+  /* Record number, cells and type, current */
+  StateDisplayNumber( u_HistoryIndex + 1, 2, 0, '0' );
+  DispPutc( ' ' );
+  DispPutc( ( z_Record.u_Cells & 0xF ) + 48 );
+  DispPutc( ( z_Record.u_Cells >> 4 ) == CELL_TYPE_LIPO ? 'L' : 'N' );
+  DispPuts_P( "  " );
+
+  if( z_Record.u_Mode == MODE_CONSTANT_POWER )
+  {
+    StateDisplayTenths( z_Record.w_DischargeCurrent );
+    DispPuts_P( "W\n" );
+  }
+  else
+  if( z_Record.u_Mode == MODE_CONSTANT_RESISTANCE )
+  {
+    StateDisplayTenths( z_Record.w_DischargeCurrent );
+    DispPuts_P( "Ohm\n" );
+  }
+  else
+  {
+    StateDisplayNumber( z_Record.w_DischargeCurrent, 4, 0, ' ' );
+    DispPuts_P( "mA\n" );
+  }
+
+  if( u_HistoryPage == 0 )
+  {
+    /* Capacity and energy */
+    StateDisplayNumber( z_Record.w_Capacity, 4, 0, ' ' );
+    DispPuts_P( "mAh  " );
+    StateDisplayEnergy( z_Record.w_Energy );
+  }
+  else
+  if( u_HistoryPage == 1 )
+  {
+    /* Duration and end voltage */
+    StateDispTime( z_Record.u_Hours, z_Record.u_Minutes, z_Record.u_Seconds, PSTR(":") );
+    DispPutc( ' ' );
+    StateDisplayNumber( z_Record.w_EndVoltage, 5, 2, ' ' );
+    DispPutc( 'V' );
+  }
+  else
+  {
+    /* Averages, from the whole mAh and 10mWh logged */
+    StateDisplayAverages( z_Record.w_Energy * 36000UL, z_Record.w_Capacity * 3600UL, 
+                          z_Record.u_Hours, z_Record.u_Minutes, z_Record.u_Seconds );
+  }
+}
+
+/* Save the running session */
+static void StateCheckpoint( void )
 {
+  CheckpointRecordType z_Checkpoint;
+
+  z_Checkpoint.w_CapacityDischarged = z_Status.w_CapacityDischarged;
+  z_Checkpoint.w_CapacityRemainder = z_Status.w_CapacityRemainder;
+  z_Checkpoint.w_CapacityFraction = z_Status.w_CapacityFraction;
+  z_Checkpoint.w_EnergyDischarged = z_Status.w_EnergyDischarged;
+  z_Checkpoint.q_EnergyRemainder = z_Status.q_EnergyRemainder;
+  z_Checkpoint.u_Hours = z_Status.u_Hours;
+  z_Checkpoint.u_Minutes = z_Status.u_Minutes;
+  z_Checkpoint.u_Seconds = z_Status.u_Seconds;
+  z_Checkpoint.w_Duty = IRBusy() ? w_IRDuty : LoadGetDuty();
+  CheckpointSave( &z_Checkpoint );
+}
+
+/* Handle transition to load calibration state */
+static void StateEnterCalibrate( void )
+{
+  DispClear();
+  DispPuts_P("Calibrate:\nInsert Battery");
+
+  LoadPowerOn();
+  SampleStart( FALSE );
+  u_CalibRunning = FALSE;
+  e_State = STATE_CALIBRATE;
+}
+
+/* Process one ISR event */
+void StateProcessFlags( uint8 u_Flags, uint16 w_Timestamp )
+{
+  Ina219SampleType z_Sample;
+  uint8 u_NewSample;
+
+  /* Conversions are read and integrated as they complete, independent of 
+   * the 1Hz user interface update below */
+  u_NewSample = SampleProcess( u_Flags, w_Timestamp );
+  SampleGetLatest( &z_Sample );
+
+  /* Stream every conversion */
+  if( u_NewSample )
+  {
+    TelemetrySendSample( &z_Sample, e_State );
+  }
+
+  /* And how busy the firmware is, once a second */
+  if( u_Flags & C_ISR_FLAG_1HZ_TICK )
+  {
+    TelemetrySendStatus( e_State );
+  }
+
   switch ( e_State )
   {
     case STATE_INIT:
@@ -258,6 +689,30 @@ void StateProcessFlags( uint8 u_Flags )
         z_Config.u_NumCells = MIN_CELLS_LIPO;
         z_Config.e_DischargeCurrent = DISCHARGE_CURRENT_50MA;
 	      z_Config.w_DischargeCurrentCustom = 0;
+        z_Config.w_Power = C_CONFIG_DEFAULT_POWER;
+        z_Config.w_Resistance = C_CONFIG_DEFAULT_RESISTANCE;
+        z_Config.w_TaperEnd = C_CONFIG_DEFAULT_TAPER_END;
+        z_Config.u_Profile = 0;
+      }
+
+      /* Without a calibration table the nominal feed-forward is used */
+      CalibReadEEPROM();
+
+      /* Offer to pick up a discharge that was cut short by a reset */
+      {
+        CheckpointRecordType z_Checkpoint;
+
+        if( CheckpointRead( &z_Checkpoint ) )
+        {
+          DispClear();
+          DispPuts_P( "Resume " );
+          StateDisplayNumber( z_Checkpoint.w_CapacityDischarged, 4, 0, ' ' );
+          DispPuts_P( "mAh\n" );
+          u_Resume = TRUE;
+          DispPutsTable_p( p_ResumeStrings, u_Resume );
+          e_State = STATE_RESUME;
+          break;
+        }
       }
 	 
       StateEnterConfig();
@@ -268,12 +723,38 @@ void StateProcessFlags( uint8 u_Flags )
     case STATE_CONFIG_SET_MODE:
     {
       /* Mode Config */
+      if( ( u_Flags & C_ISR_FLAG_SHORT_BUTTON_PRESS ) && 
+          ( z_Config.e_Mode == MODE_CALIBRATE ) )
+      {
+        StateEnterCalibrate();
+      }
+      else
+      if( ( u_Flags & C_ISR_FLAG_SHORT_BUTTON_PRESS ) && 
+          ( z_Config.e_Mode == MODE_HISTORY ) )
+      {
+        /* Browse discharge history */
+        u_HistoryIndex = 0;
+        u_HistoryPage = 0;
+        StateDisplayHistory();
+        e_State = STATE_HISTORY;
+      }
+      else
+      if( ( u_Flags & C_ISR_FLAG_SHORT_BUTTON_PRESS ) && 
+          ( z_Config.e_Mode == MODE_PROFILE ) )
+      {
+        /* Go to profile config state */
+        DispClear();
+        DispPuts_P("Profile:\n");
+        DispPutsTable_p( p_ProfileStrings, z_Config.u_Profile );
+        e_State = STATE_CONFIG_SET_PROFILE;
+      }
+      else
       if( u_Flags & C_ISR_FLAG_SHORT_BUTTON_PRESS )
       {
         /* Go to cell type config state */
-        lcd_clrscr();
-        lcd_puts("Type:\n");
-        lcd_puts( p_CellTypeStrings[z_Config.e_CellType] );
+        DispClear();
+        DispPuts_P("Type:\n");
+        DispPutsTable_p( p_CellTypeStrings, z_Config.e_CellType );
         e_State = STATE_CONFIG_SET_TYPE;
       }
       else
@@ -282,19 +763,46 @@ void StateProcessFlags( uint8 u_Flags )
       break;
     }
 
+    case STATE_CONFIG_SET_PROFILE:
+    {
+      /* Profile config. The user profile must have been programmed */
+      if( u_Flags & C_ISR_FLAG_SHORT_BUTTON_PRESS )
+      {
+        if( ProfileLoad( z_Config.u_Profile ) )
+        {
+          /* Go to cell type config state */
+          DispClear();
+          DispPuts_P("Type:\n");
+          DispPutsTable_p( p_CellTypeStrings, z_Config.e_CellType );
+          e_State = STATE_CONFIG_SET_TYPE;
+        }
+        else
+        {
+          DispGotoXY(0,1);
+          DispPuts_P("Not Programmed  ");
+        }
+      }
+      else
+        ConfigParameter( u_Flags, &z_Config.u_Profile, 0, C_PROFILE_USER, p_ProfileStrings );
+
+      break;
+    }
+
     case STATE_CONFIG_SET_TYPE:
     {
       /* Cell type config */
       if( u_Flags & C_ISR_FLAG_SHORT_BUTTON_PRESS )
       {
-        /* Go to num cells config state */
-        lcd_clrscr();
-        lcd_puts("Num Cells:\n");
-        lcd_putc( z_Config.u_NumCells + 48 );
-
-        if( z_Config.e_CellType == CELL_TYPE_NIMH )
+        /* Go to num cells config state. A count left over from a smaller
+         * LiPo pack is raised to the NIMH minimum before it is shown */
+        if( ( z_Config.e_CellType == CELL_TYPE_NIMH ) && 
+            ( z_Config.u_NumCells < MIN_CELLS_NIMH ) )
           z_Config.u_NumCells = MIN_CELLS_NIMH;
 
+        DispClear();
+        DispPuts_P("Num Cells:\n");
+        DispPutc( z_Config.u_NumCells + 48 );
+
         e_State = STATE_CONFIG_SET_NUM_CELLS;
       }
       else
@@ -306,12 +814,34 @@ void StateProcessFlags( uint8 u_Flags )
     case STATE_CONFIG_SET_NUM_CELLS:
     {
       /* Num cells config */
+      if( ( u_Flags & C_ISR_FLAG_SHORT_BUTTON_PRESS ) && 
+          ( z_Config.e_Mode == MODE_CONSTANT_POWER ) )
+      {
+        /* Go to set power state */
+        DispClear();
+        DispPuts_P("Power:\n");
+        StateDisplayTenths( z_Config.w_Power );
+        DispPuts_P(" W");
+        e_State = STATE_CONFIG_SET_POWER;
+      }
+      else
+      if( ( u_Flags & C_ISR_FLAG_SHORT_BUTTON_PRESS ) && 
+          ( z_Config.e_Mode == MODE_CONSTANT_RESISTANCE ) )
+      {
+        /* Go to set resistance state */
+        DispClear();
+        DispPuts_P("Resistance:\n");
+        StateDisplayTenths( z_Config.w_Resistance );
+        DispPuts_P(" Ohm");
+        e_State = STATE_CONFIG_SET_RESISTANCE;
+      }
+      else
       if( u_Flags & C_ISR_FLAG_SHORT_BUTTON_PRESS )
       {
         /* Go to set current state */
-        lcd_clrscr();
-        lcd_puts("Current:\n");
-        lcd_puts( p_DischargeCurrentStrings[ z_Config.e_DischargeCurrent ] );
+        DispClear();
+        DispPuts_P("Current:\n");
+        DispPutsTable_p( p_DischargeCurrentStrings, z_Config.e_DischargeCurrent );
         e_State = STATE_CONFIG_SET_CURRENT;
       }
       else
@@ -337,14 +867,14 @@ void StateProcessFlags( uint8 u_Flags )
         if( z_Config.e_DischargeCurrent == DISCHARGE_CURRENT_CUSTOM )
         {
           /* Go to custom current config state */
-          lcd_clrscr();
-          lcd_puts("Current:\n");
+          DispClear();
+          DispPuts_P("Current:\n");
           StateDisplayNumber( z_Config.w_DischargeCurrentCustom, 4, 0, ' ');
-          lcd_puts(" mA");
+          DispPuts_P(" mA");
           e_State = STATE_CONFIG_SET_CURRENT_CUSTOM;
         }
         else
-          e_State = STATE_WAIT_BATTERY;
+          StateEnterCurrentSelected();
       }
       else
         ConfigParameter( u_Flags, &z_Config.e_DischargeCurrent, 0, 
@@ -361,7 +891,7 @@ void StateProcessFlags( uint8 u_Flags )
         if( z_Config.w_DischargeCurrentCustom < CUSTOM_CURRENT_MAX )
         {
           z_Config.w_DischargeCurrentCustom += CUSTOM_CURRENT_INCREMENT;
-          lcd_gotoxy(0,1);
+          DispGotoXY(0,1);
           StateDisplayNumber( z_Config.w_DischargeCurrentCustom, 4, 0, ' ' );
         }
       }
@@ -371,14 +901,107 @@ void StateProcessFlags( uint8 u_Flags )
         if( z_Config.w_DischargeCurrentCustom > 0 )        
         {
           z_Config.w_DischargeCurrentCustom -= CUSTOM_CURRENT_INCREMENT;
-          lcd_gotoxy(0,1);
+          DispGotoXY(0,1);
           StateDisplayNumber( z_Config.w_DischargeCurrentCustom, 4, 0, ' ' );
         } 
       }
 
       if( u_Flags & C_ISR_FLAG_SHORT_BUTTON_PRESS )
       {
-        e_State = STATE_WAIT_BATTERY;
+        StateEnterCurrentSelected();
+      }
+
+      break;
+    }
+
+    case STATE_CONFIG_SET_POWER:
+    { 
+      /* Constant power config */
+      if( u_Flags & C_ISR_FLAG_ENCODER_CW )
+      {
+        if( z_Config.w_Power < POWER_MAX )
+        {
+          z_Config.w_Power += POWER_INCREMENT;
+          DispGotoXY(0,1);
+          StateDisplayTenths( z_Config.w_Power );
+        }
+      }
+
+      if( u_Flags & C_ISR_FLAG_ENCODER_CCW )
+      {
+        if( z_Config.w_Power > POWER_MIN )
+        {
+          z_Config.w_Power -= POWER_INCREMENT;
+          DispGotoXY(0,1);
+          StateDisplayTenths( z_Config.w_Power );
+        } 
+      }
+
+      if( u_Flags & C_ISR_FLAG_SHORT_BUTTON_PRESS )
+      {
+        StateEnterWaitBattery();
+      }
+
+      break;
+    }
+
+    case STATE_CONFIG_SET_RESISTANCE:
+    { 
+      /* Constant resistance config */
+      if( u_Flags & C_ISR_FLAG_ENCODER_CW )
+      {
+        if( z_Config.w_Resistance < RESISTANCE_MAX )
+        {
+          z_Config.w_Resistance += RESISTANCE_INCREMENT;
+          DispGotoXY(0,1);
+          StateDisplayTenths( z_Config.w_Resistance );
+        }
+      }
+
+      if( u_Flags & C_ISR_FLAG_ENCODER_CCW )
+      {
+        if( z_Config.w_Resistance > RESISTANCE_MIN )
+        {
+          z_Config.w_Resistance -= RESISTANCE_INCREMENT;
+          DispGotoXY(0,1);
+          StateDisplayTenths( z_Config.w_Resistance );
+        } 
+      }
+
+      if( u_Flags & C_ISR_FLAG_SHORT_BUTTON_PRESS )
+      {
+        StateEnterWaitBattery();
+      }
+
+      break;
+    }
+
+    case STATE_CONFIG_SET_TAPER_END:
+    { 
+      /* Storage mode constant voltage end current config */
+      if( u_Flags & C_ISR_FLAG_ENCODER_CW )
+      {
+        if( z_Config.w_TaperEnd < TAPER_END_MAX )
+        {
+          z_Config.w_TaperEnd += TAPER_END_INCREMENT;
+          DispGotoXY(0,1);
+          StateDisplayNumber( z_Config.w_TaperEnd, 4, 0, ' ' );
+        }
+      }
+
+      if( u_Flags & C_ISR_FLAG_ENCODER_CCW )
+      {
+        if( z_Config.w_TaperEnd > TAPER_END_MIN )
+        {
+          z_Config.w_TaperEnd -= TAPER_END_INCREMENT;
+          DispGotoXY(0,1);
+          StateDisplayNumber( z_Config.w_TaperEnd, 4, 0, ' ' );
+        } 
+      }
+
+      if( u_Flags & C_ISR_FLAG_SHORT_BUTTON_PRESS )
+      {
+        StateEnterWaitBattery();
       }
 
       break;
@@ -389,27 +1012,25 @@ void StateProcessFlags( uint8 u_Flags )
       /* Wait for battery to be connected */
       if( u_Flags & C_ISR_FLAG_1HZ_TICK )
       {
-        uint16 w_Voltage = ina219_read_voltage();
-
         if( z_Config.e_CellType == CELL_TYPE_LIPO )
         {
-          if( w_Voltage > z_Config.u_NumCells * CELL_CUTOFF_LIPO_FULL_DISCHARGE )
+          if( z_Sample.w_Voltage > z_Config.u_NumCells * CELL_CUTOFF_LIPO_FULL_DISCHARGE )
           {
-            StateEnterDischarge();
+            StateEnterBatteryFound();
             break;
           }
         }
         else
         {
-          if( w_Voltage > z_Config.u_NumCells * CELL_CUTOFF_NIMH_FULL_DISCHARGE )
+          if( z_Sample.w_Voltage > z_Config.u_NumCells * CELL_CUTOFF_NIMH_FULL_DISCHARGE )
           {
-            StateEnterDischarge();
+            StateEnterBatteryFound();
             break;
           }
         }
 
-        lcd_clrscr();
-        lcd_puts("Insert Battery");
+        DispClear();
+        DispPuts_P("Insert Battery");
       }
 
       break;
@@ -417,46 +1038,125 @@ void StateProcessFlags( uint8 u_Flags )
 
     case STATE_DISCHARGE:
     {
+      /* Current regulator runs on every conversion. In the constant power
+       * and resistance modes the setpoint follows the battery voltage, in 
+       * the constant voltage phase it tapers to hold the voltage */
+      if( z_Config.e_Mode == MODE_WAVE )
+      {
+        /* The Timer1 interrupt steps the load through the waveform. Each
+         * step reseeds the regulator, which trims the current until the 
+         * next one. Telemetry carries the voltage of every conversion */
+        if( WaveService() )
+          ControlStart( WaveGetSetpoint(), LoadGetDuty() );
+
+        if( u_NewSample )
+        {
+          WaveSetDuty( ControlUpdate( z_Sample.w_RawCurrent ) );
+
+          if( z_Sample.w_Voltage < w_WaveMinVoltage )
+          {
+            w_WaveMinVoltage = z_Sample.w_Voltage;
+            w_WaveSagCurrent = z_Sample.w_Current;
+          }
+        }
+      }
+      else
+      if( u_NewSample && IRBusy() )
+      {
+        /* Regulator is held off while the pulse steps the load. Afterwards 
+         * it carries on from the duty it had before */
+        IRStatusEnumType e_Status = IRProcess( &z_Sample );
+
+        if( e_Status != IR_RUNNING )
+        {
+          if( ( e_Status == IR_DONE ) && 
+              IRCurveAdd( z_Status.w_CapacityDischarged, IRGetResult() ) )
+          {
+            w_IRInterval *= 2;
+          }
+
+          ControlStart( z_Status.w_DischargeCurrent * 10, w_IRDuty );
+          LoadSetDuty( w_IRDuty );
+        }
+      }
+      else
+      if( u_NewSample && ( z_Config.e_Mode == MODE_PROFILE ) )
+      {
+        /* Step ends are checked on every conversion. A new step reseeds 
+         * the regulator from the feed-forward table */
+        ProfileStatusEnumType e_Status = ProfileProcess( &z_Sample );
+        uint16 w_Setpoint;
+
+        if( e_Status == PROFILE_DONE )
+        {
+          StateEnterFinished();
+          break;
+        }
+
+        w_Setpoint = ProfileSetpoint( z_Sample.w_Voltage );
+
+        if( e_Status == PROFILE_NEXT_STEP )
+        {
+          ControlStart( w_Setpoint, CalibFeedForward( w_Setpoint / 10 ) );
+          StateDisplayDischargeLine();
+        }
+        else
+          ControlSetSetpoint( w_Setpoint );
+
+        if( ProfileGetStepType() == PROFILE_STEP_REST )
+          LoadSetDuty( 0 );
+        else
+          LoadSetDutyFine( ControlUpdate( z_Sample.w_RawCurrent ) );
+      }
+      else
+      if( u_NewSample )
+      {
+        if( u_Taper )
+        {
+          ControlSetSetpoint( ControlTaperUpdate( z_Sample.w_Voltage ) );
+        }
+        else
+        if( ( z_Config.e_Mode == MODE_CONSTANT_POWER ) || 
+            ( z_Config.e_Mode == MODE_CONSTANT_RESISTANCE ) )
+        {
+          ControlSetSetpoint( StateLoadSetpoint( z_Sample.w_Voltage ) );
+        }
+
+        LoadSetDutyFine( ControlUpdate( z_Sample.w_RawCurrent ) );
+      }
+
       if( u_Flags & C_ISR_FLAG_1HZ_TICK )
-       {
-        uint16 w_ADCCurrent;
+      {
         uint16 w_ADCBattery;
+        uint8 u_Done = FALSE;
 
-        /* Read load current and battery voltage */
-        w_ADCCurrent = ina219_read_current();         /* mA */
-        w_ADCBattery = ina219_read_voltage();         /* mV */
+        /* Latest battery voltage */
+        w_ADCBattery = z_Sample.w_Voltage;            /* mV */
 
         /* Toggle LED */
-        PORTC ^= _BV(PORTC3);
+        C_BOARD_LED_PORT ^= _BV(C_BOARD_LED_BIT);
         
-        /* Update mAh accumulator ( in mA seconds ) */
-        z_Status.q_CapacityDischarged += w_ADCCurrent;
+        DispGotoXY(0,0);
 
-        /* Adjust PWM to match specified load current */
-        if( w_ADCCurrent > z_Status.w_DischargeCurrent )
-        { 
-          if( OCR1B != 0 )
-          {
-            OCR1B--;
-          }
+        if( u_Taper )
+        {
+          /* V(mv), tapering current */
+          DispPuts_P( "CV " );
+          StateDisplayNumber( w_ADCBattery, 5, 2, ' ' );
+          DispPuts_P( "V " );
+          StateDisplayNumber( z_Sample.w_Current, 4, 0, ' ' );
+          DispPuts_P( "mA\n" );
         }
         else
-        if( w_ADCCurrent < z_Status.w_DischargeCurrent )
         {
-          if( OCR1B != 0xFFFF )
-          {
-            OCR1B++;
-          }
-        } 
-
-        /* V(mv) */
-        lcd_gotoxy(0,0);
-        StateDisplayNumber( w_ADCBattery, 5, 2, ' ' );
-        lcd_puts( "V  " );
+          /* V(mv) */
+          StateDisplayNumber( w_ADCBattery, 5, 2, ' ' );
+          DispPuts_P( "V  " );
 
-        /* mAh */
-        StateDisplayNumber( z_Status.q_CapacityDischarged / 3600, 4, 0, ' ' );
-        lcd_puts( " mAh\n" );
+          /* mAh */
+          StateDisplayNumber( z_Status.w_CapacityDischarged, 4, 0, ' ' );
+          DispPuts_P( " mAh\n" );
+        }
 
         /* Time Elapsed */
         if( ++z_Status.u_Seconds == 60 )
@@ -471,18 +1171,77 @@ void StateProcessFlags( uint8 u_Flags )
           z_Status.u_Hours++;
         }
 
-        lcd_puts( "  " );
-        StateDispTime( z_Status.u_Hours, z_Status.u_Minutes, z_Status.u_Seconds );
+        StateDisplayDischargeLine();
 
-        /* Stop discharge if cutoff voltage has been reached */
-        if( w_ADCBattery < z_Status.w_CutoffVoltage )
+        /* Stop discharge if cutoff voltage has been reached. Storage mode 
+         * holds the voltage there instead, so the pack does not rebound 
+         * above it, and stops once the current has tapered off. The 
+         * voltage sags during a resistance pulse, so it is not checked then */
+        if( u_Taper )
         {
-          e_State = STATE_FINISHED;
+          if( z_Sample.w_Current < z_Config.w_TaperEnd )
+          {
+            if( ++u_TaperEndSeconds == TAPER_END_SECONDS )
+              u_Done = TRUE;
+          }
+          else
+            u_TaperEndSeconds = 0;
+        }
+        else
+        if( ( w_ADCBattery < z_Status.w_CutoffVoltage ) && !IRBusy() && 
+            ( z_Config.e_Mode != MODE_PROFILE ) )
+        {
+          if( z_Config.e_Mode == MODE_STORAGE )
+          {
+            u_Taper = TRUE;
+            u_TaperEndSeconds = 0;
+            ControlTaperStart( z_Status.w_CutoffVoltage, z_Status.w_DischargeCurrent * 10 );
+          }
+          else
+            u_Done = TRUE;
+        }
+
+        if( u_Done )
+        {
+          StateEnterFinished();
+        }
+        else
+        if( ( z_Config.e_Mode != MODE_PROFILE ) && 
+            ( ++u_CheckpointSeconds == C_CHECKPOINT_INTERVAL ) )
+        {
+          u_CheckpointSeconds = 0;
+          StateCheckpoint();
+        }
+
+        /* Measure internal resistance every so often in the constant 
+         * current modes, building up resistance against capacity */
+        if( ( e_State == STATE_DISCHARGE ) && !u_Taper && !IRBusy() &&
+            ( ( z_Config.e_Mode == MODE_FULL_DISCHARGE ) || 
+              ( z_Config.e_Mode == MODE_STORAGE ) ) &&
+            ( ++w_IRSeconds >= w_IRInterval ) )
+        {
+          w_IRSeconds = 0;
+          w_IRDuty = LoadGetDuty();
+          IRStart( z_Status.w_DischargeCurrent, 1 );
         }
       }
 
+      /* Encoder steps through time, averages and, once measured, internal 
+       * resistance */
+      if( u_Flags & ( C_ISR_FLAG_ENCODER_CW | C_ISR_FLAG_ENCODER_CCW ) )
+      {
+        if( ++u_DischargePage == 
+            ( ( IRCurveCount() || ( z_Config.e_Mode == MODE_PROFILE ) || 
+                ( z_Config.e_Mode == MODE_WAVE ) ) ? 3 : 2 ) )
+          u_DischargePage = 0;
+
+        StateDisplayDischargeLine();
+      }
+
       if( u_Flags & C_ISR_FLAG_LONG_BUTTON_PRESS )
       {
+        /* Aborted by the user, so not resumable */
+        CheckpointClear();
         StateEnterConfig();
       }
 
@@ -491,40 +1250,237 @@ void StateProcessFlags( uint8 u_Flags )
 
     case STATE_FINISHED:
     {
-      uint8 u_Cnt = 0;
+      /* Give the load time to discharge before removing OpAmp power */
+      if( u_Flags & C_ISR_FLAG_1HZ_TICK )
+      {
+        LoadPowerOff();
+      }
+
+      /* Encoder steps the second line through time, averages and the 
+       * internal resistance curve */
+      if( u_Flags & ( C_ISR_FLAG_ENCODER_CW | C_ISR_FLAG_ENCODER_CCW ) )
+      {
+        if( ++u_DischargePage == 2 + IRCurveCount() )
+          u_DischargePage = 0;
+
+        DispGotoXY(0,1);
+
+        if( u_DischargePage == 0 )
+        {
+          DispPuts_P( "  " );
+          StateDispTime( z_Status.u_Hours, z_Status.u_Minutes, z_Status.u_Seconds, PSTR(" : ") );
+          DispPuts_P( "  " );
+        }
+        else
+        if( u_DischargePage == 1 )
+          StateDisplayStatusAverages();
+        else
+        {
+          uint16 w_Capacity;
+          uint16 w_Resistance;
+
+          IRCurveGet( u_DischargePage - 2, &w_Capacity, &w_Resistance );
+          StateDisplayNumber( w_Capacity, 4, 0, ' ' );
+          DispPuts_P( "mAh  " );
+          StateDisplayResistance( w_Resistance );
+          DispPuts_P( "m\xF4" );
+        }
+      }
+
+      if( u_Flags & C_ISR_FLAG_LONG_BUTTON_PRESS )
+      {
+        SoundStop();
+        StateEnterConfig();
+      }
+
+      break;
+    }
+
+    case STATE_IR_TEST:
+    {
+      /* Load is stepped from every conversion */
+      if( u_NewSample )
+      {
+        IRStatusEnumType e_Status = IRProcess( &z_Sample );
 
-      /* Disable Interrupts */
-      cli();
+        if( e_Status != IR_RUNNING )
+        {
+          LoadSetDuty( 0 );
+          DispClear();
 
-      /* Turn off load */
-      OCR1B = 0;
-      _delay_ms(500);
-      StateOpAmpPowerOff();
+          if( e_Status == IR_DONE )
+          {
+            /* Pack, and per cell average */
+            DispPuts_P( "Pack " );
+            StateDisplayResistance( IRGetResult() );
+            DispPuts_P( " m\xF4\nCell " );
+            StateDisplayResistance( IRGetResult() / z_Config.u_NumCells );
+            DispPuts_P( " m\xF4" );
+            SoundPlay( z_MelodyFinished, 1 );
+          }
+          else
+            DispPuts_P( "IR Test Failed" );
 
-      /* Turn off LED */
-      PORTC &= ~_BV(PORTC3);
+          e_State = STATE_IR_FINISHED;
+        }
+      }
 
-      /* Display time elapsed and mAh discharged */
-      lcd_clrscr();
+      if( u_Flags & C_ISR_FLAG_LONG_BUTTON_PRESS )
+        StateEnterConfig();
 
-      /* mAh */
-      StateDisplayNumber( z_Status.q_CapacityDischarged / 3600, 4, 0, ' ' );
-      lcd_puts( " mAh Disch\n" );
+      break;
+    }
 
-      /* Time */
-      lcd_gotoxy(0,1);
-      lcd_puts( "  " );
-      StateDispTime( z_Status.u_Hours, z_Status.u_Minutes, z_Status.u_Seconds );
+    case STATE_IR_FINISHED:
+    {
+      /* Give the load time to discharge before removing OpAmp power */
+      if( u_Flags & C_ISR_FLAG_1HZ_TICK )
+      {
+        LoadPowerOff();
+      }
 
-      /* Play some tones */
-      for( u_Cnt = 0; u_Cnt < 5; u_Cnt++ )
+      if( u_Flags & C_ISR_FLAG_LONG_BUTTON_PRESS )
       {
-        playNote( 3033, 100 );
-        playNote( 2551, 100 );
-        playNote( 1911, 100 );
+        SoundStop();
+        StateEnterConfig();
+      }
 
-        _delay_ms(1500);
+      break;
+    }
+
+    case STATE_CALIBRATE:
+    {
+      if( !u_CalibRunning )
+      {
+        /* Sweep needs a source to draw current from */
+        if( ( u_Flags & C_ISR_FLAG_1HZ_TICK ) && 
+            ( z_Sample.w_Voltage > CALIBRATE_MIN_VOLTAGE ) )
+        {
+          DispClear();
+          DispPuts_P("Calibrating...\n");
+          CalibStart();
+          u_CalibRunning = TRUE;
+        }
       }
+      else
+      if( u_NewSample )
+      {
+        switch( CalibProcess( z_Sample.w_RawCurrent ) )
+        {
+          case CALIB_DONE:
+          {
+            LoadPowerOff();
+            DispClear();
+            DispPuts_P("Calibrate:\nDone");
+            e_State = STATE_CALIBRATE_FINISHED;
+            break;
+          }
+
+          case CALIB_FAILED:
+          {
+            LoadPowerOff();
+            DispClear();
+            DispPuts_P("Calibrate:\nFailed");
+            e_State = STATE_CALIBRATE_FINISHED;
+            break;
+          }
+
+          default:
+          {
+            break;
+          }
+        }
+      }
+
+      if( u_CalibRunning && ( e_State == STATE_CALIBRATE ) && 
+          ( u_Flags & C_ISR_FLAG_1HZ_TICK ) )
+      {
+        /* Progress */
+        DispGotoXY(0,1);
+        StateDisplayNumber( CalibGetStep() + 1, 2, 0, ' ' );
+        DispPuts_P( " / " );
+        StateDisplayNumber( C_CALIB_POINTS, 2, 0, ' ' );
+      }
+
+      if( u_Flags & C_ISR_FLAG_LONG_BUTTON_PRESS )
+      {
+        LoadPowerOff();
+        StateEnterConfig();
+      }
+
+      break;
+    }
+
+    case STATE_CALIBRATE_FINISHED:
+    {
+      if( u_Flags & ( C_ISR_FLAG_SHORT_BUTTON_PRESS | C_ISR_FLAG_LONG_BUTTON_PRESS ) )
+      {
+        StateEnterConfig();
+      }
+
+      break;
+    }
+
+    case STATE_HISTORY:
+    {
+      /* Encoder selects record, short press flips page, long press exits */
+      if( u_Flags & C_ISR_FLAG_LONG_BUTTON_PRESS )
+      {
+        StateEnterConfig();
+        break;
+      }
+
+      if( u_Flags & C_ISR_FLAG_ENCODER_CW )
+      {
+        if( u_HistoryIndex + 1 < HistoryCount() )
+          u_HistoryIndex++;
+      }
+
+      if( u_Flags & C_ISR_FLAG_ENCODER_CCW )
+      {
+        if( u_HistoryIndex > 0 )
+          u_HistoryIndex--;
+      }
+
+      if( u_Flags & C_ISR_FLAG_SHORT_BUTTON_PRESS )
+      {
+        if( ++u_HistoryPage == 3 )
+          u_HistoryPage = 0;
+      }
+
+      if( u_Flags & ( C_ISR_FLAG_ENCODER_CW | C_ISR_FLAG_ENCODER_CCW | 
+                      C_ISR_FLAG_SHORT_BUTTON_PRESS ) )
+      {
+        StateDisplayHistory();
+      }
+
+      break;
+    }
+
+    case STATE_RESUME:
+    {
+      /* Resume the interrupted session or discard it */
+      if( u_Flags & C_ISR_FLAG_SHORT_BUTTON_PRESS )
+      {
+        CheckpointRecordType z_Checkpoint;
+
+        if( u_Resume && CheckpointRead( &z_Checkpoint ) )
+        {
+          /* Discharge is entered as usual once the battery is back. The 
+           * session's settings were loaded from the config record at init */
+          DispClear();
+          StateEnterWaitBattery();
+        }
+        else
+        {
+          u_Resume = FALSE;
+          CheckpointClear();
+          StateEnterConfig();
+        }
+      }
+      else
+        ConfigParameter( u_Flags, &u_Resume, FALSE, TRUE, p_ResumeStrings );
+
       break;
     }
 
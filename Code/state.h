@@ -22,6 +22,10 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "types.h"
 
-void StateProcessFlags( uint8 u_Flags );
+/* Process one ISR event
+ *   u_Flags - ISR flags
+ *   w_Timestamp - ISRGetMillis() when the event was posted
+ */
+void StateProcessFlags( uint8 u_Flags, uint16 w_Timestamp );
 
 #endif
@@ -0,0 +1,200 @@
+/* 
+telemetry.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <util/crc16.h>
+#include "types.h"
+#include "load.h"
+#include "ina219.h"
+#include "sample.h"
+#include "isr.h"
+#include "twi.h"
+#include "telemetry.h"
+
+#define BAUD_RATE 9600
+#define C_TELEMETRY_RING_SIZE 64 /* Must be a power of 2 */
+
+/* A 16 byte sample frame takes 16.7ms at 9600 baud, so sending every 
+ * averaged conversion ( 17ms ) would fill the link and every fast one would
+ * overrun it. One sample per 30ms keeps the link under 60% busy */
+#define C_TELEMETRY_SAMPLE_MS 30
+
+/* Record, CRC, COBS overhead byte and delimiter */
+#define C_TELEMETRY_FRAME_MAX( size ) ( (size) + 2 + 1 + 1 )
+
+static uint8 a_TxRing[C_TELEMETRY_RING_SIZE];
+static volatile uint8 u_TxHead = 0; /* Written by main loop only */
+static volatile uint8 u_TxTail = 0; /* Written by USART_UDRE_vect only */
+static uint16 w_DropCount = 0;
+static uint16 w_LastSampleMs = 0;
+
+/* Initialize USART for transmit */
+void TelemetryInit( void )
+{
+  /* Double speed mode keeps 9600 baud within 0.2% at 1MHz */
+  UCSR0A = _BV(U2X0);
+  UBRR0 = ( F_CPU / ( 8UL * BAUD_RATE ) ) - 1;
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00); // 8N1
+  UCSR0B = _BV(TXEN0);
+}
+
+/* CRC, COBS encode and queue one record. a_Payload holds the record with 
+ * two spare bytes after it for the CRC */
+static void TelemetrySendFrame( uint8 *a_Payload, uint8 u_Size )
+{
+  uint16 w_Crc = 0xFFFF;
+  uint8 u_Index;
+  uint8 u_Head;
+  uint8 u_CodeIndex;
+  uint8 u_Code;
+
+  /* Whole frame must fit or nothing is sent */
+  if( (uint8)( C_TELEMETRY_RING_SIZE - ( u_TxHead - u_TxTail ) ) < C_TELEMETRY_FRAME_MAX( u_Size ) )
+  {
+    w_DropCount++;
+    return;
+  }
+
+  for( u_Index = 0; u_Index < u_Size; u_Index++ )
+  {
+    w_Crc = _crc_ccitt_update( w_Crc, a_Payload[u_Index] );
+  }
+
+  a_Payload[u_Size] = w_Crc & 0xFF;
+  a_Payload[u_Size + 1] = w_Crc >> 8;
+
+  /* COBS encode straight into the ring. Each code byte holds the distance 
+   * to the next zero, and is filled in once that distance is known */
+  u_Head = u_TxHead;
+  u_CodeIndex = u_Head++;
+  u_Code = 1;
+
+  for( u_Index = 0; u_Index < u_Size + 2; u_Index++ )
+  {
+    if( a_Payload[u_Index] == 0 )
+    {
+      a_TxRing[u_CodeIndex & ( C_TELEMETRY_RING_SIZE - 1 )] = u_Code;
+      u_CodeIndex = u_Head++;
+      u_Code = 1;
+    }
+    else
+    {
+      a_TxRing[u_Head++ & ( C_TELEMETRY_RING_SIZE - 1 )] = a_Payload[u_Index];
+      u_Code++;
+    }
+  }
+
+  a_TxRing[u_CodeIndex & ( C_TELEMETRY_RING_SIZE - 1 )] = u_Code;
+  a_TxRing[u_Head++ & ( C_TELEMETRY_RING_SIZE - 1 )] = 0;
+
+  /* Publish frame and make sure the transmitter is draining */
+  u_TxHead = u_Head;
+  UCSR0B |= _BV(UDRIE0);
+}
+
+/* Queue one sample frame */
+void TelemetrySendSample( Ina219SampleType *p_Sample, uint8 u_State )
+{
+  uint8 a_Payload[sizeof( TelemetryRecordType ) + 2];
+  TelemetryRecordType *p_Record = (TelemetryRecordType *)a_Payload;
+
+  /* Skipped samples are not drops */
+  if( (uint16)( p_Sample->w_Timestamp - w_LastSampleMs ) < C_TELEMETRY_SAMPLE_MS )
+  {
+    return;
+  }
+
+  w_LastSampleMs = p_Sample->w_Timestamp;
+
+  p_Record->u_Kind = C_TELEMETRY_KIND_SAMPLE;
+  p_Record->w_Timestamp = p_Sample->w_Timestamp;
+  p_Record->w_RawShunt = p_Sample->w_RawShunt;
+  p_Record->w_RawBus = p_Sample->w_RawBus;
+  p_Record->w_RawCurrent = p_Sample->w_RawCurrent;
+  p_Record->w_Duty = LoadGetDuty();
+  p_Record->u_State = u_State;
+
+  TelemetrySendFrame( a_Payload, sizeof( TelemetryRecordType ) );
+}
+
+#if C_SAMPLE_SENSORS > 1
+/* Queue the latest reading of every sensor but the load's */
+static void TelemetrySendSensors( void )
+{
+  uint8 a_Payload[sizeof( TelemetrySensorsType ) + 2];
+  TelemetrySensorsType *p_Sensors = (TelemetrySensorsType *)a_Payload;
+  Ina219SampleType z_Sample;
+  uint8 u_Sensor;
+
+  p_Sensors->u_Kind = C_TELEMETRY_KIND_SENSORS;
+  p_Sensors->w_Timestamp = ISRGetMillis();
+
+  for( u_Sensor = 1; u_Sensor < C_SAMPLE_SENSORS; u_Sensor++ )
+  {
+    SampleGetSensorLatest( u_Sensor, &z_Sample );
+    p_Sensors->a_Sensor[u_Sensor - 1].w_Voltage = z_Sample.w_Voltage;
+    p_Sensors->a_Sensor[u_Sensor - 1].w_Current = z_Sample.w_Current;
+  }
+
+  TelemetrySendFrame( a_Payload, sizeof( TelemetrySensorsType ) );
+}
+#endif
+
+/* Queue one status frame */
+void TelemetrySendStatus( uint8 u_State )
+{
+  uint8 a_Payload[sizeof( TelemetryStatusType ) + 2];
+  TelemetryStatusType *p_Status = (TelemetryStatusType *)a_Payload;
+
+  p_Status->u_Kind = C_TELEMETRY_KIND_STATUS;
+  p_Status->w_Timestamp = ISRGetMillis();
+  p_Status->w_AwakeMs = ISRGetAwakeMs();
+  p_Status->w_EventOverflows = ISRGetOverflowCount();
+  p_Status->w_Drops = w_DropCount;
+  p_Status->u_TWIErrors = TWIGetErrorCount();
+  p_Status->u_State = u_State;
+
+  TelemetrySendFrame( a_Payload, sizeof( TelemetryStatusType ) );
+
+#if C_SAMPLE_SENSORS > 1
+  TelemetrySendSensors();
+#endif
+}
+
+/* Returns number of frames dropped because the TX ring was full */
+uint16 TelemetryGetDropCount( void )
+{
+  return( w_DropCount );
+}
+
+/* USART data register empty. Send next byte or go quiet */
+ISR ( USART_UDRE_vect )
+{
+  uint8 u_Tail = u_TxTail;
+
+  if( u_Tail == u_TxHead )
+  {
+    UCSR0B &= ~_BV(UDRIE0);
+    return;
+  }
+
+  UDR0 = a_TxRing[u_Tail & ( C_TELEMETRY_RING_SIZE - 1 )];
+  u_TxTail = u_Tail + 1;
+}
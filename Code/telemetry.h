@@ -0,0 +1,95 @@
+/* 
+telemetry.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "types.h"
+#include "ina219.h"
+#include "sample.h"
+
+/* Binary sample stream on the USART TX pin ( PD1 ), 9600 baud 8N1. A 
+ * conversion at most every 30ms is sent as one frame: TelemetryRecordType 
+ * followed by its CRC-CCITT ( init 0xFFFF, little endian ), COBS encoded 
+ * and terminated by a 0x00 byte. Once a second a TelemetryStatusType frame reports how busy 
+ * the firmware is, followed on boards with more than one INA219 by a 
+ * TelemetrySensorsType frame with the latest reading of the others. The
+ * first byte of a record says which it is. Frames 
+ * are dropped whole if the TX ring is full, so the caller never waits on 
+ * the UART. Tools/telemetry2csv.c decodes the stream */
+
+#define C_TELEMETRY_KIND_SAMPLE 'S'
+#define C_TELEMETRY_KIND_STATUS 'T'
+#define C_TELEMETRY_KIND_SENSORS 'X'
+
+typedef struct
+{
+  uint8  u_Kind;       /* C_TELEMETRY_KIND_SAMPLE */
+  uint16 w_Timestamp;  /* ms, wraps */
+  uint16 w_RawShunt;   /* Shunt voltage register ( 10uV ) */
+  uint16 w_RawBus;     /* Bus voltage register */
+  uint16 w_RawCurrent; /* 0.1mA */
+  uint16 w_Duty;       /* Load channel A duty, Timer1 counts */
+  uint8  u_State;      /* State machine state */
+} TelemetryRecordType;
+
+typedef struct
+{
+  uint8  u_Kind;           /* C_TELEMETRY_KIND_STATUS */
+  uint16 w_Timestamp;      /* ms, wraps */
+  uint16 w_AwakeMs;        /* Main loop awake in the last full second */
+  uint16 w_EventOverflows; /* ISR events lost since reset */
+  uint16 w_Drops;          /* Telemetry frames dropped since reset */
+  uint8  u_TWIErrors;      /* TWI transactions failed since reset, wraps */
+  uint8  u_State;          /* State machine state */
+} TelemetryStatusType;
+
+#if C_SAMPLE_SENSORS > 1
+typedef struct
+{
+  uint16 w_Voltage;    /* mV */
+  uint16 w_Current;    /* mA */
+} TelemetrySensorType;
+
+typedef struct
+{
+  uint8  u_Kind;       /* C_TELEMETRY_KIND_SENSORS */
+  uint16 w_Timestamp;  /* ms, wraps */
+  TelemetrySensorType a_Sensor[C_SAMPLE_SENSORS - 1]; /* Sensors 1 onwards */
+} TelemetrySensorsType;
+#endif
+
+/* Initialize USART for transmit */
+void TelemetryInit( void );
+
+/* Queue one sample frame, unless one went less than 30ms ago
+ *   p_Sample - Conversion to send
+ *   u_State - Current state machine state
+ */
+void TelemetrySendSample( Ina219SampleType *p_Sample, uint8 u_State );
+
+/* Queue one status frame, and the other sensors' frame if there are any
+ *   u_State - Current state machine state
+ */
+void TelemetrySendStatus( uint8 u_State );
+
+/* Returns number of frames dropped because the TX ring was full */
+uint16 TelemetryGetDropCount( void );
+
+#endif
@@ -0,0 +1,246 @@
+/* 
+twi.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+#include <compat/twi.h>
+#include "types.h"
+#include "isr.h"
+#include "twi.h"
+
+#define SCL_CLOCK         62000L
+#define C_TWI_MAX_RETRIES 10
+
+/* TWCR values used by the state machine */
+#define TWCR_START      ( _BV(TWINT) | _BV(TWEN) | _BV(TWIE) | _BV(TWSTA) )
+#define TWCR_SEND       ( _BV(TWINT) | _BV(TWEN) | _BV(TWIE) )
+#define TWCR_RECV_ACK   ( _BV(TWINT) | _BV(TWEN) | _BV(TWIE) | _BV(TWEA) )
+#define TWCR_RECV_NACK  ( _BV(TWINT) | _BV(TWEN) | _BV(TWIE) )
+#define TWCR_STOP       ( _BV(TWINT) | _BV(TWEN) | _BV(TWSTO) )
+#define TWCR_STOP_START ( _BV(TWINT) | _BV(TWEN) | _BV(TWIE) | _BV(TWSTO) | _BV(TWSTA) )
+
+typedef struct
+{
+  uint8  u_Address;
+  uint8  u_Register;
+  uint8  u_Read;
+  uint8  u_DoneFlag;
+  uint16 w_Data;
+  uint16 *p_Result;
+} TWITransactionType;
+
+static TWITransactionType z_Queue[C_TWI_QUEUE_SIZE];
+static volatile uint8 u_QueueHead = 0;  /* Transaction in flight */
+static volatile uint8 u_QueueCount = 0;
+static volatile uint8 u_ErrorCount = 0;
+
+/* State of the transaction in flight. Only touched from TWI_vect */
+static uint8 u_ByteCount;
+static uint8 u_Retries = 0;
+
+/* Initialize TWI controller */
+void TWIInit( void )
+{
+  TWSR = 0;                         /* no prescaler */
+  TWBR = ((F_CPU/SCL_CLOCK)-16)/2;  /* must be > 10 for stable operation */
+  TWCR = _BV(TWEN);
+}
+
+/* Add a transaction to the queue, starting the bus if it was idle */
+static uint8 TWIQueue( uint8 u_Address, uint8 u_Register, uint8 u_Read, 
+                       uint16 w_Data, uint16 *p_Result, uint8 u_DoneFlag )
+{
+  TWITransactionType *p_Trans;
+  uint8 u_Queued = FALSE;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if( u_QueueCount < C_TWI_QUEUE_SIZE )
+    {
+      p_Trans = &z_Queue[( u_QueueHead + u_QueueCount ) % C_TWI_QUEUE_SIZE];
+      p_Trans->u_Address = u_Address;
+      p_Trans->u_Register = u_Register;
+      p_Trans->u_Read = u_Read;
+      p_Trans->u_DoneFlag = u_DoneFlag;
+      p_Trans->w_Data = w_Data;
+      p_Trans->p_Result = p_Result;
+
+      if( u_QueueCount++ == 0 )
+      {
+        /* Bus was idle. The stop ending the last transaction may still be 
+         * going out, and a start written over it is lost, so let it finish
+         * ( one SCL period ) before kicking off this transaction */
+        loop_until_bit_is_clear( TWCR, TWSTO );
+        TWCR = TWCR_START;
+      }
+
+      u_Queued = TRUE;
+    }
+  }
+
+  return( u_Queued );
+}
+
+/* Queue a 16-bit register read */
+uint8 TWIQueueRead( uint8 u_Address, uint8 u_Register, uint16 *p_Result, 
+                    uint8 u_DoneFlag )
+{
+  return( TWIQueue( u_Address, u_Register, TRUE, 0, p_Result, u_DoneFlag ) );
+}
+
+/* Queue a 16-bit register write */
+uint8 TWIQueueWrite( uint8 u_Address, uint8 u_Register, uint16 w_Data, 
+                     uint8 u_DoneFlag )
+{
+  return( TWIQueue( u_Address, u_Register, FALSE, w_Data, NULL, u_DoneFlag ) );
+}
+
+/* Returns the number of transactions that can still be queued */
+uint8 TWIQueueFree( void )
+{
+  return( C_TWI_QUEUE_SIZE - u_QueueCount );
+}
+
+/* Returns TRUE while any transaction is queued or in flight */
+uint8 TWIBusy( void )
+{
+  return( u_QueueCount != 0 );
+}
+
+/* Returns number of transactions dropped because of bus errors */
+uint8 TWIGetErrorCount( void )
+{
+  return( u_ErrorCount );
+}
+
+/* Retire the transaction in flight and start the next one, if any */
+static void TWIFinish( TWITransactionType *p_Trans, uint8 u_Success )
+{
+  if( u_Success )
+  {
+    if( p_Trans->p_Result )
+      *p_Trans->p_Result = p_Trans->w_Data;
+  }
+  else
+  {
+    u_ErrorCount++;
+  }
+
+  /* Completion is signalled even on failure so waiters never stall */
+  ISRPostFlags( p_Trans->u_DoneFlag );
+
+  u_QueueHead = ( u_QueueHead + 1 ) % C_TWI_QUEUE_SIZE;
+  u_Retries = 0;
+
+  if( --u_QueueCount )
+    TWCR = TWCR_STOP_START;
+  else
+    TWCR = TWCR_STOP;
+}
+
+/* TWI state machine */
+ISR ( TWI_vect )
+{
+  TWITransactionType *p_Trans = &z_Queue[u_QueueHead];
+
+  switch( TW_STATUS )
+  {
+    case TW_START:
+    {
+      u_ByteCount = 0;
+      TWDR = p_Trans->u_Address | TW_WRITE;
+      TWCR = TWCR_SEND;
+      break;
+    }
+
+    case TW_REP_START:
+    {
+      TWDR = p_Trans->u_Address | TW_READ;
+      TWCR = TWCR_SEND;
+      break;
+    }
+
+    case TW_MT_SLA_ACK:
+    {
+      TWDR = p_Trans->u_Register;
+      TWCR = TWCR_SEND;
+      break;
+    }
+
+    case TW_MT_DATA_ACK:
+    {
+      if( p_Trans->u_Read )
+      {
+        /* Register pointer set. Turn the bus around for the read */
+        TWCR = TWCR_START;
+      }
+      else
+      if( u_ByteCount < 2 )
+      {
+        /* MSB first */
+        TWDR = u_ByteCount++ ? ( p_Trans->w_Data & 0xFF ) : ( p_Trans->w_Data >> 8 );
+        TWCR = TWCR_SEND;
+      }
+      else
+      {
+        TWIFinish( p_Trans, TRUE );
+      }
+      break;
+    }
+
+    case TW_MR_SLA_ACK:
+    {
+      TWCR = TWCR_RECV_ACK;
+      break;
+    }
+
+    case TW_MR_DATA_ACK:
+    {
+      p_Trans->w_Data = TWDR << 8;
+      TWCR = TWCR_RECV_NACK;
+      break;
+    }
+
+    case TW_MR_DATA_NACK:
+    {
+      p_Trans->w_Data |= TWDR;
+      TWIFinish( p_Trans, TRUE );
+      break;
+    }
+
+    case TW_MT_SLA_NACK:
+    case TW_MR_SLA_NACK:
+    {
+      /* Device busy. Retry a bounded number of times rather than forever */
+      if( ++u_Retries < C_TWI_MAX_RETRIES )
+        TWCR = TWCR_STOP_START;
+      else
+        TWIFinish( p_Trans, FALSE );
+      break;
+    }
+
+    default:
+    {
+      /* Data NACK, arbitration lost or bus error */
+      TWIFinish( p_Trans, FALSE );
+      break;
+    }
+  }
+}
@@ -0,0 +1,66 @@
+/* 
+twi.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef TWI_H
+#define TWI_H
+
+#include "types.h"
+
+/* Interrupt driven TWI master. Transactions are 16-bit register reads and
+ * writes which are queued by the main loop and run from TWI_vect. When a
+ * transaction completes its done flag ( if any ) is posted to the ISR flags 
+ * so the event loop picks it up like any other event. */
+
+#define C_TWI_QUEUE_SIZE 8
+
+/* Initialize TWI controller */
+void TWIInit( void );
+
+/* Queue a 16-bit register read
+ *   u_Address - 8-bit device address ( R/W bit clear )
+ *   u_Register - Register pointer value
+ *   p_Result - Where to store the register value when the read completes
+ *   u_DoneFlag - ISR flag posted on completion. 0 for none
+ *   Returns TRUE if queued, FALSE if the queue is full
+ */
+uint8 TWIQueueRead( uint8 u_Address, uint8 u_Register, uint16 *p_Result, 
+                    uint8 u_DoneFlag );
+
+/* Queue a 16-bit register write
+ *   u_Address - 8-bit device address ( R/W bit clear )
+ *   u_Register - Register pointer value
+ *   w_Data - Value to write
+ *   u_DoneFlag - ISR flag posted on completion. 0 for none
+ *   Returns TRUE if queued, FALSE if the queue is full
+ */
+uint8 TWIQueueWrite( uint8 u_Address, uint8 u_Register, uint16 w_Data, 
+                     uint8 u_DoneFlag );
+
+/* Returns the number of transactions that can still be queued. Only the 
+ * main loop queues, so this many will fit until it queues more */
+uint8 TWIQueueFree( void );
+
+/* Returns TRUE while any transaction is queued or in flight */
+uint8 TWIBusy( void );
+
+/* Returns number of transactions dropped because of bus errors or a device
+ * that did not acknowledge after C_TWI_MAX_RETRIES attempts */
+uint8 TWIGetErrorCount( void );
+
+#endif
@@ -24,13 +24,21 @@ typedef unsigned char uint8;
 typedef char int8;
 typedef unsigned short uint16;
 typedef short int16;
+#if defined( __AVR__ )
 typedef unsigned long uint32;
 typedef long int32;
+#else
+/* Host simulation build ( sim/ ), where long may be 64 bits */
+typedef unsigned int uint32;
+typedef int int32;
+#endif
 
 #define TRUE 1
 #define FALSE 0
 
+#ifndef NULL
 #define NULL 0
+#endif
 
 #endif
 
@@ -0,0 +1,161 @@
+/* 
+wave.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include "types.h"
+#include "load.h"
+#include "calib.h"
+#include "wave.h"
+
+/* Feed-forward points every 256 / C_WAVE_FF_SEGMENTS levels */
+#define C_WAVE_FF_SEGMENTS 8
+#define C_WAVE_FF_SHIFT    5
+
+typedef struct
+{
+  uint8 u_Level;  /* 0 - 255 of full scale */
+  uint8 u_Ticks;  /* C_WAVE_TICK_MS ticks, 0 ends the waveform */
+} WaveSegmentType;
+
+/* Recorded flight: take-off punch, cruise with throttle punches and a 
+ * hover, 20s per loop */
+static const WaveSegmentType a_WaveFlight[] PROGMEM = {
+  { 255, 60 },  { 170, 140 },                           /* Take-off */
+  { 100, 250 }, { 100, 250 },                           /* Cruise */
+  { 255, 40 },  { 60, 30 },  { 255, 40 },  { 120, 90 }, /* Punches */
+  { 100, 250 }, { 100, 150 },                           /* Cruise */
+  { 140, 200 }, { 150, 100 },                           /* Hover */
+  { 30, 150 },  { 255, 50 },  { 80, 250 },              /* Chop and recover */
+  { 0, 0 } };
+
+static uint16 a_FeedForward[C_WAVE_FF_SEGMENTS + 1];
+static uint16 w_FullScale;
+
+/* Shared with the Timer1 interrupt */
+static volatile uint8 u_WaveRunning = FALSE;
+static volatile uint8 u_Level;
+static volatile uint8 u_Step;    /* Incremented on each segment change */
+static const WaveSegmentType *p_Segment;
+static uint8 u_SegmentTicks;
+static uint8 u_TickCount;
+
+/* Main loop only */
+static uint8 u_SeenStep;
+
+/* Interpolated feed-forward duty of a level */
+static uint16 WaveDuty( uint8 u_Value )
+{
+  uint8 u_Index = u_Value >> C_WAVE_FF_SHIFT;
+  uint8 u_Fraction = u_Value & ( ( 1 << C_WAVE_FF_SHIFT ) - 1 );
+  uint16 w_Low = a_FeedForward[u_Index];
+
+  return( w_Low + (uint16)( ( ( a_FeedForward[u_Index + 1] - w_Low ) * u_Fraction ) >> C_WAVE_FF_SHIFT ) );
+}
+
+/* Load the segment p_Segment points at */
+static void WaveLoadSegment( void )
+{
+  u_SegmentTicks = pgm_read_byte( &p_Segment->u_Ticks );
+  u_Level = pgm_read_byte( &p_Segment->u_Level );
+  LoadSetDuty( WaveDuty( u_Level ) );
+  u_Step++;
+}
+
+/* Start replaying the built-in waveform */
+void WaveStart( uint16 w_Current )
+{
+  uint8 u_Index;
+
+  WaveStop();
+
+  w_FullScale = w_Current;
+
+  /* Points climb with the level, so the interpolation never goes negative */
+  for( u_Index = 0; u_Index <= C_WAVE_FF_SEGMENTS; u_Index++ )
+  {
+    a_FeedForward[u_Index] = CalibFeedForward( 
+      (uint16)( ( (uint32)w_Current * ( u_Index << C_WAVE_FF_SHIFT ) ) >> 8 ) );
+
+    if( u_Index && ( a_FeedForward[u_Index] < a_FeedForward[u_Index - 1] ) )
+      a_FeedForward[u_Index] = a_FeedForward[u_Index - 1];
+  }
+
+  p_Segment = a_WaveFlight;
+  u_TickCount = 0;
+  WaveLoadSegment();
+  u_SeenStep = u_Step - 1;
+  u_WaveRunning = TRUE;
+}
+
+/* Stop replaying */
+void WaveStop( void )
+{
+  u_WaveRunning = FALSE;
+}
+
+/* Advance the waveform. Timer1 interrupt context only */
+void WaveTick( void )
+{
+  if( !u_WaveRunning )
+    return;
+
+  if( ++u_TickCount < C_WAVE_TICK_MS )
+    return;
+
+  u_TickCount = 0;
+
+  if( --u_SegmentTicks )
+    return;
+
+  if( pgm_read_byte( &( ++p_Segment )->u_Ticks ) == 0 )
+    p_Segment = a_WaveFlight;
+
+  WaveLoadSegment();
+}
+
+/* Check for a segment change since the last call */
+uint8 WaveService( void )
+{
+  uint8 u_Now = u_Step;
+
+  if( u_Now == u_SeenStep )
+    return( FALSE );
+
+  u_SeenStep = u_Now;
+
+  return( TRUE );
+}
+
+/* Returns current setpoint of the present segment in 0.1mA */
+uint16 WaveGetSetpoint( void )
+{
+  /* mA * level / 256 * 10 = 0.1mA */
+  return( (uint16)( ( (uint32)w_FullScale * u_Level * 10 ) >> 8 ) );
+}
+
+/* Set the load duty cycle from the regulator */
+void WaveSetDuty( uint16 w_Duty )
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if( u_Step == u_SeenStep )
+      LoadSetDutyFine( w_Duty );
+  }
+}
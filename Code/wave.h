@@ -0,0 +1,62 @@
+/* 
+wave.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#ifndef WAVE_H
+#define WAVE_H
+
+#include "types.h"
+
+/* Load waveform replay. A recorded current waveform is stored in program
+ * memory run length encoded, as segments of a level held for a number of 
+ * C_WAVE_TICK_MS ticks, and replayed in a loop. Levels are 0 - 255 of a
+ * full scale current chosen when starting.
+ *
+ * Timing is kept by the Timer1 millisecond tick, which moves to the next
+ * segment and loads its feed-forward duty cycle itself, so the load steps
+ * on time however busy the main loop is. The duty comes from a small 
+ * table of calibrated feed-forward points built at start and interpolated
+ * in the interrupt. The main loop follows each segment change to reseed 
+ * the regulator, which then trims the current until the next change */
+#define C_WAVE_TICK_MS 10 /* 100Hz */
+
+/* Start replaying the built-in waveform
+ *   w_FullScale - Current of level 255 in mA
+ */
+void WaveStart( uint16 w_FullScale );
+
+/* Stop replaying. The load is left as it is */
+void WaveStop( void );
+
+/* Advance the waveform. Timer1 interrupt context only */
+void WaveTick( void );
+
+/* Check for a segment change since the last call. Main loop only
+ *   Returns TRUE if the level changed
+ */
+uint8 WaveService( void );
+
+/* Returns current setpoint of the present segment in 0.1mA */
+uint16 WaveGetSetpoint( void );
+
+/* Set the load duty cycle from the regulator, in 1 / 2^C_LOAD_DITHER_BITS
+ * counts. Dropped if the interrupt has moved to a new segment that WaveService has not seen yet, so a stale 
+ * regulator output never overwrites the new feed-forward */
+void WaveSetDuty( uint16 w_Duty );
+
+#endif
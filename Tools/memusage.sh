@@ -0,0 +1,54 @@
+#!/bin/sh
+#
+# Report RAM and flash use of a Battery Buddy build and the largest
+# variables in SRAM, and fail if the build does not fit the ATmega168.
+# Check what AVR Studio built:
+#
+#   Tools/memusage.sh [Code/default/BatteryBuddy_V1_0_RevB.elf]
+#
+# or first build it with avr-gcc from the project's source list and options:
+#
+#   Tools/memusage.sh --build [DIR]
+#
+# text + data must fit the 16KB of flash. data + bss must leave at least
+# STACK_RESERVE bytes ( default 256 ) of the 1KB SRAM for the stack.
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+APS=$ROOT/Code/BatteryBuddy_V1_0_RevB.aps
+FLASH_SIZE=16384
+SRAM_SIZE=1024
+STACK_RESERVE=${STACK_RESERVE:-256}
+
+if [ "$1" = "--build" ]; then
+  DIR=${2:-$ROOT/sim/build/avr}
+  ELF=$DIR/BatteryBuddy_V1_0_RevB.elf
+  OPTIONS=$(sed -n 's/.*<OPTIONSFORALL>\([^<]*\)<.*/\1/p' "$APS")
+  SOURCES=$(grep -o '<SOURCEFILE>[^<]*' "$APS" | sed "s#<SOURCEFILE>#$ROOT/Code/#")
+
+  mkdir -p "$DIR" || exit 1
+  avr-gcc -mmcu=atmega168 $OPTIONS -I"$ROOT/Code" -o "$ELF" $SOURCES || exit 1
+else
+  ELF=${1:-$ROOT/Code/default/BatteryBuddy_V1_0_RevB.elf}
+fi
+
+if [ ! -f "$ELF" ]; then
+  echo "$ELF not found, build the project first" >&2
+  exit 1
+fi
+
+avr-size -C --mcu=atmega168 "$ELF" || exit 1
+
+echo "Largest .data/.bss symbols (bytes):"
+avr-nm -S -t d --size-sort -r "$ELF" | awk '$3 ~ /^[bBdD]$/ { printf "  %5d  %s\n", $2, $4 }' | head -n 20
+
+avr-size -A "$ELF" | awk -v flash=$FLASH_SIZE -v sram=$SRAM_SIZE -v reserve=$STACK_RESERVE '
+  $1 == ".text"                     { text = $2 }
+  $1 == ".data"                     { data = $2 }
+  $1 == ".bss" || $1 == ".noinit"   { bss += $2 }
+  END {
+    printf "text %d, data %d, bss %d: flash %d of %d, SRAM %d of %d, %d left for the stack\n",
+           text, data, bss, text + data, flash, data + bss, sram, sram - data - bss
+    fflush()
+    if( text + data > flash ) { print "Flash overflow" > "/dev/stderr"; exit 1 }
+    if( data + bss > sram - reserve ) { print "Less than " reserve " bytes of SRAM left for the stack" > "/dev/stderr"; exit 1 }
+  }'
@@ -0,0 +1,162 @@
+/* 
+profile2hex.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Host side tool that builds the user discharge profile ( see 
+ * Code/profile.h ) as an Intel HEX EEPROM image. The image only covers the
+ * profile area, so programming it leaves the rest of the EEPROM alone with
+ * programmers that write just the addresses present in the file.
+ *
+ * One step per line, blank lines and lines starting with # are ignored:
+ *
+ *   <cc|cp|cr|rest> <setpoint> <voltage|time|capacity|current> <value>
+ *
+ * Setpoints are % of the configured discharge current for cc, 0.1W for cp,
+ * 0.1 Ohm for cr and ignored for rest. End values are mV per cell ( 0 for 
+ * the cell type's cutoff ), seconds, mAh or mA.
+ *
+ *   cc -std=c99 -O2 -o profile2hex profile2hex.c
+ *   ./profile2hex < knee.txt > profile.hex
+ *   avrdude -p m168 -c dragon_isp -U eeprom:w:profile.hex:i
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PROFILE_ADDR  410  /* C_NVM_ADDR_PROFILE */
+#define STEPS_MAX     6    /* C_PROFILE_STEPS_MAX */
+#define STEP_SIZE     5    /* ProfileStepType */
+#define PROFILE_SIZE  ( 2 + STEPS_MAX * STEP_SIZE + 2 )
+
+static const char *step_names[] = { "cc", "cp", "cr", "rest" };
+static const char *end_names[] = { "voltage", "time", "capacity", "current" };
+
+/* Same algorithm as avr-libc _crc_ccitt_update */
+static uint16_t crc_ccitt_update( uint16_t crc, uint8_t data )
+{
+  data ^= crc & 0xFF;
+  data ^= data << 4;
+
+  return ( ( (uint16_t)data << 8 ) | ( crc >> 8 ) ) ^ (uint8_t)( data >> 4 ) ^ 
+         ( (uint16_t)data << 3 );
+}
+
+static int lookup( const char *name, const char **names, int count )
+{
+  int i;
+
+  for( i = 0; i < count; i++ )
+  {
+    if( !strcmp( name, names[i] ) )
+      return i;
+  }
+
+  return -1;
+}
+
+/* Write one Intel HEX data record */
+static void hex_record( uint16_t addr, const uint8_t *data, int len )
+{
+  uint8_t sum = len + ( addr >> 8 ) + ( addr & 0xFF );
+  int i;
+
+  printf( ":%02X%04X00", len, addr );
+
+  for( i = 0; i < len; i++ )
+  {
+    printf( "%02X", data[i] );
+    sum += data[i];
+  }
+
+  printf( "%02X\n", (uint8_t)-sum );
+}
+
+int main( void )
+{
+  uint8_t image[PROFILE_SIZE];
+  char line[128];
+  int steps = 0;
+  int line_no = 0;
+  uint16_t crc = 0xFFFF;
+  int i;
+
+  memset( image, 0, sizeof( image ) );
+
+  while( fgets( line, sizeof( line ), stdin ) )
+  {
+    char step[16];
+    char end[16];
+    unsigned setpoint;
+    unsigned value;
+    int step_type;
+    int end_type;
+    uint8_t *p;
+
+    line_no++;
+
+    if( line[0] == '#' || sscanf( line, "%15s", step ) != 1 )
+      continue;
+
+    if( sscanf( line, "%15s %u %15s %u", step, &setpoint, end, &value ) != 4 ||
+        ( step_type = lookup( step, step_names, 4 ) ) < 0 ||
+        ( end_type = lookup( end, end_names, 4 ) ) < 0 ||
+        setpoint > 0xFFFF || value > 0xFFFF )
+    {
+      fprintf( stderr, "line %d: bad step\n", line_no );
+      return 1;
+    }
+
+    if( steps == STEPS_MAX )
+    {
+      fprintf( stderr, "line %d: more than %d steps\n", line_no, STEPS_MAX );
+      return 1;
+    }
+
+    /* Little endian, packed like the AVR structure */
+    p = &image[2 + steps * STEP_SIZE];
+    p[0] = ( step_type << 4 ) | end_type;
+    p[1] = setpoint & 0xFF;
+    p[2] = setpoint >> 8;
+    p[3] = value & 0xFF;
+    p[4] = value >> 8;
+    steps++;
+  }
+
+  if( steps == 0 )
+  {
+    fprintf( stderr, "no steps\n" );
+    return 1;
+  }
+
+  image[1] = steps;
+
+  for( i = 0; i < PROFILE_SIZE - 2; i++ )
+    crc = crc_ccitt_update( crc, image[i] );
+
+  image[PROFILE_SIZE - 2] = crc & 0xFF;
+  image[PROFILE_SIZE - 1] = crc >> 8;
+
+  for( i = 0; i < PROFILE_SIZE; i += 16 )
+    hex_record( PROFILE_ADDR + i, &image[i], 
+                PROFILE_SIZE - i < 16 ? PROFILE_SIZE - i : 16 );
+
+  printf( ":00000001FF\n" );
+
+  return 0;
+}
@@ -0,0 +1,198 @@
+/* 
+telemetry2csv.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Host side decoder for the Battery Buddy telemetry stream ( see 
+ * Code/telemetry.h ). Reads the raw serial byte stream on stdin and writes 
+ * one CSV line per valid sample frame to stdout, one per status frame to 
+ * the first file named on the command line and one per extra sensor 
+ * reading to the second, if given. Bad frames are counted on stderr.
+ *
+ *   cc -std=c99 -O2 -o telemetry2csv telemetry2csv.c
+ *   stty -F /dev/ttyUSB0 9600 raw && 
+ *     ./telemetry2csv status.csv sensors.csv < /dev/ttyUSB0 > run.csv
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define SAMPLE_SIZE 12              /* TelemetryRecordType */
+#define STATUS_SIZE 11              /* TelemetryStatusType */
+#define SENSOR_SIZE 4               /* TelemetrySensorType */
+#define SENSORS_MAX 3               /* In a TelemetrySensorsType */
+#define FRAME_MAX 32
+
+/* Same algorithm as avr-libc _crc_ccitt_update */
+static uint16_t crc_ccitt_update( uint16_t crc, uint8_t data )
+{
+  data ^= crc & 0xFF;
+  data ^= data << 4;
+
+  return ( ( (uint16_t)data << 8 ) | ( crc >> 8 ) ) ^ (uint8_t)( data >> 4 ) ^ 
+         ( (uint16_t)data << 3 );
+}
+
+/* Decode a COBS frame ( without delimiter ). Returns decoded length or -1 */
+static int cobs_decode( const uint8_t *in, int len, uint8_t *out )
+{
+  int i = 0;
+  int o = 0;
+
+  while( i < len )
+  {
+    uint8_t code = in[i++];
+    int j;
+
+    if( code == 0 || i + code - 1 > len )
+      return -1;
+
+    for( j = 1; j < code; j++ )
+      out[o++] = in[i++];
+
+    if( code != 0xFF && i < len )
+      out[o++] = 0;
+  }
+
+  return o;
+}
+
+static uint16_t get16( const uint8_t *p )
+{
+  return (uint16_t)( p[0] | ( p[1] << 8 ) );
+}
+
+int main( int argc, char **argv )
+{
+  uint8_t frame[FRAME_MAX];
+  uint8_t payload[FRAME_MAX];
+  int frame_len = 0;
+  int overrun = 0;
+  unsigned long bad = 0;
+  uint32_t time_ms = 0;
+  uint16_t last_stamp = 0;
+  int have_stamp = 0;
+  FILE *status = NULL;
+  FILE *sensors = NULL;
+  int c;
+
+  if( argc > 1 && !( status = fopen( argv[1], "w" ) ) )
+  {
+    perror( argv[1] );
+    return 1;
+  }
+
+  if( argc > 2 && !( sensors = fopen( argv[2], "w" ) ) )
+  {
+    perror( argv[2] );
+    return 1;
+  }
+
+  printf( "time_ms,shunt_uv,bus_mv,voltage_mv,current_ma,duty,state\n" );
+
+  if( status )
+    fprintf( status, "time_ms,awake_ms,event_overflows,telemetry_drops,twi_errors,state\n" );
+
+  if( sensors )
+    fprintf( sensors, "time_ms,sensor,voltage_mv,current_ma\n" );
+
+  while( ( c = getchar() ) != EOF )
+  {
+    int len;
+    int size;
+    uint16_t crc = 0xFFFF;
+    uint16_t stamp;
+    int i;
+
+    if( c != 0 )
+    {
+      if( frame_len < FRAME_MAX )
+        frame[frame_len++] = (uint8_t)c;
+      else
+        overrun = 1;
+      continue;
+    }
+
+    /* Delimiter. First partial frame after connecting is expected to fail */
+    len = frame_len && !overrun ? cobs_decode( frame, frame_len, payload ) : -1;
+    frame_len = 0;
+    overrun = 0;
+
+    size = len < 1 ? 0 : payload[0] == 'S' ? SAMPLE_SIZE : payload[0] == 'T' ? STATUS_SIZE : 0;
+
+    /* The other sensors' frame is as long as the board has sensors */
+    if( len >= 3 + SENSOR_SIZE + 2 && len <= 3 + SENSORS_MAX * SENSOR_SIZE + 2 &&
+        payload[0] == 'X' && ( len - 3 - 2 ) % SENSOR_SIZE == 0 )
+      size = len - 2;
+
+    if( size && len == size + 2 )
+    {
+      for( i = 0; i < size; i++ )
+        crc = crc_ccitt_update( crc, payload[i] );
+    }
+
+    if( !size || len != size + 2 || crc != get16( &payload[size] ) )
+    {
+      bad++;
+      continue;
+    }
+
+    /* Device timestamp wraps every 65.536s. A status frame may be stamped 
+     * a little after the sample that follows it */
+    stamp = get16( &payload[1] );
+
+    if( have_stamp )
+      time_ms += (int16_t)( stamp - last_stamp );
+    last_stamp = stamp;
+    have_stamp = 1;
+
+    if( payload[0] == 'S' )
+    {
+      int16_t shunt = (int16_t)get16( &payload[3] );
+      uint16_t bus = get16( &payload[5] );
+      int16_t current = (int16_t)get16( &payload[7] );
+      uint16_t duty = get16( &payload[9] );
+      uint8_t state = payload[11];
+      long bus_mv = ( bus >> 3 ) * 4;
+
+      printf( "%lu,%ld,%ld,%ld,%.1f,%u,%u\n", (unsigned long)time_ms, 
+              (long)shunt * 10, bus_mv, bus_mv + shunt / 100, current / 10.0, 
+              duty, state );
+    }
+    else if( payload[0] == 'T' && status )
+    {
+      fprintf( status, "%lu,%u,%u,%u,%u,%u\n", (unsigned long)time_ms, get16( &payload[3] ), 
+               get16( &payload[5] ), get16( &payload[7] ), payload[9], payload[10] );
+    }
+    else if( payload[0] == 'X' && sensors )
+    {
+      for( i = 0; 3 + i * SENSOR_SIZE < size; i++ )
+        fprintf( sensors, "%lu,%d,%u,%u\n", (unsigned long)time_ms, i + 1, 
+                 get16( &payload[3 + i * SENSOR_SIZE] ), get16( &payload[5 + i * SENSOR_SIZE] ) );
+    }
+  }
+
+  fprintf( stderr, "%lu bad frames\n", bad );
+
+  if( status )
+    fclose( status );
+
+  if( sensors )
+    fclose( sensors );
+
+  return 0;
+}
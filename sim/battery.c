@@ -0,0 +1,132 @@
+/* 
+battery.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include <math.h>
+#include "battery.h"
+
+/* Cell open circuit voltage against state of charge, mV. Below 0 the 
+ * voltage keeps falling steeply, as a cell driven past empty does */
+typedef struct
+{
+  double soc;
+  double mv;
+} ocv_point;
+
+static const ocv_point ocv_nimh[] =
+{
+  { -0.10,  600 }, { 0.00, 1000 }, { 0.05, 1130 }, { 0.10, 1180 }, { 0.20, 1210 },
+  {  0.40, 1235 }, { 0.60, 1255 }, { 0.80, 1280 }, { 0.90, 1310 }, { 1.00, 1400 }
+};
+
+static const ocv_point ocv_lipo[] =
+{
+  { -0.10, 2500 }, { 0.00, 3300 }, { 0.05, 3550 }, { 0.10, 3650 }, { 0.20, 3720 },
+  {  0.40, 3800 }, { 0.60, 3880 }, { 0.80, 4000 }, { 0.90, 4090 }, { 1.00, 4200 }
+};
+
+#define OCV_POINTS ( sizeof( ocv_nimh ) / sizeof( ocv_nimh[0] ) )
+
+static const ocv_point *ocv_table( const sim_battery *b )
+{
+  return b->chem == SIM_CHEM_LIPO ? ocv_lipo : ocv_nimh;
+}
+
+/* Piecewise linear, extrapolated from the end segments */
+static double cell_ocv( const ocv_point *t, double soc )
+{
+  unsigned i = 1;
+
+  while( i < OCV_POINTS - 1 && soc > t[i].soc )
+    i++;
+
+  return t[i - 1].mv + ( soc - t[i - 1].soc ) * ( t[i].mv - t[i - 1].mv ) / 
+         ( t[i].soc - t[i - 1].soc );
+}
+
+/* Inverse of cell_ocv, the table is monotonic */
+static double cell_soc( const ocv_point *t, double mv )
+{
+  unsigned i = 1;
+
+  while( i < OCV_POINTS - 1 && mv > t[i].mv )
+    i++;
+
+  return t[i - 1].soc + ( mv - t[i - 1].mv ) * ( t[i].soc - t[i - 1].soc ) / 
+         ( t[i].mv - t[i - 1].mv );
+}
+
+void sim_battery_init( sim_battery *b, sim_chemistry chem, int cells, double capacity_mah, 
+                       double r0_ohm, double r1_ohm, double c1_farad )
+{
+  b->chem = chem;
+  b->cells = cells;
+  b->capacity_mas = capacity_mah * 3600.0;
+  b->r0_ohm = r0_ohm;
+  b->r1_ohm = r1_ohm;
+  b->c1_farad = c1_farad;
+  b->used_mas = 0;
+  b->v_rc_mv = 0;
+  b->connected = 1;
+}
+
+double sim_battery_soc( const sim_battery *b )
+{
+  return 1.0 - b->used_mas / b->capacity_mas;
+}
+
+double sim_battery_ocv( const sim_battery *b )
+{
+  return b->cells * cell_ocv( ocv_table( b ), sim_battery_soc( b ) );
+}
+
+double sim_battery_voltage( const sim_battery *b, double i_ma )
+{
+  double v;
+
+  if( !b->connected )
+    return 0;
+
+  /* mA * Ohm = mV */
+  v = sim_battery_ocv( b ) - i_ma * b->r0_ohm - b->v_rc_mv;
+
+  return v > 0 ? v : 0;
+}
+
+void sim_battery_step( sim_battery *b, double i_ma, double dt_s )
+{
+  double tau = b->r1_ohm * b->c1_farad;
+
+  if( !b->connected )
+    i_ma = 0;
+
+  b->used_mas += i_ma * dt_s;
+
+  /* Exact step of dV/dt = ( I R1 - V ) / tau for constant I */
+  if( tau > 0 )
+    b->v_rc_mv += ( i_ma * b->r1_ohm - b->v_rc_mv ) * ( 1.0 - exp( -dt_s / tau ) );
+  else
+    b->v_rc_mv = i_ma * b->r1_ohm;
+}
+
+double sim_battery_capacity_to( const sim_battery *b, double i_ma, double v_cut_mv )
+{
+  double cell_mv = ( v_cut_mv + i_ma * ( b->r0_ohm + b->r1_ohm ) ) / b->cells;
+
+  return ( 1.0 - cell_soc( ocv_table( b ), cell_mv ) ) * b->capacity_mas;
+}
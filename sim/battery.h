@@ -0,0 +1,74 @@
+/* 
+battery.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Thevenin equivalent cell model for the host simulation. The pack is 
+ * cells in series, each an open circuit voltage that follows state of 
+ * charge, a series resistance R0 and one RC pair for the slower 
+ * polarisation, so the terminal voltage sags at once under load and then 
+ * keeps drifting down, and recovers the same way when the load goes */
+
+#ifndef SIM_BATTERY_H
+#define SIM_BATTERY_H
+
+/* Host structure layout, see sim.h */
+#pragma pack(push, 8)
+
+typedef enum
+{
+  SIM_CHEM_NIMH,
+  SIM_CHEM_LIPO
+} sim_chemistry;
+
+typedef struct
+{
+  sim_chemistry chem;
+  int cells;
+  double capacity_mas;  /* Charge from full to empty, mA seconds */
+  double r0_ohm;        /* Per pack */
+  double r1_ohm;        /* RC pair, per pack */
+  double c1_farad;
+  double used_mas;      /* Charge taken out since full */
+  double v_rc_mv;       /* Voltage across the RC pair */
+  int connected;
+} sim_battery;
+
+/* Full pack of cells, with pack level resistances */
+void sim_battery_init( sim_battery *b, sim_chemistry chem, int cells, double capacity_mah, 
+                       double r0_ohm, double r1_ohm, double c1_farad );
+
+/* State of charge, 1 full, 0 empty, negative once driven past empty */
+double sim_battery_soc( const sim_battery *b );
+
+/* Open circuit voltage of the pack, mV */
+double sim_battery_ocv( const sim_battery *b );
+
+/* Terminal voltage while i_ma flows, mV. 0 when disconnected */
+double sim_battery_voltage( const sim_battery *b, double i_ma );
+
+/* Draw i_ma for dt_s seconds */
+void sim_battery_step( sim_battery *b, double i_ma, double dt_s );
+
+/* Charge, mA seconds, a constant i_ma load takes out before the terminal 
+ * voltage falls to v_cut_mv, once the RC pair has settled. This is what an
+ * ideal constant current discharge to that cutoff measures */
+double sim_battery_capacity_to( const sim_battery *b, double i_ma, double v_cut_mv );
+
+#pragma pack(pop)
+
+#endif
@@ -0,0 +1,83 @@
+/* 
+check.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Minimal checks for the simulation tests. A failed check prints where and
+ * why and is counted, the test carries on so one run shows every failure */
+
+#ifndef SIM_CHECK_H
+#define SIM_CHECK_H
+
+#include <stdio.h>
+#include "sim.h"
+
+static int check_failures;
+static int check_before_boot;  /* Count when the running boot was forked */
+
+#define CHECK( cond, ... ) \
+  do \
+  { \
+    if( !( cond ) ) \
+    { \
+      check_failures++; \
+      printf( "%s:%d: FAIL ( %s ) ", __FILE__, __LINE__, #cond ); \
+      printf( __VA_ARGS__ ); \
+      printf( "\n" ); \
+    } \
+  } while( 0 )
+
+/* Run a boot with sim_boot and add what it found. The child starts with a 
+ * copy of the count so far, so fn returns check_boot_failures() */
+static inline void check_boot( int ( *fn )( void *arg ), void *arg )
+{
+  int result;
+
+  check_before_boot = check_failures;
+  result = sim_boot( fn, arg );
+
+  if( result < 0 )
+  {
+    check_failures++;
+    printf( "boot crashed\n" );
+  }
+  else
+    check_failures += result;
+}
+
+/* The failures found in this boot, capped to fit an exit code */
+static inline int check_boot_failures( void )
+{
+  int failures = check_failures - check_before_boot;
+
+  return failures > 255 ? 255 : failures;
+}
+
+/* Print the verdict. Returns the process exit code */
+static int check_report( const char *name )
+{
+  printf( "%s: %s", name, check_failures ? "FAIL" : "PASS" );
+
+  if( check_failures )
+    printf( " ( %d )", check_failures );
+
+  printf( "\n" );
+
+  return check_failures ? 1 : 0;
+}
+
+#endif
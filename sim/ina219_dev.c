@@ -0,0 +1,192 @@
+/* 
+ina219_dev.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include <math.h>
+#include "ina219_dev.h"
+
+#define CONFIG_RESET  0x399F
+#define BUS_CNVR      ( 1 << 1 )
+#define BUS_OVF       ( 1 << 0 )
+
+void sim_ina219_init( sim_ina219 *d, uint8_t address, double shunt_ohm )
+{
+  int i;
+
+  d->address = address;
+  d->shunt_ohm = shunt_ohm;
+  d->pointer = 0;
+
+  for( i = 0; i < SIM_INA219_REGISTERS; i++ )
+  {
+    d->reg[i] = 0;
+    d->reads[i] = 0;
+    d->writes[i] = 0;
+  }
+
+  d->reg[SIM_INA219_CONFIG] = CONFIG_RESET;
+  d->bus_mv = 0;
+  d->current_ma = 0;
+  d->sum_bus_mv = 0;
+  d->sum_current_ma = 0;
+  d->window_us = 0;
+  d->elapsed_us = 0;
+  d->conversions = 0;
+  d->nack = 0;
+  d->naks_sent = 0;
+}
+
+/* One ADC, from its four config bits */
+static double adc_us( unsigned mode )
+{
+  static const double resolution_us[4] = { 84, 148, 276, 532 };
+  static const double averaged_us[8] = { 532, 1060, 2130, 4260, 8510, 17020, 34050, 68100 };
+
+  if( mode & 0x8 )
+    return averaged_us[mode & 0x7];
+
+  return resolution_us[mode & 0x3];
+}
+
+double sim_ina219_conversion_us( uint16_t config )
+{
+  return adc_us( ( config >> 7 ) & 0xF ) + adc_us( ( config >> 3 ) & 0xF );
+}
+
+static int16_t clamp16( double v, double limit )
+{
+  if( v > limit )
+    v = limit;
+  if( v < -limit )
+    v = -limit;
+
+  return (int16_t)lround( v );
+}
+
+/* Latch the window's mean into the result registers */
+static void convert( sim_ina219 *d )
+{
+  uint16_t config = d->reg[SIM_INA219_CONFIG];
+  double shunt_limit = 4000.0 * ( 1 << ( ( config >> 11 ) & 0x3 ) ); /* 40mV << PG, 10uV LSB */
+  double shunt_uv = d->sum_current_ma / d->window_us * d->shunt_ohm * 1000.0 + d->offset_uv;
+  double bus_mv = d->sum_bus_mv / d->window_us;
+  int16_t shunt = clamp16( shunt_uv / 10.0, shunt_limit );
+  int32_t current;
+  int32_t power;
+  uint16_t bus;
+  int overflow = fabs( shunt_uv / 10.0 ) > shunt_limit;
+
+  if( bus_mv < 0 )
+    bus_mv = 0;
+
+  bus = (uint16_t)lround( bus_mv / 4.0 );
+  if( bus > 0x1FFF )
+    bus = 0x1FFF;
+
+  /* Datasheet equations 4 and 5 */
+  current = ( (int32_t)shunt * d->reg[SIM_INA219_CALIBRATION] ) / 4096;
+  power = ( current * bus ) / 5000;
+
+  if( current > 32767 || current < -32768 || power > 65535 || power < 0 )
+    overflow = 1;
+
+  d->reg[SIM_INA219_SHUNT] = (uint16_t)shunt;
+  d->reg[SIM_INA219_CURRENT] = (uint16_t)(int16_t)current;
+  d->reg[SIM_INA219_POWER] = (uint16_t)power;
+  d->reg[SIM_INA219_BUS] = (uint16_t)( bus << 3 ) | BUS_CNVR | ( overflow ? BUS_OVF : 0 );
+  d->conversions++;
+}
+
+void sim_ina219_step( sim_ina219 *d, double dt_us )
+{
+  uint16_t config = d->reg[SIM_INA219_CONFIG];
+  double conversion_us = sim_ina219_conversion_us( config );
+
+  /* Only continuous shunt and bus mode is modelled */
+  if( ( config & 0x7 ) != 0x7 )
+    return;
+
+  while( dt_us > 0 )
+  {
+    double step = conversion_us - d->elapsed_us;
+
+    if( step > dt_us )
+      step = dt_us;
+
+    d->sum_bus_mv += d->bus_mv * step;
+    d->sum_current_ma += d->current_ma * step;
+    d->window_us += step;
+    d->elapsed_us += step;
+    dt_us -= step;
+
+    if( d->elapsed_us >= conversion_us )
+    {
+      convert( d );
+      d->sum_bus_mv = 0;
+      d->sum_current_ma = 0;
+      d->window_us = 0;
+      d->elapsed_us = 0;
+    }
+  }
+}
+
+uint16_t sim_ina219_read( sim_ina219 *d, uint8_t reg )
+{
+  uint16_t value;
+
+  if( reg >= SIM_INA219_REGISTERS )
+    return 0;
+
+  value = d->reg[reg];
+  d->reads[reg]++;
+
+  if( reg == SIM_INA219_POWER )
+    d->reg[SIM_INA219_BUS] &= ~BUS_CNVR;
+
+  return value;
+}
+
+void sim_ina219_write( sim_ina219 *d, uint8_t reg, uint16_t value )
+{
+  if( reg == SIM_INA219_CONFIG )
+  {
+    d->writes[reg]++;
+
+    if( value & 0x8000 )
+    {
+      /* Reset bit */
+      uint8_t address = d->address;
+      double shunt_ohm = d->shunt_ohm;
+
+      sim_ina219_init( d, address, shunt_ohm );
+      return;
+    }
+
+    /* A new config restarts the conversion */
+    d->reg[reg] = value;
+    d->sum_bus_mv = 0;
+    d->sum_current_ma = 0;
+    d->window_us = 0;
+    d->elapsed_us = 0;
+  }
+  else if( reg == SIM_INA219_CALIBRATION )
+  {
+    d->writes[reg]++;
+    d->reg[reg] = value & 0xFFFE;
+  }
+}
@@ -0,0 +1,86 @@
+/* 
+ina219_dev.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* INA219 device model for the host simulation. The register file, pointer
+ * and conversion timing follow the datasheet: in continuous shunt and bus 
+ * mode a conversion takes the bus plus the shunt ADC time set in the config
+ * register, the result is the mean of the inputs over that window, CNVR is
+ * set when it lands and cleared by reading the power register */
+
+#ifndef SIM_INA219_DEV_H
+#define SIM_INA219_DEV_H
+
+/* Host structure layout, see sim.h */
+#pragma pack(push, 8)
+
+#include <stdint.h>
+
+enum
+{
+  SIM_INA219_CONFIG,
+  SIM_INA219_SHUNT,
+  SIM_INA219_BUS,
+  SIM_INA219_POWER,
+  SIM_INA219_CURRENT,
+  SIM_INA219_CALIBRATION,
+  SIM_INA219_REGISTERS
+};
+
+typedef struct
+{
+  uint8_t address;      /* 8-bit bus address, R/W bit clear */
+  double shunt_ohm;
+  uint16_t reg[SIM_INA219_REGISTERS];
+  uint8_t pointer;
+
+  /* Inputs, set by whoever owns the device each millisecond */
+  double bus_mv;        /* IN- to ground */
+  double current_ma;    /* Through the shunt, IN+ to IN- */
+  double offset_uv;     /* Shunt input offset, may be negative. Part of the
+                         * part, so kept over a power on reset */
+
+  /* Conversion in progress */
+  double sum_bus_mv;
+  double sum_current_ma;
+  double window_us;
+  double elapsed_us;
+
+  unsigned conversions;
+  unsigned nack;        /* Address phases still to refuse */
+  unsigned naks_sent;
+  unsigned reads[SIM_INA219_REGISTERS];
+  unsigned writes[SIM_INA219_REGISTERS];
+} sim_ina219;
+
+/* Power on reset */
+void sim_ina219_init( sim_ina219 *d, uint8_t address, double shunt_ohm );
+
+/* Conversion time for a config register value, us */
+double sim_ina219_conversion_us( uint16_t config );
+
+/* Run the ADCs for dt_us with the current inputs */
+void sim_ina219_step( sim_ina219 *d, double dt_us );
+
+/* Register access as the bus sees it */
+uint16_t sim_ina219_read( sim_ina219 *d, uint8_t reg );
+void sim_ina219_write( sim_ina219 *d, uint8_t reg, uint16_t value );
+
+#pragma pack(pop)
+
+#endif
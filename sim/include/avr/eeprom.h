@@ -0,0 +1,33 @@
+/* 
+eeprom.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Host stand-in for avr-libc <avr/eeprom.h>, backed by sim_eeprom. The 
+ * pointer arguments are EEPROM addresses, as on the AVR */
+
+#ifndef SIM_AVR_EEPROM_H
+#define SIM_AVR_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <avr/io.h>
+
+uint8_t eeprom_read_byte( const uint8_t *p_Addr );
+void eeprom_read_block( void *p_Dest, const void *p_Addr, size_t n );
+
+#endif
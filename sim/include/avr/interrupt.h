@@ -0,0 +1,41 @@
+/* 
+interrupt.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Host stand-in for avr-libc <avr/interrupt.h>. Interrupt handlers become 
+ * plain functions that sim/sim.c calls when the modelled hardware would 
+ * raise them. Everything runs on one thread, so masking is a no-op */
+
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define ISR( vector ) void vector( void )
+
+#define sei()
+#define cli()
+
+void TIMER0_COMPA_vect( void );
+void TIMER1_OVF_vect( void );
+void TIMER2_COMPA_vect( void );
+void TWI_vect( void );
+void EE_READY_vect( void );
+void USART_UDRE_vect( void );
+
+#endif
@@ -0,0 +1,75 @@
+/* 
+io.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Host stand-in for avr-libc <avr/io.h>. Peripheral registers are plain 
+ * variables ( defined in sim/sim.c ) that the hardware models in sim/ read
+ * and write between interrupts. EEDR is wired straight to the emulated 
+ * EEPROM cell at EEAR, so a write lands when the firmware stores EEDR */
+
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+#include <stdint.h>
+#include <avr/sfr_defs.h>
+
+#define SIM_REG8( name )  extern volatile uint8_t name;
+#define SIM_REG16( name ) extern volatile uint16_t name;
+
+SIM_REG8( PORTB ) SIM_REG8( PORTC ) SIM_REG8( PORTD )
+SIM_REG8( DDRB )  SIM_REG8( DDRC )  SIM_REG8( DDRD )
+SIM_REG8( PINB )  SIM_REG8( PINC )  SIM_REG8( PIND )
+
+SIM_REG8( TCCR0A ) SIM_REG8( TCCR0B ) SIM_REG8( TCNT0 ) SIM_REG8( OCR0A )
+SIM_REG8( TIMSK0 ) SIM_REG8( TIFR0 )
+SIM_REG8( TCCR1A ) SIM_REG8( TCCR1B ) SIM_REG16( OCR1A ) SIM_REG16( OCR1B )
+SIM_REG16( ICR1 )  SIM_REG8( TIMSK1 ) SIM_REG8( TIFR1 )
+SIM_REG8( TCCR2A ) SIM_REG8( TCCR2B ) SIM_REG8( OCR2A ) SIM_REG8( TIMSK2 )
+SIM_REG8( TIFR2 )  SIM_REG8( ASSR )
+SIM_REG8( CLKPR )
+
+SIM_REG8( TWBR ) SIM_REG8( TWSR ) SIM_REG8( TWDR ) SIM_REG8( TWCR )
+
+SIM_REG8( EECR ) SIM_REG16( EEAR )
+
+SIM_REG8( UCSR0A ) SIM_REG8( UCSR0B ) SIM_REG8( UCSR0C ) SIM_REG8( UDR0 )
+SIM_REG16( UBRR0 )
+
+#define E2END 0x1FF
+extern uint8_t *sim_eeprom; /* In memory shared with forked boots */
+#define EEDR ( sim_eeprom[EEAR & E2END] )
+
+/* Bit positions, ATmega168 */
+enum { PORTB0, PORTB1, PORTB2, PORTB3, PORTB4, PORTB5, PORTB6, PORTB7 };
+enum { PORTC0, PORTC1, PORTC2, PORTC3, PORTC4, PORTC5, PORTC6 };
+enum { PORTD0, PORTD1, PORTD2, PORTD3, PORTD4, PORTD5, PORTD6, PORTD7 };
+enum { PINC0, PINC1, PINC2, PINC3, PINC4, PINC5, PINC6 };
+enum { DDB0, DDB1, DDB2, DDB3, DDB4, DDB5 };
+enum { DDC0, DDC1, DDC2, DDC3, DDC4, DDC5 };
+
+enum { CS00 = 0, CS01 = 1, CS02 = 2, WGM01 = 1, OCIE0A = 1, OCF0A = 1 };
+enum { CS10 = 0, CS11 = 1, CS12 = 2, WGM10 = 0, WGM11 = 1, WGM12 = 3, WGM13 = 4,
+       COM1B0 = 4, COM1B1 = 5, COM1A0 = 6, COM1A1 = 7, TOIE1 = 0, TOV1 = 0 };
+enum { CS20 = 0, CS21 = 1, CS22 = 2, WGM21 = 1, OCIE2A = 1, OCF2A = 1, AS2 = 5 };
+enum { CLKPS0 = 0, CLKPS1 = 1, CLKPCE = 7 };
+enum { TWIE = 0, TWEN = 2, TWWC = 3, TWSTO = 4, TWSTA = 5, TWEA = 6, TWINT = 7 };
+enum { EERE = 0, EEPE = 1, EEMPE = 2, EERIE = 3 };
+enum { U2X0 = 1, UDRE0 = 5, TXC0 = 6, UCSZ00 = 1, UCSZ01 = 2, TXEN0 = 3, 
+       UDRIE0 = 5 };
+
+#endif
@@ -0,0 +1,41 @@
+/* 
+pgmspace.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Host stand-in for avr-libc <avr/pgmspace.h>. Flash and RAM share one 
+ * address space on the host. pgm_read_word reads the pointed-to type, so
+ * tables of PGM_P keep their full host pointer width */
+
+#ifndef SIM_AVR_PGMSPACE_H
+#define SIM_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR( s ) ( s )
+
+typedef const char *PGM_P;
+
+#define pgm_read_byte( p ) ( *(const uint8_t *)( p ) )
+#define pgm_read_word( p ) ( *( p ) )
+#define pgm_read_dword( p ) ( *(const uint32_t *)( p ) )
+
+#define memcpy_P( dest, src, n ) memcpy( ( dest ), ( src ), ( n ) )
+
+#endif
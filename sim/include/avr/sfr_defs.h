@@ -0,0 +1,37 @@
+/* 
+sfr_defs.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Host stand-in for avr-libc <avr/sfr_defs.h> */
+
+#ifndef SIM_AVR_SFR_DEFS_H
+#define SIM_AVR_SFR_DEFS_H
+
+#define _BV( bit ) ( 1 << ( bit ) )
+
+#define bit_is_set( sfr, bit )   ( (sfr) & _BV(bit) )
+#define bit_is_clear( sfr, bit ) ( !( (sfr) & _BV(bit) ) )
+
+/* A peripheral finishes what it is doing while the CPU spins on its flag.
+ * sim_spin() completes the TWI unit's pending action, see sim/sim.c */
+void sim_spin( void );
+
+#define loop_until_bit_is_clear( sfr, bit ) \
+  do { } while( bit_is_set( sfr, bit ) && ( sim_spin(), 1 ) )
+
+#endif
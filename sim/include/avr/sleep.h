@@ -0,0 +1,37 @@
+/* 
+sleep.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Host stand-in for avr-libc <avr/sleep.h>. Sleeping hands the CPU to the
+ * hardware models in sim/sim.c, which run for a millisecond, calling any
+ * interrupts that come due, before the main loop carries on */
+
+#ifndef SIM_AVR_SLEEP_H
+#define SIM_AVR_SLEEP_H
+
+#define SLEEP_MODE_IDLE     0
+#define SLEEP_MODE_PWR_SAVE 3
+
+void sim_sleep( void );
+
+#define set_sleep_mode( mode ) ( (void)( mode ) )
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu() sim_sleep()
+
+#endif
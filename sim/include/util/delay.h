@@ -0,0 +1,31 @@
+/* 
+delay.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Host stand-in for avr-libc <util/delay.h>. A delay runs the hardware 
+ * models for that long, interrupts included, as the real busy wait would */
+
+#ifndef SIM_UTIL_DELAY_H
+#define SIM_UTIL_DELAY_H
+
+void sim_delay_us( unsigned long us );
+
+#define _delay_ms( ms ) sim_delay_us( (unsigned long)( ms ) * 1000UL )
+#define _delay_us( us ) sim_delay_us( (unsigned long)( us ) )
+
+#endif
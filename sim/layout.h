@@ -0,0 +1,39 @@
+/* 
+layout.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Forced into the firmware and the tests by the Makefile. avr-gcc aligns 
+ * nothing, so packing everything after this point gives the firmware's 
+ * records the sizes they have on the chip, and the EEPROM slots in nvmap.h
+ * the same places. The C library is laid out as the host expects, so its 
+ * headers come first. The models keep the host layout, see sim.h */
+
+#ifndef SIM_LAYOUT_H
+#define SIM_LAYOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#pragma pack(1)
+
+#endif
@@ -0,0 +1,90 @@
+/* 
+lcd.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Host stand-in for Code/lcd.c. Characters go into sim->lcd, a 2x16 copy 
+ * of what the HD44780 would show, so tests can read the screen */
+
+#include <string.h>
+#include <avr/pgmspace.h>
+#include "lcd.h"
+#include "sim.h"
+
+static uint8_t cursor_x;
+static uint8_t cursor_y;
+
+void lcd_init( uint8_t dispAttr )
+{
+  (void)dispAttr;
+  lcd_clrscr();
+}
+
+void lcd_clrscr( void )
+{
+  memset( sim->lcd, ' ', sizeof( sim->lcd ) );
+  sim->lcd[0][16] = sim->lcd[1][16] = 0;
+  lcd_home();
+}
+
+void lcd_home( void )
+{
+  cursor_x = 0;
+  cursor_y = 0;
+}
+
+void lcd_gotoxy( uint8_t x, uint8_t y )
+{
+  cursor_x = x;
+  cursor_y = y & 1;
+}
+
+void lcd_putc( char c )
+{
+  if( c == '\n' )
+  {
+    cursor_x = 0;
+    cursor_y ^= 1;
+    return;
+  }
+
+  if( cursor_x < 16 )
+    sim->lcd[cursor_y][cursor_x] = c;
+
+  cursor_x++;
+}
+
+void lcd_puts( const char *s )
+{
+  while( *s )
+    lcd_putc( *s++ );
+}
+
+void lcd_puts_p( const char *progmem_s )
+{
+  lcd_puts( progmem_s );
+}
+
+void lcd_command( uint8_t cmd )
+{
+  (void)cmd;
+}
+
+void lcd_data( uint8_t data )
+{
+  lcd_putc( (char)data );
+}
@@ -0,0 +1,580 @@
+/* 
+sim.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#define _GNU_SOURCE
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "board.h"
+#include "sim.h"
+#include "twi_bus.h"
+
+/* Registers */
+volatile uint8_t PORTB, PORTC, PORTD, DDRB, DDRC, DDRD, PINB, PINC, PIND;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, TIMSK0, TIFR0;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t OCR1A, OCR1B, ICR1;
+volatile uint8_t TCCR2A, TCCR2B, OCR2A, TIMSK2, TIFR2, ASSR, CLKPR;
+volatile uint8_t TWBR, TWSR, TWDR, TWCR;
+volatile uint8_t EECR;
+volatile uint16_t EEAR;
+volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UDR0;
+volatile uint16_t UBRR0;
+
+uint8_t *sim_eeprom;
+sim_world *sim;
+
+/* Code/batterybuddy.c main(), renamed by the Makefile */
+int sim_firmware_main( void );
+
+#define FIRMWARE_STACK   ( 256 * 1024 )
+#define EEPROM_WRITE_MS  4     /* 3.4ms per byte, rounded up to the tick */
+#define SIM_LONG_PRESS_MS 2500 /* isr.c wants 1000 debounce ticks of 2ms */
+
+static ucontext_t test_context;
+static ucontext_t firmware_context;
+static int firmware_started;
+static int in_firmware;
+static uint32_t run_until_ms;
+static unsigned long delay_us;
+
+static double timer0_counts;
+static unsigned timer1_us;
+static uint32_t timer2_ms;
+static double twi_credit;
+static double usart_credit;
+static uint32_t eeprom_ready_ms;
+
+/* Front panel inputs, 1 is the released / idle level */
+static int button_level;
+static int encoder_a_level;
+static int encoder_b_level;
+
+/* avr-libc EEPROM reads */
+uint8_t eeprom_read_byte( const uint8_t *p )
+{
+  return sim_eeprom[(uintptr_t)p & E2END];
+}
+
+void eeprom_read_block( void *dst, const void *src, size_t n )
+{
+  size_t i;
+
+  for( i = 0; i < n; i++ )
+    ( (uint8_t *)dst )[i] = sim_eeprom[( (uintptr_t)src + i ) & E2END];
+}
+
+void sim_setup( void )
+{
+  sim = mmap( NULL, sizeof( *sim ), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+
+  if( sim == MAP_FAILED )
+  {
+    perror( "mmap" );
+    exit( 2 );
+  }
+
+  memset( sim, 0, sizeof( *sim ) );
+  memset( sim->eeprom, 0xFF, sizeof( sim->eeprom ) );
+  sim_eeprom = sim->eeprom;
+
+  /* Nominal 1094mA full scale, this board reads 4% high */
+  sim->load.full_scale_ma = 1094.0 * 1.04;
+  sim->load.offset_ma = 2.0;
+  sim->load.tau_ms = 5.0;
+  sim->load.path_ohm = 0.5;
+
+  sim->sensors = 1;
+  sim_ina219_init( &sim->sensor[0], SIM_LOAD_SENSOR_ADDRESS, SIM_SHUNT_OHM );
+}
+
+static void set_pin( volatile uint8_t *pin, int bit, int level )
+{
+  if( level )
+    *pin |= (uint8_t)_BV(bit);
+  else
+    *pin &= (uint8_t)~_BV(bit);
+}
+
+/* Writes to PINx toggle outputs on the part but land in the input 
+ * variable here, so the inputs are driven again before every interrupt */
+static void apply_inputs( void )
+{
+  set_pin( &C_BOARD_BUTTON_PIN, C_BOARD_BUTTON_BIT, button_level );
+  set_pin( &C_BOARD_ENCODER_A_PIN, C_BOARD_ENCODER_A_BIT, encoder_a_level );
+  set_pin( &C_BOARD_ENCODER_B_PIN, C_BOARD_ENCODER_B_BIT, encoder_b_level );
+}
+
+void sim_power_on( void )
+{
+  int i;
+
+  PORTB = PORTC = PORTD = DDRB = DDRC = DDRD = 0;
+  PINB = PINC = PIND = 0xFF;
+  TCCR0A = TCCR0B = TCNT0 = OCR0A = TIMSK0 = TIFR0 = 0;
+  TCCR1A = TCCR1B = TIMSK1 = TIFR1 = 0;
+  OCR1A = OCR1B = ICR1 = 0;
+  TCCR2A = TCCR2B = OCR2A = TIMSK2 = TIFR2 = ASSR = CLKPR = 0;
+  TWBR = TWDR = TWCR = 0;
+  TWSR = 0xF8;
+  EECR = 0;
+  EEAR = 0;
+  UCSR0A = _BV(UDRE0);
+  UCSR0B = UCSR0C = UDR0 = 0;
+  UBRR0 = 0;
+
+  button_level = encoder_a_level = encoder_b_level = 1;
+  apply_inputs();
+
+  timer0_counts = 0;
+  timer1_us = 0;
+  timer2_ms = 0;
+  twi_credit = 0;
+  usart_credit = 0;
+  sim->tx_len = 0;
+  eeprom_ready_ms = 0;
+  delay_us = 0;
+
+  sim->now_ms = 0;
+  sim->load.filtered[0] = sim->load.filtered[1] = 0;
+  sim->load_ma = 0;
+  memset( sim->lcd, ' ', sizeof( sim->lcd ) );
+  sim->lcd[0][16] = sim->lcd[1][16] = 0;
+
+  /* The INA219s power up with the board */
+  sim_twi_reset();
+
+  for( i = 0; i < sim->sensors; i++ )
+  {
+    sim_ina219_init( &sim->sensor[i], sim->sensor[i].address, sim->sensor[i].shunt_ohm );
+    sim_twi_attach( &sim->sensor[i] );
+  }
+
+  firmware_started = 0;
+}
+
+int sim_boot( int ( *fn )( void *arg ), void *arg )
+{
+  pid_t pid;
+  int status;
+
+  fflush( stdout );
+  fflush( stderr );
+
+  pid = fork();
+
+  if( pid < 0 )
+  {
+    perror( "fork" );
+    exit( 2 );
+  }
+
+  if( pid == 0 )
+  {
+    sim_power_on();
+    status = fn( arg );
+    fflush( stdout );
+    fflush( stderr );
+    _exit( status );
+  }
+
+  if( waitpid( pid, &status, 0 ) < 0 || !WIFEXITED( status ) )
+    return -1;
+
+  return WEXITSTATUS( status );
+}
+
+/* Load channels and the pack, for the millisecond just gone */
+static void step_analog( const double duty[2] )
+{
+  sim_load_model *load = &sim->load;
+  double alpha = 1.0 - exp( -1.0 / load->tau_ms );
+  double demand = 0;
+  double limit;
+  double v;
+  int opamp = ( C_BOARD_OPAMP_PORT & _BV(C_BOARD_OPAMP_BIT) ) != 0;
+  int enabled[2];
+  int ch;
+
+  enabled[0] = ( TCCR1A & _BV(COM1B1) ) && ( C_BOARD_LOAD_A_DDR & _BV(C_BOARD_LOAD_A_BIT) );
+  enabled[1] = ( TCCR1A & _BV(COM1A1) ) && ( C_BOARD_LOAD_B_DDR & _BV(C_BOARD_LOAD_B_BIT) );
+
+  for( ch = 0; ch < 2; ch++ )
+  {
+    double i;
+
+    load->filtered[ch] += ( ( enabled[ch] ? duty[ch] : 0 ) - load->filtered[ch] ) * alpha;
+
+    i = load->filtered[ch] * load->full_scale_ma + load->offset_ma;
+
+    if( opamp && enabled[ch] && i > 0 )
+      demand += i;
+  }
+
+  /* With the MOSFETs fully on the pack sets the current */
+  limit = ( sim_battery_ocv( &sim->cell ) - sim->cell.v_rc_mv ) / 
+          ( sim->cell.r0_ohm + load->path_ohm );
+
+  if( !sim->cell.connected || limit < 0 )
+    limit = 0;
+
+  if( demand > limit )
+    demand = limit;
+
+  v = sim_battery_voltage( &sim->cell, demand );
+
+  sim->load_ma = demand;
+  sim->charge_mas += demand * 0.001;
+  sim->energy_mj += v * demand * 1e-6;
+
+  /* The shunt sits on the low side of IN-, the firmware adds its drop back */
+  sim->sensor[0].current_ma = demand;
+  sim->sensor[0].bus_mv = v - demand * sim->sensor[0].shunt_ohm;
+
+  sim_battery_step( &sim->cell, demand, 0.001 );
+}
+
+/* One millisecond of hardware */
+static void sim_tick( void )
+{
+  double duty[2] = { 0, 0 };
+  unsigned periods = 0;
+  int i;
+
+  apply_inputs();
+
+  /* Timer1 PWM, interrupt at the end of every period */
+  if( TCCR1B & ( _BV(CS12) | _BV(CS11) | _BV(CS10) ) )
+  {
+    timer1_us += 1000;
+
+    while( timer1_us >= ICR1 + 1u )
+    {
+      timer1_us -= ICR1 + 1u;
+      duty[0] += OCR1B / ( ICR1 + 1.0 );
+      duty[1] += OCR1A / ( ICR1 + 1.0 );
+      periods++;
+
+      if( TIMSK1 & _BV(TOIE1) )
+      {
+        apply_inputs();
+        TIMER1_OVF_vect();
+      }
+    }
+
+    if( periods )
+    {
+      duty[0] /= periods;
+      duty[1] /= periods;
+    }
+  }
+
+  /* Timer2, 1Hz from the watch crystal */
+  if( ++timer2_ms >= 1000 )
+  {
+    timer2_ms = 0;
+
+    if( TIMSK2 & _BV(OCIE2A) )
+      TIMER2_COMPA_vect();
+  }
+
+  /* Timer0 tone generator, 125kHz CTC */
+  if( ( TIMSK0 & _BV(OCIE0A) ) && ( TCCR0B & _BV(CS01) ) )
+  {
+    timer0_counts += 125;
+
+    while( ( TIMSK0 & _BV(OCIE0A) ) && timer0_counts >= OCR0A + 1.0 )
+    {
+      timer0_counts -= OCR0A + 1.0;
+      TIMER0_COMPA_vect();
+    }
+  }
+  else
+  {
+    timer0_counts = 0;
+  }
+
+  /* USART. Bytes leave at the rate UBRR0 sets, the ready interrupt asks for
+   * the next one. An interrupt that turns itself off sent nothing */
+  UCSR0A |= _BV(TXC0) | _BV(UDRE0);
+  usart_credit += F_CPU / ( ( UCSR0A & _BV(U2X0) ? 8.0 : 16.0 ) * ( UBRR0 + 1 ) ) / 10.0 / 1000.0;
+
+  while( usart_credit >= 1.0 && ( UCSR0B & _BV(UDRIE0) ) )
+  {
+    usart_credit -= 1.0;
+    USART_UDRE_vect();
+
+    if( UCSR0B & _BV(UDRIE0) )
+    {
+      if( sim->tx_len < SIM_TX_MAX )
+        sim->tx[sim->tx_len] = UDR0;
+      sim->tx_len++;
+    }
+  }
+
+  if( !( UCSR0B & _BV(UDRIE0) ) )
+    usart_credit = 0;
+
+  /* TWI */
+  twi_credit += sim_twi_actions_per_ms();
+
+  while( twi_credit >= 1.0 )
+  {
+    twi_credit -= 1.0;
+
+    if( !sim_twi_step() )
+    {
+      twi_credit = 0;
+      break;
+    }
+  }
+
+  /* EEPROM. A byte lands when EEDR is written, the ready interrupt follows
+   * once the programming time has passed */
+  if( ( EECR & _BV(EERIE) ) && sim->now_ms >= eeprom_ready_ms )
+  {
+    EE_READY_vect();
+
+    if( EECR & _BV(EEPE) )
+    {
+      sim->eeprom_writes++;
+      eeprom_ready_ms = sim->now_ms + EEPROM_WRITE_MS;
+    }
+
+    EECR &= (uint8_t)~( _BV(EEPE) | _BV(EEMPE) | _BV(EERE) );
+  }
+
+  step_analog( duty );
+
+  for( i = 0; i < sim->sensors; i++ )
+    sim_ina219_step( &sim->sensor[i], 1000.0 );
+
+  sim->now_ms++;
+  sim->total_ms++;
+
+  if( in_firmware && sim->now_ms >= run_until_ms )
+    swapcontext( &firmware_context, &test_context );
+}
+
+/* <avr/sleep.h> sleep_cpu() */
+void sim_sleep( void )
+{
+  sim_tick();
+}
+
+/* <avr/sfr_defs.h> loop_until_bit_is_clear(). Only the TWI unit clears a 
+ * flag on its own. A wait that it cannot end would hang the part too */
+void sim_spin( void )
+{
+  if( !sim_twi_step() )
+  {
+    fprintf( stderr, "sim: busy wait on a flag nothing will clear\n" );
+    exit( 2 );
+  }
+}
+
+/* <util/delay.h> */
+void sim_delay_us( unsigned long us )
+{
+  delay_us += us;
+
+  while( delay_us >= 1000 )
+  {
+    delay_us -= 1000;
+    sim_tick();
+  }
+}
+
+static void firmware_entry( void )
+{
+  sim_firmware_main();
+
+  fprintf( stderr, "sim: firmware main returned\n" );
+  exit( 2 );
+}
+
+void sim_run_ms( uint32_t ms )
+{
+  run_until_ms = sim->now_ms + ms;
+
+  if( !firmware_started )
+  {
+    getcontext( &firmware_context );
+    firmware_context.uc_stack.ss_sp = malloc( FIRMWARE_STACK );
+    firmware_context.uc_stack.ss_size = FIRMWARE_STACK;
+    firmware_context.uc_link = NULL;
+    makecontext( &firmware_context, firmware_entry, 0 );
+    firmware_started = 1;
+  }
+
+  in_firmware = 1;
+  swapcontext( &test_context, &firmware_context );
+  in_firmware = 0;
+}
+
+void sim_run_hardware_ms( uint32_t ms )
+{
+  while( ms-- )
+    sim_tick();
+}
+
+const char *sim_lcd_line( int row )
+{
+  return sim->lcd[row & 1];
+}
+
+int sim_lcd_contains( const char *text )
+{
+  return strstr( sim->lcd[0], text ) || strstr( sim->lcd[1], text );
+}
+
+int sim_run_until_lcd( const char *text, uint32_t max_ms )
+{
+  uint32_t end = sim->now_ms + max_ms;
+
+  while( !sim_lcd_contains( text ) )
+  {
+    if( sim->now_ms >= end )
+      return 0;
+
+    sim_run_ms( 10 );
+  }
+
+  return 1;
+}
+
+void sim_press( uint32_t ms )
+{
+  button_level = 0;
+  sim_run_ms( ms );
+  button_level = 1;
+  sim_run_ms( 100 );
+}
+
+void sim_short_press( void )
+{
+  sim_press( 100 );
+}
+
+void sim_long_press( void )
+{
+  sim_press( SIM_LONG_PRESS_MS );
+}
+
+/* A detent is a full cycle of A, read on its rising edge. B low at that 
+ * point is clockwise */
+void sim_turn( int detents )
+{
+  encoder_b_level = detents > 0 ? 0 : 1;
+
+  while( detents )
+  {
+    encoder_a_level = 0;
+    sim_run_ms( 5 );
+    encoder_a_level = 1;
+    sim_run_ms( 5 );
+
+    detents += detents > 0 ? -1 : 1;
+  }
+
+  encoder_b_level = 1;
+  sim_run_ms( 20 );
+}
+
+int sim_turn_until( const char *text, int max_detents )
+{
+  int i;
+
+  for( i = 0; i < max_detents; i++ )
+  {
+    if( !strncmp( sim->lcd[1], text, strlen( text ) ) )
+      return 1;
+
+    sim_turn( 1 );
+  }
+
+  return !strncmp( sim->lcd[1], text, strlen( text ) );
+}
+
+int sim_select( const char *text )
+{
+  if( !sim_turn_until( text, 40 ) )
+    return 0;
+
+  sim_short_press();
+
+  return 1;
+}
+
+void sim_connect( sim_chemistry chem, int cells, double capacity_mah, 
+                  double r0_ohm, double r1_ohm, double c1_farad )
+{
+  sim_battery_init( &sim->cell, chem, cells, capacity_mah, r0_ohm, r1_ohm, c1_farad );
+}
+
+sim_ina219 *sim_add_sensor( uint8_t address )
+{
+  sim_ina219 *d = &sim->sensor[sim->sensors++];
+
+  d->offset_uv = 0;
+  sim_ina219_init( d, address, SIM_SHUNT_OHM );
+  sim_twi_attach( d );
+
+  return d;
+}
+
+long sim_decode_telemetry( const char *prefix )
+{
+  const char *slash = strrchr( prefix, '/' );
+  char command[1024];
+  long bad = -1;
+  FILE *p;
+
+  /* The decoder sits beside the variant directories */
+  snprintf( command, sizeof( command ), 
+            "%.*s/../telemetry2csv %s.status.csv %s.sensors.csv > %s.samples.csv 2> %s.log", 
+            slash ? (int)( slash - prefix ) : 1, slash ? prefix : ".", 
+            prefix, prefix, prefix, prefix );
+
+  if( !( p = popen( command, "w" ) ) )
+    return -1;
+
+  fwrite( sim->tx, 1, sim->tx_len < SIM_TX_MAX ? sim->tx_len : SIM_TX_MAX, p );
+
+  if( pclose( p ) != 0 )
+    return -1;
+
+  snprintf( command, sizeof( command ), "%s.log", prefix );
+
+  if( ( p = fopen( command, "r" ) ) )
+  {
+    if( fscanf( p, "%ld bad frames", &bad ) != 1 )
+      bad = -1;
+    fclose( p );
+  }
+
+  return bad;
+}
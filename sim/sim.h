@@ -0,0 +1,147 @@
+/* 
+sim.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Host simulation of the Battery Buddy board. The firmware in Code/ is 
+ * built unchanged for the host, main loop included, against the register 
+ * stand-ins in sim/include. It runs as a coroutine: whenever it sleeps or 
+ * delays, the hardware models here run for a millisecond and call the 
+ * interrupts that come due, and once the time asked for by sim_run_ms has 
+ * passed control returns to the test.
+ *
+ * Everything that survives a reset, the EEPROM, the battery and the 
+ * totals, lives in memory shared between processes. A test that needs a 
+ * power cycle runs each boot in a forked child with sim_boot, so the 
+ * firmware always starts from its power-on statics */
+
+#ifndef SIM_H
+#define SIM_H
+
+/* Host structure layout, also in the tests, which are built with the 
+ * firmware's, see layout.h */
+#pragma pack(push, 8)
+
+#include <stdint.h>
+#include <avr/io.h>
+#include "battery.h"
+#include "ina219_dev.h"
+
+#define SIM_SENSORS_MAX 4
+#define SIM_SHUNT_OHM   0.03838 /* Stock shunt, matches C_INA219_CAL_DEFAULT */
+#define SIM_LOAD_SENSOR_ADDRESS 0x80 /* C_BOARD_INA219_0 */
+#define SIM_TX_MAX      ( 1UL << 20 ) /* USART bytes kept per boot */
+
+/* One op-amp / MOSFET load channel per PWM output. The op-amp servos the 
+ * sense voltage to the RC filtered PWM, so the current is proportional to 
+ * duty until the pack cannot push any more through the path resistance */
+typedef struct
+{
+  double full_scale_ma; /* At 100% duty */
+  double offset_ma;     /* Op-amp offset, may be negative */
+  double tau_ms;        /* PWM filter */
+  double path_ohm;      /* MOSFET, sense resistor, shunt and wiring */
+  double filtered[2];   /* Filter state, 0 - 1 */
+} sim_load_model;
+
+typedef struct
+{
+  uint8_t eeprom[E2END + 1];
+  sim_battery cell;
+  sim_load_model load;
+  sim_ina219 sensor[SIM_SENSORS_MAX]; /* sensor[0] is in the load path */
+  int sensors;                        /* On the bus */
+
+  uint32_t now_ms;                    /* Since this boot */
+  uint32_t total_ms;                  /* Across boots */
+  double load_ma;                     /* This millisecond */
+  double charge_mas;                  /* Taken from the cell, all boots */
+  double energy_mj;
+  unsigned long eeprom_writes;        /* Bytes programmed */
+  char lcd[2][17];
+
+  uint8_t tx[SIM_TX_MAX];             /* Sent on the USART this boot */
+  uint32_t tx_len;                    /* May pass SIM_TX_MAX, the rest is lost */
+} sim_world;
+
+extern sim_world *sim;
+
+/* Map the shared world and set up a default board: an erased EEPROM, one 
+ * INA219 and no battery. Call once, first thing */
+void sim_setup( void );
+
+/* Power on. Clears the registers and the per-boot state, the firmware 
+ * starts on the next sim_run_ms */
+void sim_power_on( void );
+
+/* Run a whole boot in a child process. fn gets the powered on board and 
+ * returns the child's exit code, or returns early to cut the power 
+ *   Returns the child's exit code, -1 if it crashed
+ */
+int sim_boot( int ( *fn )( void *arg ), void *arg );
+
+/* Let simulated time pass */
+void sim_run_ms( uint32_t ms );
+
+/* Let time pass with the main loop stopped, only interrupts run. For tests
+ * that drive firmware modules directly and never start the main loop */
+void sim_run_hardware_ms( uint32_t ms );
+
+/* Run until an LCD row contains text
+ *   Returns 1 if it appeared within max_ms
+ */
+int sim_run_until_lcd( const char *text, uint32_t max_ms );
+
+/* Front panel */
+void sim_press( uint32_t ms );            /* Press, hold and let go */
+void sim_short_press( void );
+void sim_long_press( void );
+void sim_turn( int detents );             /* Positive is clockwise */
+
+/* Turn clockwise until the second LCD row starts with text
+ *   Returns 1 if it got there within max_detents
+ */
+int sim_turn_until( const char *text, int max_detents );
+
+/* Turn to a menu entry on the second row and press to accept it
+ *   Returns 1 if the entry was found
+ */
+int sim_select( const char *text );
+
+const char *sim_lcd_line( int row );
+int sim_lcd_contains( const char *text );
+
+/* Connect a fresh pack */
+void sim_connect( sim_chemistry chem, int cells, double capacity_mah, 
+                  double r0_ohm, double r1_ohm, double c1_farad );
+
+/* Put another INA219 on the bus, measuring nothing until the test sets its 
+ * inputs
+ *   Returns the device
+ */
+sim_ina219 *sim_add_sensor( uint8_t address );
+
+/* Decode what the USART sent this boot with Tools/telemetry2csv, which the 
+ * Makefile builds in build/. Writes <prefix>.samples.csv, .status.csv and 
+ * .sensors.csv, the prefix being the test binary's path
+ *   Returns the number of bad frames, or -1 if the decoder did not run
+ */
+long sim_decode_telemetry( const char *prefix );
+
+#pragma pack(pop)
+
+#endif
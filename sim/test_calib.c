@@ -0,0 +1,139 @@
+/* 
+test_calib.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Calibration table storage. Drives the calibration sweep directly, main 
+ * loop stopped, with made up readings, and checks which table a later boot
+ * loads: none from a zeroed or an erased EEPROM, the new one once it is 
+ * written, and the previous one if the power goes while it is written */
+
+#include <string.h>
+#include "sim.h"
+#include "check.h"
+#include "types.h"
+#include "nvm.h"
+#include "load.h"
+#include "calib.h"
+
+#define TARGET_MA 500
+
+/* Readings per point, 0.1mA. The sweep stops once a point passes 
+ * C_CALIB_MAX_CURRENT, which at these gains is near the end */
+#define TABLE_A ( 1000 * C_LOAD_CHANNELS )
+#define TABLE_B ( 800 * C_LOAD_CHANNELS )
+
+typedef enum
+{
+  CALIB_EMPTY,
+  CALIB_A,
+  CALIB_B
+} calib_table;
+
+typedef struct
+{
+  calib_table write;   /* Sweep to run, CALIB_EMPTY for none */
+  int cut;             /* Cut the power while the table is written */
+  calib_table expect;  /* Table the boot must have loaded */
+  const char *when;
+} calib_case;
+
+/* Duty the feed-forward gives for TARGET_MA from a table */
+static uint16 expected_duty( calib_table table )
+{
+  if( table == CALIB_EMPTY )
+    return (uint16)( (uint32_t)TARGET_MA * ( C_LOAD_PWM_TOP + 1 ) / ( 1094UL * C_LOAD_CHANNELS ) );
+
+  return (uint16)( (uint32_t)TARGET_MA * 10 * C_CALIB_DUTY_STEP / 
+                   ( table == CALIB_A ? TABLE_A : TABLE_B ) );
+}
+
+/* Feed the sweep a reading proportional to the duty of each point */
+static CalibStatusEnumType sweep( calib_table table )
+{
+  uint16 w_PerStep = table == CALIB_A ? TABLE_A : TABLE_B;
+  CalibStatusEnumType e_Status;
+
+  CalibStart();
+
+  do
+    e_Status = CalibProcess( ( CalibGetStep() + 1 ) * w_PerStep );
+  while( e_Status == CALIB_RUNNING );
+
+  return e_Status;
+}
+
+static int run( void *arg )
+{
+  const calib_case *c = arg;
+  uint8 u_Valid = CalibReadEEPROM();
+  uint16 w_Duty = CalibFeedForward( TARGET_MA );
+
+  CHECK( u_Valid == ( c->expect != CALIB_EMPTY ), "%s: table %s", c->when, u_Valid ? "loaded" : "rejected" );
+  CHECK( w_Duty >= expected_duty( c->expect ) - 1 && w_Duty <= expected_duty( c->expect ) + 1, 
+         "%s: feed-forward %u for %umA, expected %u", c->when, w_Duty, TARGET_MA, 
+         expected_duty( c->expect ) );
+
+  if( c->write == CALIB_EMPTY )
+    return check_boot_failures();
+
+  CHECK( sweep( c->write ) == CALIB_DONE, "%s: sweep failed", c->when );
+  CHECK( CalibFeedForward( TARGET_MA ) == expected_duty( c->write ) ||
+         CalibFeedForward( TARGET_MA ) == expected_duty( c->write ) + 1, 
+         "%s: feed-forward %u after the sweep", c->when, CalibFeedForward( TARGET_MA ) );
+
+  /* The first bytes of the record are programmed, the rest are not */
+  if( c->cut )
+  {
+    sim_run_hardware_ms( 10 );
+    return check_boot_failures();
+  }
+
+  while( NvmBusy() )
+    sim_run_hardware_ms( 1 );
+
+  return check_boot_failures();
+}
+
+int main( void )
+{
+  static const calib_case cases[] =
+  {
+    { CALIB_EMPTY, 0, CALIB_EMPTY, "zeroed" },
+    { CALIB_EMPTY, 0, CALIB_EMPTY, "erased" },
+    { CALIB_A,     0, CALIB_EMPTY, "first sweep" },
+    { CALIB_B,     1, CALIB_A,     "second sweep, cut short" },
+    { CALIB_B,     0, CALIB_A,     "second sweep again" },
+    { CALIB_EMPTY, 0, CALIB_B,     "after the second sweep" }
+  };
+  unsigned i;
+
+  sim_setup();
+
+  for( i = 0; i < sizeof( cases ) / sizeof( cases[0] ); i++ )
+  {
+    /* An all zero EEPROM used to pass the XOR checksum */
+    if( i == 0 )
+      memset( sim->eeprom, 0x00, sizeof( sim->eeprom ) );
+    if( i == 1 )
+      memset( sim->eeprom, 0xFF, sizeof( sim->eeprom ) );
+
+    check_boot( run, (void *)&cases[i] );
+  }
+
+  return check_report( C_LOAD_CHANNELS > 1 ? "test_calib ( 2 channels )" : "test_calib" );
+}
@@ -0,0 +1,119 @@
+/* 
+test_capacity.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Coulomb counting. Full discharges at low and high current, each compared
+ * with the charge the cell model actually delivered, pulses included, and 
+ * with the analytic capacity down to the cutoff voltage */
+
+#include <math.h>
+#include "sim.h"
+#include "check.h"
+#include "common.h"
+#include "history.h"
+#include "sample.h"
+
+typedef struct
+{
+  sim_chemistry chem;
+  const char *type;
+  int cells;
+  const char *cells_text;
+  double capacity_mah;
+  const char *current_text;
+  double current_ma;
+  double cutoff_mv;       /* Per cell */
+} discharge_case;
+
+static const discharge_case cases[] =
+{
+  { SIM_CHEM_NIMH, "NIMH", 4, "4",  40.0, "50mA",    50.0,  900.0 },
+  { SIM_CHEM_LIPO, "LiPo", 1, "1", 120.0, "100mA",  100.0, 3000.0 },
+  { SIM_CHEM_NIMH, "NIMH", 6, "6", 200.0, "1000mA", 1000.0,  900.0 }
+};
+
+#define CASES ( sizeof( cases ) / sizeof( cases[0] ) )
+
+static int discharge( void *arg )
+{
+  const discharge_case *c = arg;
+  uint8 u_History;
+  uint32_t limit_ms;
+  double firmware_mas;
+  double model_mas;
+  double analytic_mas;
+  double seconds;
+  sim_battery fresh = sim->cell;
+
+  CHECK( sim_run_until_lcd( "Mode:", 5000 ), "no mode menu" );
+  /* The firmware has found the records from the earlier cases */
+  u_History = HistoryCount();
+  CHECK( sim_select( "Full Discharge" ), "mode" );
+  CHECK( sim_select( c->type ), "type" );
+  CHECK( sim_select( c->cells_text ), "cells" );
+  CHECK( sim_select( c->current_text ), "current" );
+
+  limit_ms = sim->now_ms + (uint32_t)( c->capacity_mah * 3600.0 / c->current_ma * 1500.0 );
+
+  while( HistoryCount() == u_History && sim->now_ms < limit_ms )
+    sim_run_ms( 5000 );
+
+  CHECK( HistoryCount() != u_History, "%s %dS at %s did not finish", c->type, c->cells, c->current_text );
+
+  firmware_mas = z_Status.w_CapacityDischarged * 3600.0 + z_Status.w_CapacityRemainder + 
+                 z_Status.w_CapacityFraction / (double)C_CHARGE_UNITS_PER_MAS;
+  model_mas = sim->charge_mas;
+  seconds = z_Status.u_Hours * 3600.0 + z_Status.u_Minutes * 60.0 + z_Status.u_Seconds;
+  analytic_mas = sim_battery_capacity_to( &fresh, c->current_ma, c->cutoff_mv * c->cells );
+
+  printf( "capacity: %s %dS %4.0fmA: firmware %8.3f mAh, model %8.3f mAh, analytic %8.3f mAh\n", 
+          c->type, c->cells, c->current_ma, firmware_mas / 3600.0, model_mas / 3600.0, 
+          analytic_mas / 3600.0 );
+
+  /* The counter sees every conversion, so it tracks the charge the pack 
+   * really gave up, IR pulses and the start-up included. What is left is 
+   * the INA219 current register, which truncates to its 0.1mA LSB */
+  CHECK( fabs( firmware_mas - model_mas ) <= 0.1 * seconds + model_mas * 0.0005, 
+         "firmware %.3f mAh, model %.3f mAh", firmware_mas / 3600.0, model_mas / 3600.0 );
+
+  /* Cutoff is checked once a second on a settled, loaded voltage */
+  CHECK( fabs( model_mas - analytic_mas ) <= analytic_mas * 0.01 + 3.6, 
+         "model %.3f mAh, analytic %.3f mAh", model_mas / 3600.0, analytic_mas / 3600.0 );
+
+  return check_boot_failures();
+}
+
+int main( void )
+{
+  unsigned i;
+
+  sim_setup();
+
+  for( i = 0; i < CASES; i++ )
+  {
+    const discharge_case *c = &cases[i];
+
+    sim_connect( c->chem, c->cells, c->capacity_mah, 0.03 * c->cells, 0.015 * c->cells, 2000.0 );
+    sim->charge_mas = 0;
+    sim->energy_mj = 0;
+
+    check_boot( discharge, (void *)c );
+  }
+
+  return check_report( "test_capacity" );
+}
@@ -0,0 +1,124 @@
+/* 
+test_control.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Current regulator benchmark. Starts constant current discharges and 
+ * measures, from the moment the load comes on, how long the current takes
+ * to settle into a 1% band and how far it then overshoots the setpoint. 
+ * The load model reads 4% high against the nominal feed-forward, so the 
+ * regulator has real work to do. Built for the one and the two channel 
+ * board */
+
+#include <math.h>
+#include "sim.h"
+#include "check.h"
+#include "load.h"
+
+#define RECORD_MS   3000
+#define SETTLE_MAX_MS 150
+#define SETTLE_PROBE_MS 25  /* Filter settled, no regulator update yet */
+
+typedef struct
+{
+  const char *current_text;
+  double current_ma;
+} control_case;
+
+static const control_case cases[] =
+{
+  { "100mA",   100.0 },
+  { "500mA",   500.0 },
+  { "1000mA", 1000.0 }
+};
+
+#define CASES ( sizeof( cases ) / sizeof( cases[0] ) )
+
+static double trace[RECORD_MS];
+
+static int regulate( void *arg )
+{
+  const control_case *c = arg;
+  double band = c->current_ma * 0.01 > 1.0 ? c->current_ma * 0.01 : 1.0;
+  double initial;
+  double overshoot = 0;
+  int crossed_ms = -1;
+  int settled_ms = 0;
+  int start_ms;
+  int i;
+
+  CHECK( sim_run_until_lcd( "Mode:", 5000 ), "no mode menu" );
+  CHECK( sim_select( "Full Discharge" ), "mode" );
+  CHECK( sim_select( "NIMH" ), "type" );
+  CHECK( sim_select( "4" ), "cells" );
+  CHECK( sim_select( c->current_text ), "current" );
+
+  /* Wait for the 1Hz tick to find the pack and switch the load on */
+  for( start_ms = 0; start_ms < 3000 && sim->load_ma < c->current_ma * 0.1; start_ms++ )
+    sim_run_ms( 1 );
+
+  for( i = 0; i < RECORD_MS; i++ )
+  {
+    trace[i] = sim->load_ma;
+    sim_run_ms( 1 );
+  }
+
+  /* What the feed-forward alone gives, once the PWM filter has settled 
+   * and before the first regulator update */
+  initial = trace[SETTLE_PROBE_MS];
+
+  for( i = 0; i < RECORD_MS; i++ )
+  {
+    double error = trace[i] - c->current_ma;
+
+    /* Overshoot is past the setpoint, on the far side from where it started */
+    if( crossed_ms < 0 && i >= SETTLE_PROBE_MS && 
+        ( initial > c->current_ma ? error <= 0 : error >= 0 ) )
+      crossed_ms = i;
+
+    if( crossed_ms >= 0 && fabs( error ) > overshoot && 
+        ( initial > c->current_ma ? error < 0 : error > 0 ) )
+      overshoot = fabs( error );
+
+    if( fabs( error ) > band )
+      settled_ms = i + 1;
+  }
+
+  printf( "control: %d channel%s %6.0fmA: feed-forward %+5.1f%%, settles to +-%.1fmA in %3d ms, "
+          "overshoot %.2fmA\n", C_LOAD_CHANNELS, C_LOAD_CHANNELS > 1 ? "s" : " ", c->current_ma, 
+          ( initial - c->current_ma ) * 100.0 / c->current_ma, band, settled_ms, overshoot );
+
+  CHECK( settled_ms <= SETTLE_MAX_MS, "%.0fmA took %d ms to settle", c->current_ma, settled_ms );
+  CHECK( overshoot <= band, "%.0fmA overshoots by %.2fmA", c->current_ma, overshoot );
+
+  return check_boot_failures();
+}
+
+int main( void )
+{
+  unsigned i;
+
+  sim_setup();
+
+  for( i = 0; i < CASES; i++ )
+  {
+    sim_connect( SIM_CHEM_NIMH, 4, 2000.0, 0.12, 0.06, 2000.0 );
+    check_boot( regulate, (void *)&cases[i] );
+  }
+
+  return check_report( C_LOAD_CHANNELS > 1 ? "test_control ( 2 channels )" : "test_control" );
+}
@@ -0,0 +1,99 @@
+/* 
+test_discharge.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* End to end: set up a full discharge through the front panel, let the 
+ * firmware take a small 4 cell NiMH pack down to cutoff and check what it 
+ * measured and logged against the cell model */
+
+#include <math.h>
+#include <time.h>
+#include "sim.h"
+#include "check.h"
+#include "common.h"
+#include "history.h"
+
+#define CAPACITY_MAH 150.0
+#define CURRENT_MA   500
+
+static int discharge( void *arg )
+{
+  HistoryRecordType z_Record;
+  double model_mah;
+  uint32_t limit_ms;
+
+  (void)arg;
+
+  /* Banner, then the mode menu */
+  CHECK( sim_run_until_lcd( "Mode:", 5000 ), "no mode menu: '%s'", sim_lcd_line( 0 ) );
+
+  CHECK( sim_select( "Full Discharge" ), "mode" );
+  CHECK( sim_select( "NIMH" ), "type" );
+  CHECK( sim_select( "4" ), "cells" );
+  CHECK( sim_select( "500mA" ), "current" );
+
+  /* The 1Hz tick finds the pack and starts the load */
+  sim_run_ms( 3000 );
+  CHECK( fabs( sim->load_ma - CURRENT_MA ) < CURRENT_MA * 0.02, 
+         "load %.1fmA after start", sim->load_ma );
+
+  limit_ms = sim->now_ms + (uint32_t)( CAPACITY_MAH * 3600.0 / CURRENT_MA * 1500.0 );
+
+  while( !HistoryCount() && sim->now_ms < limit_ms )
+    sim_run_ms( 5000 );
+
+  CHECK( HistoryCount() == 1, "discharge did not finish in %u s", sim->now_ms / 1000 );
+  CHECK( HistoryRead( 0, &z_Record ), "history record" );
+
+  model_mah = sim->charge_mas / 3600.0;
+
+  printf( "discharge: firmware %u mAh, %u.%02u Wh, model %.1f mAh %.3f Wh, %u:%02u:%02u\n",
+          z_Status.w_CapacityDischarged, z_Status.w_EnergyDischarged / 100, 
+          z_Status.w_EnergyDischarged % 100, model_mah, sim->energy_mj / 3.6e6,
+          z_Status.u_Hours, z_Status.u_Minutes, z_Status.u_Seconds );
+
+  CHECK( fabs( z_Status.w_CapacityDischarged - model_mah ) <= 1.0 + model_mah * 0.01, 
+         "capacity %u mAh, model %.1f mAh", z_Status.w_CapacityDischarged, model_mah );
+  CHECK( z_Record.w_Capacity == z_Status.w_CapacityDischarged, "logged %u mAh", z_Record.w_Capacity );
+  CHECK( z_Record.w_EndVoltage < 4 * 900, "end voltage %u mV", z_Record.w_EndVoltage );
+  CHECK( z_Record.w_DischargeCurrent == CURRENT_MA, "logged %u mA", z_Record.w_DischargeCurrent );
+
+  /* The load is let go a second after the finish */
+  sim_run_ms( 3000 );
+  CHECK( sim->load_ma == 0, "load %.1fmA after finish", sim->load_ma );
+
+  return check_boot_failures();
+}
+
+int main( void )
+{
+  struct timespec start, end;
+
+  clock_gettime( CLOCK_MONOTONIC, &start );
+
+  sim_setup();
+  sim_connect( SIM_CHEM_NIMH, 4, CAPACITY_MAH, 0.12, 0.06, 2000.0 );
+
+  check_boot( discharge, NULL );
+  clock_gettime( CLOCK_MONOTONIC, &end );
+
+  printf( "discharge: %.1f s simulated in %.2f s\n", sim->total_ms / 1000.0, 
+          ( end.tv_sec - start.tv_sec ) + ( end.tv_nsec - start.tv_nsec ) / 1e9 );
+
+  return check_report( "test_discharge" );
+}
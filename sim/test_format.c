@@ -0,0 +1,144 @@
+/* 
+test_format.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Exhaustive equivalence of FormatNumber with the division based 
+ * StateDisplayNumber it replaced: every uint16 value, every field size the
+ * firmware allows, every number of decimals including the rejected ones, 
+ * and both fill characters. Field sizes above C_FORMAT_FIELD_MAX, where 
+ * the old routine overflowed its divisor, are rejected by the new one and 
+ * not compared */
+
+#include <string.h>
+#include "check.h"
+#include "types.h"
+#include "format.h"
+
+static char reference[16];
+static char *reference_end;
+
+static void reference_putc( char c )
+{
+  *reference_end++ = c;
+}
+
+/* StateDisplayNumber as it was, printing into reference[] */
+static void reference_number( uint16 w_Number, uint8 u_FieldSize, 
+                              uint8 u_DigitsAfterDecimal, char u_FillChar )
+{
+  uint16 w_Temp;
+  uint16 w_Divisor = 1;
+  uint8 u_Count;
+  uint8 u_DecimalPlaceIndex = 0;
+  uint8 u_NonZeroDigitFound = FALSE;
+
+  reference_end = reference;
+  *reference_end = 0;
+
+  if( u_FieldSize > 8 || u_DigitsAfterDecimal > u_FieldSize - 2 )
+    return;
+
+  if( u_DigitsAfterDecimal )
+  {
+    u_DecimalPlaceIndex = u_FieldSize - u_DigitsAfterDecimal - 1;
+  }
+
+  for( u_Count = 1; u_Count < u_FieldSize; u_Count++ )
+  {
+    w_Divisor *= 10;
+  }
+
+  for( u_Count = 0; u_Count < u_FieldSize; u_Count++ )  
+  {
+    if( u_DigitsAfterDecimal && ( u_Count == u_DecimalPlaceIndex ) )
+    {
+      reference_putc('.');
+      u_NonZeroDigitFound = TRUE;
+    }
+    else
+    {
+      w_Temp = w_Number / w_Divisor;
+
+      if( w_Temp )
+      {
+        reference_putc( (uint8)w_Temp + 48 );
+        w_Number -= w_Temp * w_Divisor;
+        u_NonZeroDigitFound = TRUE;
+      }
+      else
+      {
+        if( !u_NonZeroDigitFound )
+        {
+          if( u_Count + 1 == u_DecimalPlaceIndex )
+          {
+            reference_putc('0');
+          }
+          else
+          {
+            if( u_Count == u_FieldSize - 1 )
+              reference_putc('0');
+            else
+              reference_putc( u_FillChar );
+          }
+        }
+        else
+        {
+          reference_putc('0');
+        }
+      }
+
+      w_Divisor /= 10;
+    }
+  }
+
+  *reference_end = 0;
+}
+
+int main( void )
+{
+  static const char fills[] = { ' ', '0' };
+  char buffer[C_FORMAT_FIELD_MAX + 1];
+  unsigned long cases = 0;
+  uint32_t number;
+  uint8 u_Field;
+  uint8 u_Decimals;
+  unsigned fill;
+
+  for( u_Field = 0; u_Field <= C_FORMAT_FIELD_MAX; u_Field++ )
+    for( u_Decimals = 0; u_Decimals <= C_FORMAT_FIELD_MAX; u_Decimals++ )
+      for( fill = 0; fill < sizeof( fills ); fill++ )
+        for( number = 0; number <= 0xFFFF; number++ )
+        {
+          memset( buffer, 'x', sizeof( buffer ) );
+          FormatNumber( buffer, number, u_Field, u_Decimals, fills[fill] );
+          reference_number( number, u_Field, u_Decimals, fills[fill] );
+          cases++;
+
+          /* Stop at the first mismatch of each layout */
+          if( strcmp( buffer, reference ) )
+          {
+            CHECK( 0, "%u in %u with %u decimals, fill '%c': \"%s\", was \"%s\"", 
+                   number, u_Field, u_Decimals, fills[fill], buffer, reference );
+            break;
+          }
+        }
+
+  printf( "format: %lu cases compared\n", cases );
+
+  return check_report( "test_format" );
+}
@@ -0,0 +1,235 @@
+/* 
+test_history.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* History ring unit test. Drives the history module directly, main loop 
+ * stopped, through several wraps of the ring and of the sequence number.
+ * After every append the cached newest slot and count must agree with a 
+ * fresh scan of the EEPROM, and a power cut in the middle of a write, or
+ * a slot gone bad anywhere in the ring, must only cost that slot */
+
+#include <string.h>
+#include "sim.h"
+#include "nvmap.h"
+#include "check.h"
+#include "types.h"
+#include "nvm.h"
+#include "history.h"
+
+#define SLOTS C_HISTORY_SLOTS
+
+/* Records appended over all boots, the capacity field numbers them */
+static int appended;
+
+static void wait_written( void )
+{
+  while( NvmBusy() )
+    sim_run_hardware_ms( 1 );
+}
+
+static void append( void )
+{
+  HistoryRecordType z_Record;
+
+  memset( &z_Record, 0, sizeof( z_Record ) );
+  z_Record.w_Capacity = appended + 1;
+  HistoryAppend( &z_Record );
+  appended++;
+}
+
+/* What the ring must hold, newest record first, given how many there are */
+static void check_contents( int count, int newest, const char *when )
+{
+  HistoryRecordType z_Record;
+  int i;
+
+  CHECK( HistoryCount() == count, "%s: %d records, expected %d", when, HistoryCount(), count );
+
+  for( i = 0; i < count; i++ )
+  {
+    CHECK( HistoryRead( i, &z_Record ), "%s: record %d unreadable", when, i );
+    CHECK( z_Record.w_Capacity == newest - i, "%s: record %d is #%u, expected #%d", 
+           when, i, z_Record.w_Capacity, newest - i );
+  }
+
+  CHECK( !HistoryRead( count, &z_Record ), "%s: record past the end readable", when );
+}
+
+/* The cache kept by HistoryAppend against a fresh scan of the EEPROM */
+static void check_cache( const char *when )
+{
+  HistoryRecordType z_Cached;
+  HistoryRecordType z_Scanned;
+  uint8 u_Cached = HistoryCount();
+  uint8 u_CachedValid = HistoryRead( 0, &z_Cached );
+
+  wait_written();
+  HistoryInit();
+
+  CHECK( HistoryCount() == u_Cached, "%s: cached %d records, scan finds %d", 
+         when, u_Cached, HistoryCount() );
+  CHECK( HistoryRead( 0, &z_Scanned ) == u_CachedValid && 
+         ( !u_CachedValid || z_Scanned.w_Capacity == z_Cached.w_Capacity ),
+         "%s: cached newest #%u, scan finds #%u", when, z_Cached.w_Capacity, z_Scanned.w_Capacity );
+}
+
+/* One boot: append records and check after each */
+static int fill( void *arg )
+{
+  int records = *(int *)arg;
+  int i;
+
+  HistoryInit();
+  check_contents( appended < SLOTS ? appended : SLOTS, appended, "after boot" );
+
+  for( i = 0; i < records; i++ )
+  {
+    append();
+    check_contents( appended < SLOTS ? appended : SLOTS, appended, "after append" );
+    check_cache( "after append" );
+    check_contents( appended < SLOTS ? appended : SLOTS, appended, "after rescan" );
+  }
+
+  wait_written();
+
+  return check_boot_failures();
+}
+
+/* One boot that loses power 10ms into an append, with the first bytes of 
+ * the record programmed and the rest not */
+static int cut( void *arg )
+{
+  (void)arg;
+
+  HistoryInit();
+  append();
+  sim_run_hardware_ms( 10 );
+  appended--;
+
+  return check_boot_failures();
+}
+
+/* After the cut the interrupted record is gone, and so is the oldest it 
+ * was overwriting. The next append reuses the slot */
+static int after_cut( void *arg )
+{
+  (void)arg;
+
+  HistoryInit();
+  check_contents( SLOTS - 1, appended, "after power cut" );
+
+  append();
+  check_contents( SLOTS, appended, "append after power cut" );
+  check_cache( "append after power cut" );
+  wait_written();
+
+  return check_boot_failures();
+}
+
+/* A write dropped because the queue is full leaves the ring and the cache
+ * as they were */
+static int dropped( void *arg )
+{
+  HistoryRecordType z_Record;
+  uint8 a_Data[C_NVM_BUFFER_SIZE];
+  int i;
+
+  (void)arg;
+
+  HistoryInit();
+
+  /* Fill the queue with writes that change nothing */
+  NvmRead( 0, a_Data, sizeof( a_Data ) );
+  for( i = 0; i < C_NVM_QUEUE_SIZE; i++ )
+    CHECK( NvmWrite( 0, a_Data, sizeof( a_Data ) ), "filler write %d queued", i );
+
+  memset( &z_Record, 0, sizeof( z_Record ) );
+  z_Record.w_Capacity = 0xBAD;
+  HistoryAppend( &z_Record );
+
+  check_contents( SLOTS, appended, "after dropped append" );
+  check_cache( "after dropped append" );
+
+  return check_boot_failures();
+}
+
+/* A bad slot in the middle of the ring, two past the newest record, so 
+ * the valid record before it is not the newest and is scanned after it. 
+ * The newest must still be found, the next append must go after it and 
+ * the count must allow for the hole */
+static int corrupt_middle( void *arg )
+{
+  HistoryRecordType z_Record;
+  int newest;
+  int bad;
+
+  (void)arg;
+
+  HistoryInit();
+
+  while( ( appended - 1 ) % SLOTS != 3 )
+  {
+    append();
+    wait_written();
+  }
+
+  newest = ( appended - 1 ) % SLOTS;
+  bad = newest + 2;
+
+  sim->eeprom[C_NVM_ADDR_HISTORY + bad * sizeof( HistoryRecordType ) + 1] ^= 0x01;
+
+  HistoryInit();
+  CHECK( HistoryCount() == SLOTS - 1, "%d records with slot %d bad", HistoryCount(), bad );
+  CHECK( HistoryRead( 0, &z_Record ) && z_Record.w_Capacity == appended, 
+         "newest is #%u, expected #%d", z_Record.w_Capacity, appended );
+
+  append();
+  CHECK( HistoryRead( 0, &z_Record ) && z_Record.w_Capacity == appended, 
+         "appended #%u, expected #%d", z_Record.w_Capacity, appended );
+  CHECK( HistoryRead( 1, &z_Record ) && z_Record.w_Capacity == appended - 1, 
+         "before it #%u, expected #%d", z_Record.w_Capacity, appended - 1 );
+  check_cache( "append after bad slot" );
+
+  return check_boot_failures();
+}
+
+int main( void )
+{
+  /* Fill part way, to exactly full, just past the wrap, then far enough 
+   * to take the sequence number through 255 */
+  static const int boots[] = { 0, 5, SLOTS - 5, 1, 30, 240 };
+  unsigned i;
+
+  sim_setup();
+
+  for( i = 0; i < sizeof( boots ) / sizeof( boots[0] ); i++ )
+  {
+    check_boot( fill, (void *)&boots[i] );
+    appended += boots[i];
+  }
+
+  check_boot( cut, NULL );
+  check_boot( after_cut, NULL );
+  appended++;
+
+  check_boot( dropped, NULL );
+
+  check_boot( corrupt_middle, NULL );
+
+  return check_report( "test_history" );
+}
@@ -0,0 +1,268 @@
+/* 
+test_profile.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Profile replay. Runs the built-in profiles and a user profile in EEPROM
+ * that uses every step type and end condition, through the front panel, 
+ * and logs each step as it runs. Every step is then checked against its 
+ * own definition: the load it held and the condition it ended on, and 
+ * the capacity counted against the model. The knee profile runs again on
+ * a sensor and load whose offsets are negative, so the rests read slightly
+ * below zero */
+
+#include <string.h>
+#include <math.h>
+#include <util/crc16.h>
+#include "sim.h"
+#include "check.h"
+#include "nvmap.h"
+#include "history.h"
+#include "profile.h"
+#include "common.h"
+
+#define CELLS        4
+#define CUTOFF_MV    ( CELLS * 900 )  /* NIMH full discharge */
+#define CURRENT_MA   500
+#define CAPACITY_MAH 200.0
+#define LEVEL_BAND   0.02             /* Of the setting, over the step */
+#define REST_MV      1295             /* Per cell, reached part way through the recovery */
+
+#define STEP( step, setpoint, end, value ) \
+  { C_PROFILE_TYPE( PROFILE_STEP_##step, PROFILE_END_##end ), setpoint, value }
+
+typedef struct
+{
+  const char *name;          /* Profile menu entry */
+  ProfileType profile;       /* Built-ins as in profile.c, user as written */
+  double offset_uv;          /* Load sensor shunt offset */
+  double offset_ma;          /* Load op-amp offset */
+} profile_case;
+
+static const profile_case cases[] =
+{
+  { "Knee Capacity", { 0, 5, { STEP( CC, 100, VOLTAGE, 0 ), STEP( REST, 0, TIME, 120 ),
+                               STEP( CC, 50, VOLTAGE, 0 ), STEP( REST, 0, TIME, 120 ),
+                               STEP( CC, 20, VOLTAGE, 0 ) }, 0 }, 0, 2.0 },
+  { "Load Steps",    { 0, 4, { STEP( CC, 20, TIME, 600 ), STEP( CC, 100, TIME, 600 ),
+                               STEP( REST, 0, TIME, 300 ), STEP( CC, 100, VOLTAGE, 0 ) }, 0 }, 0, 2.0 },
+  { "Knee Capacity", { 0, 5, { STEP( CC, 100, VOLTAGE, 0 ), STEP( REST, 0, TIME, 120 ),
+                               STEP( CC, 50, VOLTAGE, 0 ), STEP( REST, 0, TIME, 120 ),
+                               STEP( CC, 20, VOLTAGE, 0 ) }, 0 }, -20.0, -2.0 },
+  { "User",          { 0, 5, { STEP( CP, 30, CAPACITY, 20 ), STEP( CR, 100, TIME, 60 ),
+                               STEP( REST, 0, VOLTAGE, REST_MV ), STEP( CR, 100, CURRENT, 470 ),
+                               STEP( CC, 100, VOLTAGE, 0 ) }, 0 }, 0, 2.0 }
+};
+
+#define CASES ( sizeof( cases ) / sizeof( cases[0] ) )
+
+/* What one step did */
+typedef struct
+{
+  double ms;
+  double sum_ma;        /* Over the settled part */
+  double sum_mw;
+  double sum_error_ma;  /* Current less V / R, for resistance steps */
+  double settled_ms;
+  double start_mas;
+  double charge_mas;
+  double end_mv;        /* Terminal voltage and current at the end */
+  double end_ma;
+} step_log;
+
+static step_log steps[C_PROFILE_STEPS_MAX];
+
+/* Write the user profile the way Tools/profile2hex.c lays it out */
+static void program_user( const ProfileType *p_Profile )
+{
+  ProfileType z_Image = *p_Profile;
+  uint8_t *p_Byte = (uint8_t *)&z_Image;
+  uint16_t w_Crc = 0xFFFF;
+  unsigned i;
+
+  for( i = 0; i < sizeof( z_Image ) - sizeof( w_Crc ); i++ )
+    w_Crc = _crc_ccitt_update( w_Crc, p_Byte[i] );
+
+  z_Image.w_Crc = w_Crc;
+  memcpy( &sim->eeprom[C_NVM_ADDR_PROFILE], &z_Image, sizeof( z_Image ) );
+}
+
+/* Check one logged step against its definition */
+static void check_step( const profile_case *c, int i )
+{
+  const ProfileStepType *s = &c->profile.a_Step[i];
+  const step_log *l = &steps[i];
+  double mean_ma = l->settled_ms ? l->sum_ma / l->settled_ms : 0;
+  double mean_mw = l->settled_ms ? l->sum_mw / l->settled_ms : 0;
+  double target;
+  double end;
+
+  switch( s->u_Type >> 4 )
+  {
+    case PROFILE_STEP_CC:
+      target = CURRENT_MA * s->w_Setpoint / 100.0;
+      CHECK( fabs( mean_ma - target ) <= target * LEVEL_BAND, "%s step %d: %.1fmA, set %.1fmA", 
+             c->name, i + 1, mean_ma, target );
+      break;
+
+    case PROFILE_STEP_CP:
+      target = s->w_Setpoint * 100.0;
+      CHECK( fabs( mean_mw - target ) <= target * LEVEL_BAND, "%s step %d: %.0fmW, set %.0fmW", 
+             c->name, i + 1, mean_mw, target );
+      break;
+
+    case PROFILE_STEP_CR:
+      CHECK( fabs( l->sum_error_ma ) <= l->sum_ma * LEVEL_BAND, "%s step %d: %.1fmA off V / R on average", 
+             c->name, i + 1, l->sum_error_ma / l->settled_ms );
+      break;
+
+    default:
+      CHECK( mean_ma <= fmax( sim->load.offset_ma, 0 ) + 0.5, "%s step %d: %.1fmA while resting", 
+             c->name, i + 1, mean_ma );
+      break;
+  }
+
+  switch( s->u_Type & 0x0F )
+  {
+    case PROFILE_END_VOLTAGE:
+      end = s->w_End ? s->w_End * CELLS : CUTOFF_MV;
+
+      /* Found on the conversion after the crossing */
+      if( ( s->u_Type >> 4 ) == PROFILE_STEP_REST )
+        CHECK( l->end_mv >= end - 10 && l->end_mv <= end + 100, "%s step %d: rest ended at %.0fmV, "
+               "set %.0fmV", c->name, i + 1, l->end_mv, end );
+      else
+        CHECK( l->end_mv <= end + 10 && l->end_mv >= end - 100, "%s step %d: ended at %.0fmV, "
+               "set %.0fmV", c->name, i + 1, l->end_mv, end );
+      break;
+
+    case PROFILE_END_TIME:
+      CHECK( fabs( l->ms - s->w_End * 1000.0 ) <= 100, "%s step %d: ran %.0fms, set %us", 
+             c->name, i + 1, l->ms, s->w_End );
+      break;
+
+    case PROFILE_END_CAPACITY:
+      CHECK( fabs( l->charge_mas / 3600.0 - s->w_End ) <= s->w_End * 0.01 + 0.1, 
+             "%s step %d: took %.2fmAh, set %umAh", c->name, i + 1, l->charge_mas / 3600.0, s->w_End );
+      break;
+
+    case PROFILE_END_CURRENT:
+      CHECK( l->end_ma <= s->w_End && l->end_ma >= s->w_End * 0.97, 
+             "%s step %d: ended at %.1fmA, set %umA", c->name, i + 1, l->end_ma, s->w_End );
+      break;
+  }
+}
+
+static int replay( void *arg )
+{
+  const profile_case *c = arg;
+  double model_mah;
+  int history;
+  int step = 0;
+  int i;
+
+  CHECK( sim_run_until_lcd( "Mode:", 5000 ), "no mode menu" );
+  history = HistoryCount();
+
+  CHECK( sim_select( "Profile" ), "mode" );
+  CHECK( sim_select( c->name ), "profile %s", c->name );
+  CHECK( sim_select( "NIMH" ), "type" );
+  CHECK( sim_select( "4" ), "cells" );
+  CHECK( sim_select( "500mA" ), "current" );
+
+  /* The 1Hz tick finds the pack and starts the first step */
+  for( i = 0; i < 3000 && sim->load_ma < 10; i++ )
+    sim_run_ms( 1 );
+
+  memset( steps, 0, sizeof( steps ) );
+  steps[0].start_mas = sim->charge_mas;
+
+  /* Log every millisecond against the step the firmware is running */
+  while( HistoryCount() == history && sim->now_ms < 6 * 3600000UL )
+  {
+    step_log *l;
+    double v;
+
+    sim_run_ms( 1 );
+
+    if( ProfileGetStep() != step && ProfileGetStep() < ProfileGetStepCount() )
+    {
+      step = ProfileGetStep();
+      steps[step].start_mas = sim->charge_mas;
+    }
+
+    l = &steps[step];
+    v = sim_battery_voltage( &sim->cell, sim->load_ma );
+
+    l->ms++;
+    l->charge_mas = sim->charge_mas - l->start_mas;
+    l->end_mv = v;
+    l->end_ma = sim->load_ma;
+
+    if( l->ms > C_PROFILE_SETTLE_MS )
+    {
+      l->settled_ms++;
+      l->sum_ma += sim->load_ma;
+      l->sum_mw += sim->load_ma * v / 1000.0;
+      l->sum_error_ma += sim->load_ma - v * 10.0 / c->profile.a_Step[step].w_Setpoint;
+    }
+  }
+
+  CHECK( HistoryCount() != history, "%s did not finish", c->name );
+  CHECK( step == c->profile.u_Steps - 1, "%s finished in step %d of %u", c->name, step + 1, 
+         c->profile.u_Steps );
+
+  model_mah = ( sim->charge_mas - steps[0].start_mas ) / 3600.0;
+
+  printf( "profile: %s, offset %.0fuV %.0fmA, firmware %u mAh, model %.1f mAh\n", c->name, 
+          c->offset_uv, c->offset_ma, z_Status.w_CapacityDischarged, model_mah );
+
+  CHECK( fabs( z_Status.w_CapacityDischarged - model_mah ) <= 1.0 + model_mah * 0.01, 
+         "%s capacity %u mAh, model %.1f mAh", c->name, z_Status.w_CapacityDischarged, model_mah );
+
+  for( i = 0; i <= step; i++ )
+  {
+    printf( "  step %d: %7.1f s %7.1f mA %7.0f mW %6.2f mAh, ends at %5.0f mV %6.1f mA\n", i + 1,
+            steps[i].ms / 1000, steps[i].settled_ms ? steps[i].sum_ma / steps[i].settled_ms : 0, 
+            steps[i].settled_ms ? steps[i].sum_mw / steps[i].settled_ms : 0, 
+            steps[i].charge_mas / 3600, steps[i].end_mv, steps[i].end_ma );
+    check_step( c, i );
+  }
+
+  /* Let the checkpoint clear land, or the next boot offers a resume */
+  sim_run_ms( 3000 );
+
+  return check_boot_failures();
+}
+
+int main( void )
+{
+  unsigned i;
+
+  sim_setup();
+  program_user( &cases[CASES - 1].profile );
+
+  for( i = 0; i < CASES; i++ )
+  {
+    sim_connect( SIM_CHEM_NIMH, CELLS, CAPACITY_MAH, 0.12, 0.06, 2000.0 );
+    sim->sensor[0].offset_uv = cases[i].offset_uv;
+    sim->load.offset_ma = cases[i].offset_ma;
+    check_boot( replay, (void *)&cases[i] );
+  }
+
+  return check_report( "test_profile" );
+}
@@ -0,0 +1,173 @@
+/* 
+test_resume.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Power cuts at random times during a discharge. Each boot runs in its own
+ * process and is cut short at a random moment, the next one resumes from 
+ * the checkpoint. The resumed session must carry on from exactly what the 
+ * checkpoint holds, energy remainder included, and the finished session 
+ * may only be short by what was discharged after the last checkpoint 
+ * before each cut */
+
+#include <stdlib.h>
+#include <math.h>
+#include "sim.h"
+#include "check.h"
+#include "common.h"
+#include "sample.h"
+#include "history.h"
+#include "checkpoint.h"
+
+#define CAPACITY_MAH 150.0
+#define CURRENT_MA   500
+#define CUT_MIN_MS   20000
+#define CUT_MAX_MS   300000
+#define SEED         12
+
+/* What the resumed session may have added by the time it is checked: the 
+ * conversions in the first 100ms of load, at no more than 6V */
+#define RESUME_SLACK_MAS ( CURRENT_MA * 0.1 )
+#define RESUME_SLACK_UJ  ( CURRENT_MA * 6.0 * 0.1 * 1000.0 )
+
+typedef struct
+{
+  int boot;          /* 0 sets the discharge up, later boots resume it */
+  uint32_t cut_ms;   /* After the load comes on */
+} resume_case;
+
+/* Totals the firmware has counted */
+static double firmware_mas( void )
+{
+  return z_Status.w_CapacityDischarged * 3600.0 + z_Status.w_CapacityRemainder + 
+         z_Status.w_CapacityFraction / (double)C_CHARGE_UNITS_PER_MAS;
+}
+
+static double firmware_uj( void )
+{
+  return z_Status.w_EnergyDischarged * (double)C_ENERGY_UJ_PER_UNIT + z_Status.q_EnergyRemainder;
+}
+
+static int wait_load( void )
+{
+  int i;
+
+  for( i = 0; i < 3000 && sim->load_ma < CURRENT_MA * 0.5; i++ )
+    sim_run_ms( 1 );
+
+  return sim->load_ma >= CURRENT_MA * 0.5;
+}
+
+static int run( void *arg )
+{
+  const resume_case *c = arg;
+  CheckpointRecordType z_Checkpoint;
+  HistoryRecordType z_Record;
+  uint32_t cut_ms;
+  double checkpoint_mas;
+  double checkpoint_uj;
+  double model_mah;
+  double lost_mah;
+  int history;
+
+  if( c->boot == 0 )
+  {
+    CHECK( sim_run_until_lcd( "Mode:", 5000 ), "no mode menu: '%s'", sim_lcd_line( 0 ) );
+    history = HistoryCount();
+
+    CHECK( sim_select( "Full Discharge" ), "mode" );
+    CHECK( sim_select( "NIMH" ), "type" );
+    CHECK( sim_select( "4" ), "cells" );
+    CHECK( sim_select( "500mA" ), "current" );
+    CHECK( wait_load(), "load did not start" );
+  }
+  else
+  {
+    CHECK( sim_run_until_lcd( "Resume", 5000 ), "boot %d: no resume prompt: '%s'", c->boot, sim_lcd_line( 0 ) );
+    history = HistoryCount();
+    CHECK( CheckpointRead( &z_Checkpoint ), "boot %d: no checkpoint", c->boot );
+
+    /* Yes is offered first */
+    sim_short_press();
+    CHECK( wait_load(), "boot %d: load did not start", c->boot );
+
+    /* Carries on from the checkpoint, remainders and all */
+    checkpoint_mas = z_Checkpoint.w_CapacityDischarged * 3600.0 + z_Checkpoint.w_CapacityRemainder + 
+                     z_Checkpoint.w_CapacityFraction / (double)C_CHARGE_UNITS_PER_MAS;
+    checkpoint_uj = z_Checkpoint.w_EnergyDischarged * (double)C_ENERGY_UJ_PER_UNIT + 
+                    z_Checkpoint.q_EnergyRemainder;
+
+    CHECK( firmware_mas() >= checkpoint_mas && firmware_mas() <= checkpoint_mas + RESUME_SLACK_MAS,
+           "boot %d: resumed at %.1f mAs, checkpoint %.1f mAs", c->boot, firmware_mas(), checkpoint_mas );
+    CHECK( firmware_uj() >= checkpoint_uj && firmware_uj() <= checkpoint_uj + RESUME_SLACK_UJ,
+           "boot %d: resumed at %.0f uJ, checkpoint %.0f uJ", c->boot, firmware_uj(), checkpoint_uj );
+    CHECK( z_Status.u_Hours == z_Checkpoint.u_Hours && z_Status.u_Minutes == z_Checkpoint.u_Minutes,
+           "boot %d: resumed at %u:%02u, checkpoint %u:%02u", c->boot, z_Status.u_Hours, 
+           z_Status.u_Minutes, z_Checkpoint.u_Hours, z_Checkpoint.u_Minutes );
+  }
+
+  /* Run to the cut or the finish, whichever comes first */
+  cut_ms = sim->now_ms + c->cut_ms;
+
+  while( HistoryCount() == history && sim->now_ms < cut_ms )
+    sim_run_ms( 1000 );
+
+  if( HistoryCount() == history )
+    return check_boot_failures();
+
+  CHECK( HistoryRead( 0, &z_Record ), "history record" );
+  model_mah = sim->charge_mas / 3600.0;
+
+  /* Every cut loses at most a checkpoint interval, and the write */
+  lost_mah = c->boot * ( C_CHECKPOINT_INTERVAL + 1 ) * CURRENT_MA / 3600.0;
+
+  printf( "resume: %d boots, firmware %u mAh, %u.%02u Wh, model %.1f mAh %.3f Wh, "
+          "up to %.1f mAh lost\n", c->boot + 1, z_Record.w_Capacity, z_Record.w_Energy / 100, 
+          z_Record.w_Energy % 100, model_mah, sim->energy_mj / 3.6e6, lost_mah );
+
+  CHECK( z_Record.w_Capacity <= model_mah + 1.0 + model_mah * 0.01, 
+         "logged %u mAh, model %.1f mAh", z_Record.w_Capacity, model_mah );
+  CHECK( z_Record.w_Capacity >= model_mah - 1.0 - model_mah * 0.01 - lost_mah,
+         "logged %u mAh after %d cuts, model %.1f mAh", z_Record.w_Capacity, c->boot, model_mah );
+
+  return check_boot_failures();
+}
+
+int main( void )
+{
+  resume_case c;
+  int finished = 0;
+
+  srand( SEED );
+
+  sim_setup();
+  sim_connect( SIM_CHEM_NIMH, 4, CAPACITY_MAH, 0.12, 0.06, 2000.0 );
+
+  for( c.boot = 0; c.boot < 20 && !finished; c.boot++ )
+  {
+    c.cut_ms = CUT_MIN_MS + (uint32_t)( rand() % ( ( CUT_MAX_MS - CUT_MIN_MS ) / 1000 ) ) * 1000;
+    check_boot( run, &c );
+
+    /* The shared EEPROM says whether that boot logged the session */
+    HistoryInit();
+    finished = HistoryCount();
+  }
+
+  CHECK( finished, "discharge did not finish in %d boots", c.boot );
+
+  return check_report( "test_resume" );
+}
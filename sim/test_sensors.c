@@ -0,0 +1,209 @@
+/* 
+test_sensors.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Several INA219 sensors. Built for a board with four on the bus: the 
+ * load sensor and three more, each fed its own voltage and current. Runs 
+ * a full discharge and checks the sampler reads every conversion of the 
+ * load sensor, serves the others evenly in the turns between, loses no 
+ * turns while the bus is busy, keeps their results apart, reports them in
+ * the telemetry and still regulates and counts on the load sensor */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "sim.h"
+#include "check.h"
+#include "common.h"
+#include "history.h"
+#include "ina219.h"
+#include "sample.h"
+
+#define CAPACITY_MAH 150.0
+#define CURRENT_MA   500
+#define WINDOW_MS    40000   /* Counted mid discharge, clear of the start 
+                              * and of the first internal resistance pulse,
+                              * whose fast conversions nothing can keep up 
+                              * with */
+#define TURN_MS      6       /* Longest turn, a poll that finds a conversion
+                              * and the reads after it, see sample.c */
+
+/* Inputs of the extra sensors */
+#define SENSOR_MV( i ) ( 1000.0 * (i) + 234.0 )
+#define SENSOR_MA( i ) ( 100.0 * (i) + 50.0 )
+
+static const uint8_t addresses[] = { 0x82, 0x88, 0x8A }; /* C_BOARD_INA219_1..3 */
+
+static const char *prefix;     /* Of the decoder's output files */
+
+static int round_robin( void *arg )
+{
+  unsigned polls[C_SAMPLE_SENSORS];
+  unsigned reads[C_SAMPLE_SENSORS];
+  unsigned conversions[C_SAMPLE_SENSORS];
+  unsigned reported[C_SAMPLE_SENSORS] = { 0 };
+  unsigned long t, voltage, current;
+  int sensor;
+  Ina219SampleType z_Sample;
+  char line[256];
+  FILE *f;
+  long bad;
+  double model_mah;
+  double expected;
+  uint32_t limit_ms;
+  int i;
+
+  (void)arg;
+
+  for( i = 1; i < C_SAMPLE_SENSORS; i++ )
+  {
+    sim->sensor[i].bus_mv = SENSOR_MV( i );
+    sim->sensor[i].current_ma = SENSOR_MA( i );
+  }
+
+  CHECK( sim_run_until_lcd( "Mode:", 5000 ), "no mode menu: '%s'", sim_lcd_line( 0 ) );
+
+  CHECK( sim_select( "Full Discharge" ), "mode" );
+  CHECK( sim_select( "NIMH" ), "type" );
+  CHECK( sim_select( "4" ), "cells" );
+  CHECK( sim_select( "500mA" ), "current" );
+
+  sim_run_ms( 10000 );
+
+  for( i = 0; i < C_SAMPLE_SENSORS; i++ )
+  {
+    polls[i] = sim->sensor[i].reads[SIM_INA219_BUS];
+    reads[i] = sim->sensor[i].reads[SIM_INA219_POWER];
+    conversions[i] = sim->sensor[i].conversions;
+  }
+
+  sim_run_ms( WINDOW_MS );
+
+  /* The load sensor has every other turn, the others share the rest. The 
+   * bus, not the tick, sets the pace: every turn of theirs finds a 
+   * conversion */
+  expected = (double)WINDOW_MS / ( 2 * ( C_SAMPLE_SENSORS - 1 ) * TURN_MS );
+
+  for( i = 0; i < C_SAMPLE_SENSORS; i++ )
+  {
+    polls[i] = sim->sensor[i].reads[SIM_INA219_BUS] - polls[i];
+    reads[i] = sim->sensor[i].reads[SIM_INA219_POWER] - reads[i];
+    conversions[i] = sim->sensor[i].conversions - conversions[i];
+
+    printf( "sensors: 0x%02X polled %u, read %u of %u conversions\n", sim->sensor[i].address, 
+            polls[i], reads[i], conversions[i] );
+
+    /* A turn may straddle either end of the window */
+    CHECK( reads[i] <= conversions[i] + 1, "sensor %d read %u of %u conversions", 
+           i, reads[i], conversions[i] );
+
+    if( i == C_SAMPLE_LOAD_SENSOR )
+    {
+      CHECK( reads[i] + 1 >= conversions[i], "load sensor read %u of %u conversions", 
+             reads[i], conversions[i] );
+      continue;
+    }
+
+    CHECK( abs( (int)polls[i] - (int)polls[1] ) <= 2, "sensor %d polled %u times, sensor 1 %u", 
+           i, polls[i], polls[1] );
+    CHECK( reads[i] >= expected * 0.99, "sensor %d read %u conversions, at least %.0f expected", 
+           i, reads[i], expected );
+  }
+
+  /* Nothing of one sensor lands in another's result. The voltage is 
+   * IN+, the bus input plus the shunt drop, to the 4mV bus LSB */
+  for( i = 1; i < C_SAMPLE_SENSORS; i++ )
+  {
+    SampleGetSensorLatest( i, &z_Sample );
+    expected = SENSOR_MV( i ) + SENSOR_MA( i ) * sim->sensor[i].shunt_ohm;
+
+    CHECK( fabs( z_Sample.w_Voltage - expected ) <= 4, "sensor %d at %umV, fed %.0fmV", 
+           i, z_Sample.w_Voltage, expected );
+    CHECK( fabs( z_Sample.w_Current - SENSOR_MA( i ) ) <= 1, "sensor %d at %umA, fed %.0fmA", 
+           i, z_Sample.w_Current, SENSOR_MA( i ) );
+  }
+
+  CHECK( fabs( sim->load_ma - CURRENT_MA ) < CURRENT_MA * 0.02, "load %.1fmA", sim->load_ma );
+
+  limit_ms = sim->now_ms + (uint32_t)( CAPACITY_MAH * 3600.0 / CURRENT_MA * 1500.0 );
+
+  while( !HistoryCount() && sim->now_ms < limit_ms )
+    sim_run_ms( 5000 );
+
+  CHECK( HistoryCount() == 1, "discharge did not finish in %u s", sim->now_ms / 1000 );
+
+  model_mah = sim->charge_mas / 3600.0;
+
+  printf( "sensors: firmware %u mAh, model %.1f mAh\n", z_Status.w_CapacityDischarged, model_mah );
+
+  CHECK( fabs( z_Status.w_CapacityDischarged - model_mah ) <= 1.0 + model_mah * 0.01, 
+         "capacity %u mAh, model %.1f mAh", z_Status.w_CapacityDischarged, model_mah );
+
+  /* The others' readings go out once a second, whole */
+  bad = sim_decode_telemetry( prefix );
+  CHECK( bad == 0, "decoder found %ld bad frames", bad );
+
+  snprintf( line, sizeof( line ), "%s.sensors.csv", prefix );
+
+  if( ( f = fopen( line, "r" ) ) )
+  {
+    fgets( line, sizeof( line ), f );
+
+    while( fgets( line, sizeof( line ), f ) )
+    {
+      if( sscanf( line, "%lu,%d,%lu,%lu", &t, &sensor, &voltage, &current ) != 4 || 
+          sensor < 1 || sensor >= C_SAMPLE_SENSORS )
+        continue;
+
+      /* Past the first few seconds, the readings are what each was fed */
+      if( t > 10000 &&
+          ( fabs( voltage - SENSOR_MV( sensor ) - SENSOR_MA( sensor ) * sim->sensor[sensor].shunt_ohm ) > 4 ||
+            fabs( current - SENSOR_MA( sensor ) ) > 1 ) )
+        continue;
+
+      reported[sensor]++;
+    }
+
+    fclose( f );
+  }
+
+  for( i = 1; i < C_SAMPLE_SENSORS; i++ )
+    CHECK( reported[i] + 12 >= sim->now_ms / 1000, "sensor %d reported right %u times in %u s", 
+           i, reported[i], sim->now_ms / 1000 );
+
+  return check_boot_failures();
+}
+
+int main( int argc, char **argv )
+{
+  unsigned i;
+
+  (void)argc;
+
+  prefix = argv[0];
+
+  sim_setup();
+  sim_connect( SIM_CHEM_NIMH, 4, CAPACITY_MAH, 0.12, 0.06, 2000.0 );
+
+  for( i = 0; i < sizeof( addresses ); i++ )
+    sim_add_sensor( addresses[i] );
+
+  check_boot( round_robin, NULL );
+
+  return check_report( "test_sensors" );
+}
@@ -0,0 +1,177 @@
+/* 
+test_telemetry.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Telemetry stream. Captures what a full discharge sends on the USART, 
+ * including the periodic internal resistance pulses and their fast 
+ * conversions, and decodes it with Tools/telemetry2csv. Every frame must
+ * arrive whole, none may be dropped for lack of room on the link, and the
+ * samples and status reports must match what the board did */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sim.h"
+#include "check.h"
+#include "history.h"
+
+#define CAPACITY_MAH    150.0
+#define CURRENT_MA      500
+#define STATE_DISCHARGE 11       /* Code/state.c */
+#define LINK_BYTES_S    960.0    /* 9600 baud 8N1 */
+#define LINK_BUDGET     0.6      /* Of the link, leaves room for bursts */
+
+static const char *prefix;     /* Of the decoder's output files */
+static char samples_csv[256];
+static char status_csv[256];
+
+static int telemetry( void *arg )
+{
+  long bad;
+  unsigned long samples = 0;
+  unsigned long on_target = 0;
+  unsigned long discharging = 0;
+  unsigned long statuses = 0;
+  unsigned long max_drops = 0;
+  unsigned long max_overflows = 0;
+  unsigned long min_awake = 1000;
+  unsigned long max_awake = 0;
+  unsigned long last_ms = 0;
+  unsigned long min_gap_ms = ~0UL;
+  unsigned long t, awake, overflows, drops, errors, state, duty;
+  long shunt, bus, voltage;
+  double current;
+  uint32_t seconds;
+  char line[256];
+  FILE *f;
+
+  (void)arg;
+
+  CHECK( sim_run_until_lcd( "Mode:", 5000 ), "no mode menu: '%s'", sim_lcd_line( 0 ) );
+
+  CHECK( sim_select( "Full Discharge" ), "mode" );
+  CHECK( sim_select( "NIMH" ), "type" );
+  CHECK( sim_select( "4" ), "cells" );
+  CHECK( sim_select( "500mA" ), "current" );
+
+  while( !HistoryCount() && sim->now_ms < 3600000UL )
+    sim_run_ms( 5000 );
+
+  CHECK( HistoryCount() == 1, "discharge did not finish" );
+  CHECK( sim->tx_len <= SIM_TX_MAX, "%u bytes sent, only %lu kept", sim->tx_len, SIM_TX_MAX );
+
+  seconds = sim->now_ms / 1000;
+
+  bad = sim_decode_telemetry( prefix );
+
+  CHECK( bad == 0, "decoder found %ld bad frames", bad );
+
+  if( ( f = fopen( samples_csv, "r" ) ) )
+  {
+    fgets( line, sizeof( line ), f );
+
+    while( fgets( line, sizeof( line ), f ) )
+    {
+      if( sscanf( line, "%lu,%ld,%ld,%ld,%lf,%lu,%lu", &t, &shunt, &bus, &voltage, &current, 
+                  &duty, &state ) != 7 )
+        continue;
+
+      if( samples && t - last_ms < min_gap_ms )
+        min_gap_ms = t - last_ms;
+
+      last_ms = t;
+      samples++;
+
+      if( state == STATE_DISCHARGE )
+      {
+        discharging++;
+
+        if( fabs( current - CURRENT_MA ) <= CURRENT_MA * 0.02 && voltage > 4 * 900 - 200 )
+          on_target++;
+      }
+    }
+
+    fclose( f );
+  }
+
+  if( ( f = fopen( status_csv, "r" ) ) )
+  {
+    fgets( line, sizeof( line ), f );
+
+    while( fgets( line, sizeof( line ), f ) )
+    {
+      if( sscanf( line, "%lu,%lu,%lu,%lu,%lu,%lu", &t, &awake, &overflows, &drops, &errors, 
+                  &state ) != 6 )
+        continue;
+
+      statuses++;
+
+      if( drops > max_drops )
+        max_drops = drops;
+      if( overflows > max_overflows )
+        max_overflows = overflows;
+
+      if( awake < min_awake )
+        min_awake = awake;
+      if( awake > max_awake )
+        max_awake = awake;
+    }
+
+    fclose( f );
+  }
+
+  printf( "telemetry: %u bytes in %u s ( %.0f%% of the link ), %lu samples, %lu status, "
+          "awake %lu - %lu ms/s\n", sim->tx_len, seconds, 
+          100.0 * sim->tx_len / seconds / LINK_BYTES_S, samples, statuses, min_awake, max_awake );
+
+  CHECK( sim->tx_len <= seconds * LINK_BYTES_S * LINK_BUDGET, "%.0f bytes/s sent", 
+         (double)sim->tx_len / seconds );
+  CHECK( max_drops == 0, "%lu frames dropped", max_drops );
+  CHECK( max_overflows == 0, "%lu events lost", max_overflows );
+  CHECK( statuses + 2 >= seconds && statuses <= seconds + 1, "%lu status frames in %u s", 
+         statuses, seconds );
+  /* The simulation only charges time to sleeps and delays, so the main loop
+   * shows up as awake for its LCD delays alone */
+  CHECK( max_awake > 0 && max_awake < 1000, "awake %lu - %lu ms/s", min_awake, max_awake );
+  CHECK( discharging > seconds * 10, "%lu samples while discharging", discharging );
+  CHECK( on_target >= discharging * 0.9, "%lu of %lu samples at %umA", on_target, discharging, 
+         CURRENT_MA );
+  CHECK( min_gap_ms >= 1, "samples out of order or repeated" );
+
+  /* Let the checkpoint clear land */
+  sim_run_ms( 3000 );
+
+  return check_boot_failures();
+}
+
+int main( int argc, char **argv )
+{
+  (void)argc;
+
+  prefix = argv[0];
+  snprintf( samples_csv, sizeof( samples_csv ), "%s.samples.csv", prefix );
+  snprintf( status_csv, sizeof( status_csv ), "%s.status.csv", prefix );
+
+  sim_setup();
+  sim_connect( SIM_CHEM_NIMH, 4, CAPACITY_MAH, 0.12, 0.06, 2000.0 );
+
+  check_boot( telemetry, NULL );
+
+  return check_report( "test_telemetry" );
+}
@@ -0,0 +1,157 @@
+/* 
+test_tracking.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Constant power and constant resistance tracking. Runs each mode on a 
+ * pack with a high internal resistance, so the voltage sags a long way 
+ * over the discharge and the load current has to follow it. Every second 
+ * of the discharge the mean power, or the mean current against the mean 
+ * voltage, must match the setting */
+
+#include <math.h>
+#include "sim.h"
+#include "check.h"
+#include "common.h"
+#include "history.h"
+
+#define CELLS        6
+#define CUTOFF_MV    ( CELLS * 900 )
+#define CAPACITY_MAH 300.0
+#define TRACK_BAND   0.02   /* Of the setting, per one second window */
+#define START_S      2      /* Windows skipped while the regulator settles */
+#define END_S        2      /* Windows skipped at the cutoff collapse */
+#define WINDOWS_MAX  7200
+
+typedef struct
+{
+  const char *mode_text;
+  const char *setting_screen;
+  int power;       /* Settings, 0.1W or 0.1 Ohm, the firmware defaults */
+  int resistance;
+} tracking_case;
+
+static const tracking_case cases[] =
+{
+  { "Const Power",      "Power:",      50, 0 },
+  { "Const Resistance", "Resistance:", 0, 100 }
+};
+
+#define CASES ( sizeof( cases ) / sizeof( cases[0] ) )
+
+/* Each one second window: relative error, mean voltage and current */
+static double error[WINDOWS_MAX];
+static double mean_v[WINDOWS_MAX];
+static double mean_i[WINDOWS_MAX];
+
+static int track( void *arg )
+{
+  const tracking_case *c = arg;
+  double worst = 0;
+  int windows = 0;
+  int last;
+  int history;
+  int i;
+
+  CHECK( sim_run_until_lcd( "Mode:", 5000 ), "no mode menu" );
+  history = HistoryCount();
+
+  CHECK( sim_select( c->mode_text ), "mode" );
+  CHECK( sim_select( "NIMH" ), "type" );
+  CHECK( sim_select( "6" ), "cells" );
+  CHECK( sim_run_until_lcd( c->setting_screen, 1000 ), "no %s screen", c->setting_screen );
+  sim_short_press();
+
+  /* The 1Hz tick finds the pack and starts the load */
+  for( i = 0; i < 3000 && sim->load_ma < 10; i++ )
+    sim_run_ms( 1 );
+
+  while( HistoryCount() == history && windows < WINDOWS_MAX )
+  {
+    double sum_p = 0;
+    double sum_i = 0;
+    double sum_v = 0;
+    double v;
+
+    for( i = 0; i < 1000; i++ )
+    {
+      sim_run_ms( 1 );
+      v = sim_battery_voltage( &sim->cell, sim->load_ma );
+      sum_p += v * sim->load_ma * 1e-6;
+      sum_i += sim->load_ma;
+      sum_v += v;
+    }
+
+    mean_v[windows] = sum_v / 1000;
+    mean_i[windows] = sum_i / 1000;
+
+    if( c->power )
+      error[windows] = ( sum_p / 1000 - c->power / 10.0 ) / ( c->power / 10.0 );
+    else
+      error[windows] = ( sum_i / 1000 - sum_v * 10.0 / c->resistance / 1000 ) / 
+                       ( sum_v * 10.0 / c->resistance / 1000 );
+
+    /* The running screen shows charge and energy */
+    if( windows == START_S )
+      CHECK( sim_lcd_contains( "mAh" ) && sim_lcd_contains( "Wh" ), "'%s' '%s'", 
+             sim_lcd_line( 0 ), sim_lcd_line( 1 ) );
+
+    windows++;
+  }
+
+  CHECK( HistoryCount() != history, "%s did not finish in %d s", c->mode_text, windows );
+
+  /* Let the checkpoint clear land, or the next boot offers a resume */
+  sim_run_ms( 3000 );
+
+  /* Windows ending at the cutoff see the voltage collapse and the load go */
+  last = windows - END_S - 1;
+
+  for( i = START_S; i <= last; i++ )
+    if( fabs( error[i] ) > fabs( worst ) )
+      worst = error[i];
+
+  printf( "tracking: %-16s %5.2fV -> %5.2fV, %4.0fmA -> %4.0fmA, worst window %+.2f%% over %d s\n",
+          c->mode_text, mean_v[START_S] / 1000, mean_v[last] / 1000, mean_i[START_S], 
+          mean_i[last], worst * 100, windows );
+
+  CHECK( fabs( worst ) <= TRACK_BAND, "%s off by %+.2f%%", c->mode_text, worst * 100 );
+
+  /* The sag is what makes this a tracking test */
+  CHECK( mean_v[last] < mean_v[START_S] * 0.85, "voltage only sagged from %.0f to %.0f mV", 
+         mean_v[START_S], mean_v[last] );
+
+  /* And stops at the cutoff of the cells that were set */
+  CHECK( mean_v[last] >= CUTOFF_MV, "ran on to %.0f mV", mean_v[last] );
+
+  return check_boot_failures();
+}
+
+int main( void )
+{
+  unsigned i;
+
+  sim_setup();
+
+  for( i = 0; i < CASES; i++ )
+  {
+    sim_connect( SIM_CHEM_NIMH, CELLS, CAPACITY_MAH, 0.6, 0.3, 1000.0 );
+    check_boot( track, (void *)&cases[i] );
+  }
+
+  return check_report( "test_tracking" );
+}
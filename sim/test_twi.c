@@ -0,0 +1,237 @@
+/* 
+test_twi.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* Interrupt driven TWI driver and the INA219 driver on top of it, against
+ * the simulated bus. The main loop is never started, the test queues 
+ * transactions itself and lets the TWI interrupt run them */
+
+#include "sim.h"
+#include "twi_bus.h"
+#include "check.h"
+#include "types.h"
+#include "isr.h"
+#include "twi.h"
+#include "ina219.h"
+#include "board.h"
+
+#define LOAD_SENSOR 0x80
+#define MISSING     0x90
+#define RETRIES     10   /* C_TWI_MAX_RETRIES */
+
+/* Done flags of the events posted so far, in order */
+static int drain( uint8 *p_Flags, int max )
+{
+  ISREventType z_Event;
+  int count = 0;
+
+  while( ISRGetEvent( &z_Event ) )
+  {
+    if( count < max )
+      p_Flags[count] = z_Event.u_Flags;
+    count++;
+  }
+
+  return count;
+}
+
+static void test_write_read( void )
+{
+  uint16 w_Result = 0;
+  uint8 a_Flags[4];
+
+  CHECK( TWIQueueWrite( LOAD_SENSOR, SIM_INA219_CALIBRATION, 0x29B0, C_ISR_FLAG_SAMPLE_TICK ), "write queued" );
+  CHECK( TWIQueueRead( LOAD_SENSOR, SIM_INA219_CALIBRATION, &w_Result, C_ISR_FLAG_SAMPLE_READY ), "read queued" );
+
+  /* Queueing hands the bus to the interrupt and returns */
+  CHECK( sim_twi_actions == 0, "%lu bus actions before any time passed", sim_twi_actions );
+  CHECK( TWIBusy(), "busy while queued" );
+
+  /* 6 + 8 bus actions at 62.5kHz SCL */
+  sim_run_hardware_ms( 3 );
+
+  CHECK( !TWIBusy(), "idle after 3ms" );
+  CHECK( sim->sensor[0].reg[SIM_INA219_CALIBRATION] == 0x29B0, "device holds %04X", 
+         sim->sensor[0].reg[SIM_INA219_CALIBRATION] );
+  CHECK( w_Result == 0x29B0, "read back %04X", w_Result );
+  CHECK( drain( a_Flags, 4 ) == 2, "two completions" );
+  CHECK( a_Flags[0] == C_ISR_FLAG_SAMPLE_TICK && a_Flags[1] == C_ISR_FLAG_SAMPLE_READY, 
+         "completions out of order %02X %02X", a_Flags[0], a_Flags[1] );
+}
+
+static void test_queue_full( void )
+{
+  uint16 a_Result[C_TWI_QUEUE_SIZE + 1];
+  uint8 a_Flags[C_TWI_QUEUE_SIZE + 1];
+  int i;
+
+  for( i = 0; i < C_TWI_QUEUE_SIZE; i++ )
+  {
+    a_Result[i] = 0;
+    CHECK( TWIQueueRead( LOAD_SENSOR, SIM_INA219_CONFIG, &a_Result[i], C_ISR_FLAG_CONVERSION_POLL ), 
+           "read %d queued", i );
+  }
+
+  CHECK( !TWIQueueRead( LOAD_SENSOR, SIM_INA219_CONFIG, &a_Result[i], C_ISR_FLAG_CONVERSION_POLL ), 
+         "queue takes more than %d", C_TWI_QUEUE_SIZE );
+
+  sim_run_hardware_ms( 12 );
+
+  CHECK( !TWIBusy(), "idle after 12ms" );
+  CHECK( drain( a_Flags, C_TWI_QUEUE_SIZE + 1 ) == C_TWI_QUEUE_SIZE, "completions" );
+
+  for( i = 0; i < C_TWI_QUEUE_SIZE; i++ )
+    CHECK( a_Result[i] == 0x399F, "read %d got %04X", i, a_Result[i] );
+}
+
+static void test_nack( void )
+{
+  uint16 w_Result = 0xBEEF;
+  uint8 u_Errors = TWIGetErrorCount();
+  uint8 a_Flags[4];
+
+  /* A device that is busy for a while is retried */
+  sim->sensor[0].nack = 3;
+  sim->sensor[0].naks_sent = 0;
+  TWIQueueRead( LOAD_SENSOR, SIM_INA219_CONFIG, &w_Result, C_ISR_FLAG_CONVERSION_POLL );
+  sim_run_hardware_ms( 5 );
+
+  CHECK( w_Result == 0x399F, "read after retries got %04X", w_Result );
+  CHECK( sim->sensor[0].naks_sent == 3, "%u NACKs", sim->sensor[0].naks_sent );
+  CHECK( TWIGetErrorCount() == u_Errors, "retried read counted as an error" );
+  CHECK( drain( a_Flags, 4 ) == 1, "one completion" );
+
+  /* One that never answers is given up on, but still completes */
+  w_Result = 0xBEEF;
+  sim->sensor[0].nack = RETRIES;
+  TWIQueueRead( LOAD_SENSOR, SIM_INA219_CONFIG, &w_Result, C_ISR_FLAG_CONVERSION_POLL );
+  sim_run_hardware_ms( 10 );
+
+  CHECK( !TWIBusy(), "gave up" );
+  CHECK( w_Result == 0xBEEF, "failed read stored %04X", w_Result );
+  CHECK( TWIGetErrorCount() == (uint8)( u_Errors + 1 ), "error count %u", TWIGetErrorCount() );
+  CHECK( drain( a_Flags, 4 ) == 1, "failed read completes" );
+
+  /* Nothing at the address at all, and the bus is still usable after */
+  TWIQueueRead( MISSING, SIM_INA219_CONFIG, &w_Result, C_ISR_FLAG_CONVERSION_POLL );
+  TWIQueueRead( LOAD_SENSOR, SIM_INA219_CONFIG, &w_Result, C_ISR_FLAG_SAMPLE_READY );
+  sim_run_hardware_ms( 10 );
+
+  CHECK( TWIGetErrorCount() == (uint8)( u_Errors + 2 ), "error count %u", TWIGetErrorCount() );
+  CHECK( w_Result == 0x399F, "read after a missing device got %04X", w_Result );
+  CHECK( drain( a_Flags, 4 ) == 2, "both complete" );
+}
+
+/* A transaction queued as the last one finishes, before its stop is out */
+static void test_stop_start( void )
+{
+  uint16 w_First = 0;
+  uint16 w_Second = 0;
+  uint8 a_Flags[4];
+
+  TWIQueueRead( LOAD_SENSOR, SIM_INA219_CONFIG, &w_First, C_ISR_FLAG_CONVERSION_POLL );
+
+  while( TWIBusy() )
+    sim_twi_step();
+
+  CHECK( TWCR & _BV(TWSTO), "stop already sent" );
+
+  /* A start written over the stop turns the bus around instead, and the 
+   * read would get the first register again */
+  TWIQueueRead( LOAD_SENSOR, SIM_INA219_CALIBRATION, &w_Second, C_ISR_FLAG_SAMPLE_READY );
+  sim_run_hardware_ms( 3 );
+
+  CHECK( w_First == 0x399F, "first read got %04X", w_First );
+  CHECK( w_Second == 0x29B0, "second read got %04X", w_Second );
+  CHECK( drain( a_Flags, 4 ) == 2, "both complete" );
+}
+
+/* On a device of its own, the one at 0x80 follows the load model */
+static void test_ina219( void )
+{
+  Ina219Type z_Device = C_BOARD_INA219_1;
+  Ina219SampleType z_Sample;
+  sim_ina219 *d = sim_add_sensor( z_Device.u_Address );
+  uint16 w_Filler;
+  uint8 a_Flags[4];
+  int i;
+
+  d->current_ma = 1000.0;
+  d->bus_mv = 7400.0;
+
+  ina219_init( &z_Device );
+  sim_run_hardware_ms( 40 );
+
+  CHECK( d->reg[SIM_INA219_CONFIG] == C_INA219_CONFIG_AVERAGED, "config %04X", 
+         d->reg[SIM_INA219_CONFIG] );
+  CHECK( d->reg[SIM_INA219_CALIBRATION] == ( C_INA219_CAL_DEFAULT & 0xFFFE ), 
+         "calibration %04X", d->reg[SIM_INA219_CALIBRATION] );
+  drain( a_Flags, 4 );
+
+  CHECK( ina219_start_poll( &z_Device ), "poll queued" );
+  sim_run_hardware_ms( 2 );
+  CHECK( drain( a_Flags, 4 ) == 1 && a_Flags[0] == C_ISR_FLAG_CONVERSION_POLL, "poll completion" );
+  CHECK( ina219_conversion_ready( &z_Device ), "conversion ready after 40ms" );
+
+  CHECK( ina219_start_sample( &z_Device ), "sample queued" );
+  sim_run_hardware_ms( 4 );
+  CHECK( drain( a_Flags, 4 ) == 1 && a_Flags[0] == C_ISR_FLAG_SAMPLE_READY, "sample completion" );
+
+  ina219_get_sample( &z_Device, &z_Sample );
+  /* The chip truncates 3838 * 10672 / 4096 to 9999 */
+  CHECK( z_Sample.w_Current >= 999 && z_Sample.w_Current <= 1000, "current %u mA", z_Sample.w_Current );
+  CHECK( z_Sample.w_Voltage >= 7436 && z_Sample.w_Voltage <= 7440, "voltage %u mV", z_Sample.w_Voltage );
+
+  /* Reading power cleared CNVR */
+  ina219_start_poll( &z_Device );
+  sim_run_hardware_ms( 2 );
+  drain( a_Flags, 4 );
+  CHECK( !ina219_conversion_ready( &z_Device ), "conversion still ready after the power read" );
+
+  /* A sample is queued whole or not at all */
+  for( i = 0; i < C_TWI_QUEUE_SIZE - 2; i++ )
+    TWIQueueRead( LOAD_SENSOR, SIM_INA219_CONFIG, &w_Filler, 0 );
+
+  CHECK( !ina219_start_sample( &z_Device ), "sample queued without room" );
+  CHECK( TWIQueueFree() == 2, "%u free after a refused sample", TWIQueueFree() );
+  sim_run_hardware_ms( 10 );
+  CHECK( drain( a_Flags, 4 ) == 0, "a refused sample completed" );
+}
+
+static int run( void *arg )
+{
+  (void)arg;
+
+  TWIInit();
+
+  test_write_read();
+  test_queue_full();
+  test_nack();
+  test_stop_start();
+  test_ina219();
+
+  return check_boot_failures();
+}
+
+int main( void )
+{
+  sim_setup();
+  check_boot( run, NULL );
+
+  return check_report( "test_twi" );
+}
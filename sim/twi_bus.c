@@ -0,0 +1,198 @@
+/* 
+twi_bus.c
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+#include <stddef.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <compat/twi.h>
+#include "twi_bus.h"
+
+/* While TWINT is set in TWCR the firmware has asked for an action that the
+ * unit has not done yet. The unit clears it when the action starts, the 
+ * opposite of the real flag, so a firmware that fails to answer an 
+ * interrupt leaves the bus hanging here too */
+typedef enum
+{
+  BUS_IDLE,     /* Stop sent, or never started */
+  BUS_ADDRESS,  /* Start sent, SLA+R/W next */
+  BUS_WRITE,    /* Slave addressed for writing */
+  BUS_READ,     /* Slave addressed for reading */
+  BUS_REFUSED   /* Address not acknowledged, waiting for stop or start */
+} bus_state;
+
+static sim_ina219 *devices[SIM_TWI_DEVICES_MAX];
+static int device_count;
+static bus_state state;
+static sim_ina219 *selected;
+static int byte_index;
+static uint8_t write_msb;
+static uint16_t read_value;
+
+unsigned long sim_twi_actions;
+unsigned long sim_twi_naks;
+
+void sim_twi_reset( void )
+{
+  device_count = 0;
+  state = BUS_IDLE;
+  selected = NULL;
+  sim_twi_actions = 0;
+  sim_twi_naks = 0;
+}
+
+void sim_twi_attach( sim_ina219 *d )
+{
+  if( device_count < SIM_TWI_DEVICES_MAX )
+    devices[device_count++] = d;
+}
+
+double sim_twi_actions_per_ms( void )
+{
+  static const unsigned prescale[4] = { 1, 4, 16, 64 };
+  double scl_hz = F_CPU / ( 16.0 + 2.0 * TWBR * prescale[TWSR & 0x3] );
+
+  /* Eight data bits and an acknowledge */
+  return scl_hz / 9.0 / 1000.0;
+}
+
+static sim_ina219 *find( uint8_t address )
+{
+  int i;
+
+  for( i = 0; i < device_count; i++ )
+  {
+    if( devices[i]->address == address )
+      return devices[i];
+  }
+
+  return NULL;
+}
+
+/* Address phase. Returns the status code */
+static uint8_t address_phase( uint8_t sla )
+{
+  int reading = sla & TW_READ;
+
+  selected = find( sla & ~TW_READ );
+  byte_index = 0;
+
+  if( selected && selected->nack )
+  {
+    selected->nack--;
+    selected->naks_sent++;
+    selected = NULL;
+  }
+
+  if( !selected )
+  {
+    sim_twi_naks++;
+    state = BUS_REFUSED;
+    return reading ? TW_MR_SLA_NACK : TW_MT_SLA_NACK;
+  }
+
+  state = reading ? BUS_READ : BUS_WRITE;
+  return reading ? TW_MR_SLA_ACK : TW_MT_SLA_ACK;
+}
+
+/* Data byte from the master: register pointer, then MSB, then LSB */
+static uint8_t write_phase( uint8_t data )
+{
+  if( byte_index == 0 )
+    selected->pointer = data;
+  else if( byte_index == 1 )
+    write_msb = data;
+  else if( byte_index == 2 )
+    sim_ina219_write( selected, selected->pointer, (uint16_t)( write_msb << 8 | data ) );
+
+  byte_index++;
+
+  return TW_MT_DATA_ACK;
+}
+
+/* Data byte to the master. The register is captured on the first byte */
+static uint8_t read_phase( int ack )
+{
+  if( byte_index == 0 )
+    read_value = sim_ina219_read( selected, selected->pointer );
+
+  TWDR = byte_index == 0 ? (uint8_t)( read_value >> 8 ) : 
+         byte_index == 1 ? (uint8_t)read_value : 0xFF;
+  byte_index++;
+
+  return ack ? TW_MR_DATA_ACK : TW_MR_DATA_NACK;
+}
+
+int sim_twi_step( void )
+{
+  uint8_t command = TWCR;
+  uint8_t status;
+
+  if( !( command & _BV(TWEN) ) || !( command & _BV(TWINT) ) )
+    return 0;
+
+  TWCR = command & ~_BV(TWINT);
+  sim_twi_actions++;
+
+  if( command & _BV(TWSTO) )
+  {
+    state = BUS_IDLE;
+    selected = NULL;
+    TWCR &= ~_BV(TWSTO);
+
+    /* Stop alone does not interrupt */
+    if( !( command & _BV(TWSTA) ) )
+      return 1;
+  }
+
+  if( command & _BV(TWSTA) )
+  {
+    status = state == BUS_IDLE ? TW_START : TW_REP_START;
+    state = BUS_ADDRESS;
+    selected = NULL;
+  }
+  else
+  {
+    switch( state )
+    {
+      case BUS_ADDRESS:
+        status = address_phase( TWDR );
+        break;
+
+      case BUS_WRITE:
+        status = write_phase( TWDR );
+        break;
+
+      case BUS_READ:
+        status = read_phase( command & _BV(TWEA) );
+        break;
+
+      default:
+        /* Nobody is listening */
+        status = TW_BUS_ERROR;
+        break;
+    }
+  }
+
+  TWSR = ( TWSR & 0x3 ) | status;
+
+  if( command & _BV(TWIE) )
+    TWI_vect();
+
+  return 1;
+}
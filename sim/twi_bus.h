@@ -0,0 +1,54 @@
+/* 
+twi_bus.h
+Copyright (C) 2010 Scott Stickeler
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA. 
+*/
+
+/* TWI peripheral and bus model for the host simulation. Works on the 
+ * firmware's register writes the way the ATmega168 TWI unit does: a TWCR 
+ * write with TWINT set starts the next bus action, and when it completes 
+ * TWSR holds the status code and TWI_vect is called if TWIE is set. Bus 
+ * actions complete one at a time at the SCL rate set by TWBR, so the 
+ * firmware sees the same interleaving with its other interrupts as on the 
+ * board */
+
+#ifndef SIM_TWI_BUS_H
+#define SIM_TWI_BUS_H
+
+#include "ina219_dev.h"
+
+#define SIM_TWI_DEVICES_MAX 8
+
+/* Detach everything and release the bus */
+void sim_twi_reset( void );
+
+/* Put a device on the bus */
+void sim_twi_attach( sim_ina219 *d );
+
+/* Bus actions ( start, address, data byte or stop ) per millisecond at the
+ * SCL rate set in TWBR / TWSR */
+double sim_twi_actions_per_ms( void );
+
+/* Complete the pending bus action, if the firmware has started one
+ *   Returns 1 if an action was completed
+ */
+int sim_twi_step( void );
+
+/* Completed bus actions and address phases that were not acknowledged */
+extern unsigned long sim_twi_actions;
+extern unsigned long sim_twi_naks;
+
+#endif